@@ -0,0 +1,235 @@
+/// @file
+/// @brief Compare compression ratio and throughput of Blosc-wrapped zstd and
+/// dictionary-primed zstd on small chunks. Acquires the same number of frames
+/// from the simulated radial sine camera into 64x64x16 chunks with each of the
+/// ZarrBlosc1ZstdByteShuffle and ZarrZstdDictionary devices, then sweeps the
+/// dictionary size through the `zstd_dictionary_bytes` device option, and
+/// reports the bytes of chunk data written and the acquisition rate for each.
+
+#include "device/hal/device.manager.h"
+#include "acquire.h"
+#include "logger.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "tests/json.hpp"
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+const static uint32_t frame_width = 512;
+const static uint32_t frame_height = 512;
+const static uint32_t chunk_width = 64;
+const static uint32_t chunk_height = 64;
+const static uint32_t frames_per_chunk = 16;
+const static uint32_t max_frame_count = 256;
+
+struct BenchmarkResult
+{
+    size_t frames_written;
+    size_t bytes_of_chunks;
+    double seconds;
+};
+
+/// Sum the sizes of all chunk files under the first array of the dataset.
+size_t
+bytes_of_chunks(const fs::path& array_path)
+{
+    size_t nbytes = 0;
+    for (const auto& entry : fs::recursive_directory_iterator(array_path)) {
+        const auto filename = entry.path().filename().string();
+        if (entry.is_regular_file() && !filename.starts_with(".") &&
+            filename != "zstd.dict") {
+            nbytes += entry.file_size();
+        }
+    }
+    return nbytes;
+}
+
+BenchmarkResult
+acquire(AcquireRuntime* runtime,
+        const char* device_name,
+        const char* filename,
+        const std::string& external_metadata)
+{
+    auto dm = acquire_device_manager(runtime);
+    CHECK(runtime);
+    CHECK(dm);
+
+    AcquireProperties props = {};
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                SIZED("simulated.*radial.*"),
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                device_name,
+                                strlen(device_name),
+                                &props.video[0].storage.identifier));
+
+    const struct PixelScale sample_spacing_um = { 1, 1 };
+
+    storage_properties_init(&props.video[0].storage.settings,
+                            0,
+                            (char*)filename,
+                            strlen(filename) + 1,
+                            (char*)external_metadata.c_str(),
+                            external_metadata.size() + 1,
+                            sample_spacing_um,
+                            3);
+
+    CHECK(storage_properties_set_dimension(&props.video[0].storage.settings,
+                                           0,
+                                           SIZED("x") + 1,
+                                           DimensionType_Space,
+                                           frame_width,
+                                           chunk_width,
+                                           0));
+    CHECK(storage_properties_set_dimension(&props.video[0].storage.settings,
+                                           1,
+                                           SIZED("y") + 1,
+                                           DimensionType_Space,
+                                           frame_height,
+                                           chunk_height,
+                                           0));
+    CHECK(storage_properties_set_dimension(&props.video[0].storage.settings,
+                                           2,
+                                           SIZED("t") + 1,
+                                           DimensionType_Time,
+                                           0,
+                                           frames_per_chunk,
+                                           0));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = SampleType_u16;
+    props.video[0].camera.settings.shape = { .x = frame_width,
+                                             .y = frame_height };
+    props.video[0].camera.settings.exposure_time_us = 1e3;
+    props.video[0].max_frame_count = max_frame_count;
+
+    OK(acquire_configure(runtime, &props));
+
+    const auto start = std::chrono::steady_clock::now();
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+    const auto stop = std::chrono::steady_clock::now();
+
+    const auto zarray_path = fs::path(filename) / "0" / ".zarray";
+    CHECK(fs::is_regular_file(zarray_path));
+    std::ifstream f(zarray_path);
+    json zarray = json::parse(f);
+
+    return {
+        .frames_written = zarray["shape"][0].get<size_t>(),
+        .bytes_of_chunks = bytes_of_chunks(fs::path(filename) / "0"),
+        .seconds = std::chrono::duration<double>(stop - start).count(),
+    };
+}
+
+void
+report(const std::string& label, const BenchmarkResult& result)
+{
+    const double bytes_of_frames = (double)result.frames_written *
+                                   frame_width * frame_height *
+                                   sizeof(uint16_t);
+    LOG("%s: %zu frames, ratio %.3f, %.1f MiB/s",
+        label.c_str(),
+        result.frames_written,
+        bytes_of_frames / (double)result.bytes_of_chunks,
+        bytes_of_frames / result.seconds / (1 << 20));
+}
+
+int
+main()
+{
+    auto runtime = acquire_init(reporter);
+
+    int retval = 1;
+    try {
+        for (const auto* device_name :
+             { "ZarrBlosc1ZstdByteShuffle", "ZarrZstdDictionary" }) {
+            const auto filename = std::string(EXAMPLE "-") + device_name +
+                                  ".zarr";
+            if (fs::exists(filename)) {
+                fs::remove_all(filename);
+            }
+
+            const auto result =
+              acquire(runtime, device_name, filename.c_str(), "{}");
+            report(device_name, result);
+        }
+
+        // smaller dictionaries train faster but prime less of each chunk
+        for (const size_t dictionary_bytes : { 1 << 12, 1 << 14, 1 << 16 }) {
+            const auto label = "ZarrZstdDictionary (" +
+                               std::to_string(dictionary_bytes) + " bytes)";
+            const auto filename = std::string(EXAMPLE "-ZarrZstdDictionary-") +
+                                  std::to_string(dictionary_bytes) + ".zarr";
+            if (fs::exists(filename)) {
+                fs::remove_all(filename);
+            }
+
+            const auto external_metadata =
+              json({ { "acquire_zarr_options",
+                       { { "zstd_dictionary_bytes", dictionary_bytes } } } })
+                .dump();
+            const auto result = acquire(runtime,
+                                        "ZarrZstdDictionary",
+                                        filename.c_str(),
+                                        external_metadata);
+            report(label, result);
+        }
+        retval = 0;
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Exception: (unknown)");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
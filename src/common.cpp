@@ -4,6 +4,7 @@
 #include "platform.h"
 
 #include <cmath>
+#include <latch>
 #include <thread>
 
 namespace zarr = acquire::sink::zarr;
@@ -36,6 +37,8 @@ zarr::Dimension::Dimension(const StorageDimension& dim)
 common::ThreadPool::ThreadPool(size_t n_threads,
                                std::function<void(const std::string&)> err)
   : error_handler_{ err }
+  , n_busy_{ 0 }
+  , n_lent_{ 0 }
   , is_accepting_jobs_{ true }
 {
     n_threads = std::clamp(
@@ -72,6 +75,32 @@ common::ThreadPool::push_to_job_queue(JobT&& job)
     cv_.notify_one();
 }
 
+size_t
+common::ThreadPool::n_threads() const noexcept
+{
+    return threads_.size();
+}
+
+size_t
+common::ThreadPool::borrow_idle_threads(size_t n_jobs) noexcept
+{
+    std::scoped_lock lock(jobs_mutex_);
+
+    const size_t n_claimed = n_busy_ + jobs_.size() + n_lent_ + n_jobs;
+    const size_t n_idle =
+      n_claimed < threads_.size() ? threads_.size() - n_claimed : 0;
+    n_lent_ += n_idle;
+
+    return n_idle;
+}
+
+void
+common::ThreadPool::return_threads(size_t n) noexcept
+{
+    std::scoped_lock lock(jobs_mutex_);
+    n_lent_ -= std::min(n, n_lent_);
+}
+
 void
 common::ThreadPool::await_stop() noexcept
 {
@@ -122,10 +151,13 @@ common::ThreadPool::thread_worker_()
         }
 
         if (auto job = pop_from_job_queue_(); job.has_value()) {
+            ++n_busy_;
             lock.unlock();
             if (std::string err_msg; !job.value()(err_msg)) {
                 error_handler_(err_msg);
             }
+            lock.lock();
+            --n_busy_;
         }
     }
 
@@ -212,6 +244,61 @@ common::sample_type_to_dtype(SampleType t)
     }
 }
 
+uint8_t
+common::bit_depth(SampleType t)
+{
+    static const uint8_t table[] = { 8, 16, 8, 16, 32, 10, 12, 14 };
+    if (t < countof(table)) {
+        return table[t];
+    } else {
+        throw std::runtime_error("Invalid sample type.");
+    }
+}
+
+size_t
+common::channels(const ImageShape& shape)
+{
+    return shape.dims.channels ? shape.dims.channels : 1;
+}
+
+size_t
+common::channel_stride(const ImageShape& shape)
+{
+    EXPECT(shape.strides.channels >= 0, "Negative strides are not supported.");
+    return shape.strides.channels ? (size_t)shape.strides.channels : 1;
+}
+
+size_t
+common::sample_stride(const ImageShape& shape)
+{
+    EXPECT(shape.strides.width >= 0, "Negative strides are not supported.");
+    return shape.strides.width ? (size_t)shape.strides.width : channels(shape);
+}
+
+size_t
+common::row_stride(const ImageShape& shape)
+{
+    EXPECT(shape.strides.height >= 0, "Negative strides are not supported.");
+    if (shape.strides.height) {
+        return (size_t)shape.strides.height;
+    }
+
+    return shape.dims.width * sample_stride(shape);
+}
+
+size_t
+common::bytes_of_strided_frame(const ImageShape& shape)
+{
+    if (shape.dims.width == 0 || shape.dims.height == 0) {
+        return 0;
+    }
+
+    const size_t last_sample = (shape.dims.height - 1) * row_stride(shape) +
+                               (shape.dims.width - 1) * sample_stride(shape) +
+                               (channels(shape) - 1) * channel_stride(shape);
+    return (last_sample + 1) * bytes_of_type(shape.type);
+}
+
 const char*
 common::sample_type_to_string(SampleType t) noexcept
 {
@@ -241,3 +328,61 @@ common::write_string(const std::string& path, const std::string& str)
     TRACE("Wrote %d bytes to \"%s\".", str.size(), path.c_str());
     file_close(&f);
 }
+
+#ifndef NO_UNIT_TESTS
+#ifdef _WIN32
+#define acquire_export __declspec(dllexport)
+#else
+#define acquire_export
+#endif
+
+extern "C"
+{
+    acquire_export int unit_test__thread_pool__borrow_idle_threads()
+    {
+        int retval = 0;
+        try {
+            common::ThreadPool pool(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+            const auto n = pool.n_threads();
+
+            // threads already lent aren't lent again
+            CHECK(pool.borrow_idle_threads(0) == n);
+            CHECK(pool.borrow_idle_threads(0) == 0);
+            pool.return_threads(n);
+
+            // nor are threads set aside for jobs about to be queued
+            CHECK(pool.borrow_idle_threads(1) == n - 1);
+            pool.return_threads(n - 1);
+
+            // nor are threads running a job
+            std::atomic<bool> started = false, release = false;
+            std::latch done(1);
+            pool.push_to_job_queue([&](std::string&) {
+                started = true;
+                while (!release) {
+                    std::this_thread::yield();
+                }
+                done.count_down();
+                return true;
+            });
+            while (!started) {
+                std::this_thread::yield();
+            }
+            CHECK(pool.borrow_idle_threads(0) == n - 1);
+            pool.return_threads(n - 1);
+
+            release = true;
+            done.wait();
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+}
+#endif
@@ -69,6 +69,22 @@ struct ThreadPool final
 
     void push_to_job_queue(JobT&& job);
 
+    /// @brief Get the number of worker threads in the pool.
+    size_t n_threads() const noexcept;
+
+    /// @brief Claim the worker threads that would still be idle once
+    /// @p n_jobs more jobs are queued, for use by threads outside the pool,
+    /// e.g., Blosc's internal threads.
+    /// @details Threads that are running or waiting for a job, or that are
+    /// already claimed, are never claimed again, so that the threads claimed
+    /// across every user of the pool never exceed the idle ones.
+    /// @return The number of threads claimed, to be given back with
+    /// `return_threads()`.
+    size_t borrow_idle_threads(size_t n_jobs) noexcept;
+
+    /// @brief Give back threads claimed with `borrow_idle_threads()`.
+    void return_threads(size_t n) noexcept;
+
     /**
      * @brief Block until all jobs on the queue have processed, then spin down
      * the threads.
@@ -83,6 +99,8 @@ struct ThreadPool final
     mutable std::mutex jobs_mutex_;
     std::condition_variable cv_;
     std::queue<JobT> jobs_;
+    size_t n_busy_; // threads running a job
+    size_t n_lent_; // threads claimed by borrow_idle_threads()
 
     std::atomic<bool> is_accepting_jobs_;
 
@@ -138,6 +156,48 @@ bytes_per_chunk(const std::vector<Dimension>& dimensions,
 const char*
 sample_type_to_dtype(SampleType t);
 
+/// @brief Get the number of significant bits in a sample of a given type.
+/// @param t An enumerated sample type.
+/// @throw std::runtime_error if @par t is not a valid SampleType.
+/// @return The bit depth of @par t, e.g., 12 for SampleType_u12.
+uint8_t
+bit_depth(SampleType t);
+
+/// @brief Get the number of channels interleaved in a frame.
+/// @param shape The shape of the frame.
+/// @return The channel count of @par shape, or 1 if it is unset.
+size_t
+channels(const ImageShape& shape);
+
+/// @brief Get the distance, in samples, between the same pixel in
+/// consecutive channels of a frame.
+/// @param shape The shape of the frame.
+/// @return The channel stride of @par shape, or 1 if it is unset.
+size_t
+channel_stride(const ImageShape& shape);
+
+/// @brief Get the distance, in samples, between consecutive samples of one
+/// channel in a row of a frame.
+/// @param shape The shape of the frame.
+/// @return The width stride of @par shape, or the channel count if it is
+/// unset.
+size_t
+sample_stride(const ImageShape& shape);
+
+/// @brief Get the distance, in samples, between the starts of consecutive rows
+/// of a frame, e.g., for frame grabbers that pad each row.
+/// @param shape The shape of the frame.
+/// @return The height stride of @par shape, or the row length if it is unset.
+size_t
+row_stride(const ImageShape& shape);
+
+/// @brief Get the number of bytes spanned by a frame's samples, from the first
+/// sample to the end of the last, following its strides.
+/// @param shape The shape of the frame.
+/// @return The minimum size of a buffer holding a frame of shape @par shape.
+size_t
+bytes_of_strided_frame(const ImageShape& shape);
+
 /// @brief Get a string representation of the SampleType enum.
 /// @param t An enumerated sample type.
 /// @return A human-readable representation of the SampleType @par t.
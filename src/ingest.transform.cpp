@@ -0,0 +1,576 @@
+#include "ingest.transform.hh"
+#include "common.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace zarr = acquire::sink::zarr;
+namespace common = zarr::common;
+
+namespace {
+/// The region of interest, with zero sizes resolved to the rest of the frame.
+struct Roi
+{
+    size_t x, y, width, height;
+};
+
+Roi
+resolve_roi(const zarr::IngestTransform& transform, const ImageShape& shape)
+{
+    const size_t width = transform.roi_width
+                           ? transform.roi_width
+                           : shape.dims.width - std::min(transform.roi_x,
+                                                         shape.dims.width);
+    const size_t height = transform.roi_height
+                            ? transform.roi_height
+                            : shape.dims.height - std::min(transform.roi_y,
+                                                           shape.dims.height);
+    return { transform.roi_x, transform.roi_y, width, height };
+}
+
+bool
+is_identity(const zarr::IngestTransform& transform, const ImageShape& shape)
+{
+    const auto roi = resolve_roi(transform, shape);
+    return transform.binning == 1 && roi.x == 0 && roi.y == 0 &&
+           roi.width == shape.dims.width && roi.height == shape.dims.height;
+}
+
+// The kernels below are written as simple loops over contiguous rows so that
+// the compiler vectorizes them with the instruction set enabled by
+// `target_enable_simd`. Binning by 2, which pairs adjacent samples, also has
+// an AVX2 path.
+
+/// Add each run of `bin` samples in a row of the frame to one accumulator.
+template<typename T, typename A>
+void
+accumulate_row(A* acc,
+               const T* src,
+               size_t n_out,
+               size_t bin,
+               size_t sample_stride)
+{
+    if (sample_stride == 1 && bin == 2) {
+        size_t i = 0;
+#ifdef __AVX2__
+        // sum each pair of 16 samples into 8 accumulators
+        for (; i + 8 <= n_out; i += 8) {
+            const T* s = src + 2 * i;
+            if constexpr (std::is_same_v<T, float>) {
+                // horizontal adds pair within 128-bit lanes, so put the
+                // lanes in order
+                const auto pairs = _mm256_castps_pd(_mm256_hadd_ps(
+                  _mm256_loadu_ps(s), _mm256_loadu_ps(s + 8)));
+                const auto sums = _mm256_castpd_ps(
+                  _mm256_permute4x64_pd(pairs, _MM_SHUFFLE(3, 1, 2, 0)));
+                _mm256_storeu_ps(acc + i,
+                                 _mm256_add_ps(_mm256_loadu_ps(acc + i), sums));
+            } else {
+                __m256i sums;
+                if constexpr (sizeof(T) == 1) {
+                    const auto v = _mm_loadu_si128((const __m128i*)s);
+                    const auto widened = std::is_signed_v<T>
+                                           ? _mm256_cvtepi8_epi16(v)
+                                           : _mm256_cvtepu8_epi16(v);
+                    sums = _mm256_madd_epi16(widened, _mm256_set1_epi16(1));
+                } else if constexpr (std::is_signed_v<T>) {
+                    sums =
+                      _mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)s),
+                                        _mm256_set1_epi16(1));
+                } else {
+                    // madd would take samples past 32767 as negative
+                    const auto v = _mm256_loadu_si256((const __m256i*)s);
+                    sums = _mm256_add_epi32(
+                      _mm256_and_si256(v, _mm256_set1_epi32(0xffff)),
+                      _mm256_srli_epi32(v, 16));
+                }
+                const auto a = _mm256_loadu_si256((const __m256i*)(acc + i));
+                _mm256_storeu_si256((__m256i*)(acc + i),
+                                    _mm256_add_epi32(a, sums));
+            }
+        }
+#endif
+        for (; i < n_out; ++i) {
+            acc[i] += (A)src[2 * i] + (A)src[2 * i + 1];
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < n_out; ++i) {
+        for (size_t j = 0; j < bin; ++j) {
+            acc[i] += (A)src[(i * bin + j) * sample_stride];
+        }
+    }
+}
+
+/// Write a row of accumulated bins out as samples, either as the sum of the
+/// bin, saturated to the range of T, or as the mean of the bin, rounded to
+/// the nearest value of T.
+template<typename T, typename A>
+void
+store_row(T* dst,
+          const A* acc,
+          size_t n,
+          zarr::BinningMode mode,
+          size_t samples_per_bin)
+{
+    if (mode == zarr::BinningMode::Mean) {
+        const double scale = 1. / (double)samples_per_bin;
+        for (size_t i = 0; i < n; ++i) {
+            if constexpr (std::is_floating_point_v<T>) {
+                dst[i] = (T)((double)acc[i] * scale);
+            } else {
+                dst[i] = (T)std::floor((double)acc[i] * scale + 0.5);
+            }
+        }
+        return;
+    }
+
+    if constexpr (std::is_floating_point_v<T>) {
+        for (size_t i = 0; i < n; ++i) {
+            dst[i] = (T)acc[i];
+        }
+    } else {
+        constexpr A lo = (A)std::numeric_limits<T>::min();
+        constexpr A hi = (A)std::numeric_limits<T>::max();
+        for (size_t i = 0; i < n; ++i) {
+            dst[i] = (T)std::clamp(acc[i], lo, hi);
+        }
+    }
+}
+
+/// Bin samples of type T into samples of type O, which is wider than T when
+/// summing 8-bit samples.
+template<typename T, typename A, typename O = T>
+void
+bin_frame(uint8_t* dst,
+          const uint8_t* src,
+          const ImageShape& in_shape,
+          const Roi& roi,
+          size_t bin,
+          zarr::BinningMode mode)
+{
+    const auto sample_stride = common::sample_stride(in_shape);
+    const auto row_stride = common::row_stride(in_shape);
+    const size_t out_width = roi.width / bin;
+    const size_t out_height = roi.height / bin;
+
+    std::vector<A> acc(out_width);
+    auto* out = (O*)dst;
+    const auto* in = (const T*)src;
+    for (size_t y = 0; y < out_height; ++y) {
+        std::fill(acc.begin(), acc.end(), (A)0);
+        for (size_t k = 0; k < bin; ++k) {
+            const auto* row = in + (roi.y + y * bin + k) * row_stride +
+                              roi.x * sample_stride;
+            accumulate_row<T, A>(
+              acc.data(), row, out_width, bin, sample_stride);
+        }
+        store_row<O, A>(
+          out + y * out_width, acc.data(), out_width, mode, bin * bin);
+    }
+}
+
+/// Copy the region of interest out of the frame, packing rows and channels.
+void
+crop_frame(uint8_t* dst,
+           const uint8_t* src,
+           const ImageShape& in_shape,
+           const Roi& roi)
+{
+    const size_t bytes_per_px = bytes_of_type(in_shape.type);
+    const auto n_channels = common::channels(in_shape);
+    const auto channel_stride = common::channel_stride(in_shape);
+    const auto sample_stride = common::sample_stride(in_shape);
+    const auto row_stride = common::row_stride(in_shape);
+
+    const size_t samples_per_row = roi.width * n_channels;
+    const bool rows_are_packed =
+      channel_stride == 1 && sample_stride == n_channels;
+
+    for (size_t y = 0; y < roi.height; ++y) {
+        const uint8_t* row =
+          src + bytes_per_px *
+                  ((roi.y + y) * row_stride + roi.x * sample_stride);
+        uint8_t* out = dst + y * samples_per_row * bytes_per_px;
+
+        if (rows_are_packed) {
+            std::memcpy(out, row, samples_per_row * bytes_per_px);
+            continue;
+        }
+
+        for (size_t x = 0; x < roi.width; ++x) {
+            for (size_t c = 0; c < n_channels; ++c) {
+                std::memcpy(
+                  out + (x * n_channels + c) * bytes_per_px,
+                  row + (x * sample_stride + c * channel_stride) *
+                          bytes_per_px,
+                  bytes_per_px);
+            }
+        }
+    }
+}
+} // namespace
+
+void
+zarr::validate_ingest_transform(const IngestTransform& transform,
+                                const ImageShape& shape)
+{
+    EXPECT(transform.binning > 0, "Binning factor must be positive.");
+
+    const auto roi = resolve_roi(transform, shape);
+    EXPECT(roi.x + roi.width <= shape.dims.width &&
+             roi.y + roi.height <= shape.dims.height,
+           "Region of interest (%zu, %zu) + (%zu, %zu) is outside the %u x %u "
+           "frame.",
+           roi.x,
+           roi.y,
+           roi.width,
+           roi.height,
+           shape.dims.width,
+           shape.dims.height);
+    EXPECT(roi.width / transform.binning > 0 &&
+             roi.height / transform.binning > 0,
+           "Binning by %u leaves no pixels in a %zu x %zu region of interest.",
+           transform.binning,
+           roi.width,
+           roi.height);
+    EXPECT(transform.binning == 1 || common::channels(shape) == 1,
+           "Binning is not supported for frames with multiple channels.");
+}
+
+ImageShape
+zarr::transformed_shape(const IngestTransform& transform,
+                        const ImageShape& shape)
+{
+    validate_ingest_transform(transform, shape);
+
+    const auto roi = resolve_roi(transform, shape);
+    const auto n_channels = (uint32_t)common::channels(shape);
+    const auto width = (uint32_t)(roi.width / transform.binning);
+    const auto height = (uint32_t)(roi.height / transform.binning);
+
+    ImageShape out = {
+        .dims = {
+          .channels = n_channels,
+          .width = width,
+          .height = height,
+          .planes = 1,
+        },
+        .strides = {
+          .channels = 1,
+          .width = n_channels,
+          .height = (int64_t)width * n_channels,
+          .planes = (int64_t)width * height * n_channels,
+        },
+        .type = shape.type,
+    };
+
+    if (transform.binning > 1 && transform.binning_mode == BinningMode::Sum) {
+        switch (shape.type) {
+            case SampleType_u8:
+            case SampleType_u10:
+            case SampleType_u12:
+            case SampleType_u14:
+                out.type = SampleType_u16;
+                break;
+            case SampleType_i8:
+                out.type = SampleType_i16;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return out;
+}
+
+zarr::Ingest::Ingest(const IngestTransform& transform, const ImageShape& shape)
+  : transform_{ transform }
+  , in_shape_{ shape }
+  , out_shape_{ transformed_shape(transform, shape) }
+{
+    if (!is_identity(transform_, in_shape_)) {
+        buffer_.resize(sizeof(VideoFrame) +
+                       common::bytes_of_strided_frame(out_shape_));
+    }
+}
+
+const VideoFrame*
+zarr::Ingest::apply(const VideoFrame* frame)
+{
+    CHECK(frame);
+    if (buffer_.empty()) {
+        return frame;
+    }
+
+    EXPECT(frame->shape.dims.width == in_shape_.dims.width &&
+             frame->shape.dims.height == in_shape_.dims.height &&
+             frame->shape.type == in_shape_.type,
+           "Expected a %u x %u frame of type %s. Got %u x %u of type %s.",
+           in_shape_.dims.width,
+           in_shape_.dims.height,
+           common::sample_type_to_string(in_shape_.type),
+           frame->shape.dims.width,
+           frame->shape.dims.height,
+           common::sample_type_to_string(frame->shape.type));
+    EXPECT(common::bytes_of_strided_frame(frame->shape) <=
+             frame->bytes_of_frame - sizeof(*frame),
+           "Frame buffer is too small for its shape.");
+
+    auto* out = (VideoFrame*)buffer_.data();
+    std::memcpy(out, frame, sizeof(*out));
+    out->bytes_of_frame = buffer_.size();
+    out->shape = out_shape_;
+
+    const auto roi = resolve_roi(transform_, frame->shape);
+    const auto bin = transform_.binning;
+    const auto mode = transform_.binning_mode;
+    if (bin == 1) {
+        crop_frame(out->data, frame->data, frame->shape, roi);
+        return out;
+    }
+
+    const bool widen = mode == BinningMode::Sum;
+    switch (frame->shape.type) {
+        case SampleType_u8:
+            if (widen) {
+                bin_frame<uint8_t, uint32_t, uint16_t>(
+                  out->data, frame->data, frame->shape, roi, bin, mode);
+            } else {
+                bin_frame<uint8_t, uint32_t>(
+                  out->data, frame->data, frame->shape, roi, bin, mode);
+            }
+            break;
+        case SampleType_i8:
+            if (widen) {
+                bin_frame<int8_t, int32_t, int16_t>(
+                  out->data, frame->data, frame->shape, roi, bin, mode);
+            } else {
+                bin_frame<int8_t, int32_t>(
+                  out->data, frame->data, frame->shape, roi, bin, mode);
+            }
+            break;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            bin_frame<uint16_t, uint32_t>(
+              out->data, frame->data, frame->shape, roi, bin, mode);
+            break;
+        case SampleType_i16:
+            bin_frame<int16_t, int32_t>(
+              out->data, frame->data, frame->shape, roi, bin, mode);
+            break;
+        case SampleType_f32:
+            bin_frame<float, float>(
+              out->data, frame->data, frame->shape, roi, bin, mode);
+            break;
+        default:
+            throw std::runtime_error("Unsupported sample type.");
+    }
+
+    return out;
+}
+
+const ImageShape&
+zarr::Ingest::shape() const noexcept
+{
+    return out_shape_;
+}
+
+#ifndef NO_UNIT_TESTS
+#ifdef _WIN32
+#define acquire_export __declspec(dllexport)
+#else
+#define acquire_export
+#endif
+
+extern "C"
+{
+    acquire_export int unit_test__ingest_transform()
+    {
+        int retval = 0;
+        std::vector<uint8_t> buf;
+        try {
+            const ImageShape shape = {
+                .dims = { .channels = 1, .width = 8, .height = 6 },
+                .type = SampleType_u16,
+            };
+
+            buf.resize(sizeof(VideoFrame) + 8 * 6 * sizeof(uint16_t));
+            auto* frame = (VideoFrame*)buf.data();
+            frame->bytes_of_frame = buf.size();
+            frame->shape = shape;
+            frame->frame_id = 7;
+            auto* px = (uint16_t*)frame->data;
+            for (auto y = 0; y < 6; ++y) {
+                for (auto x = 0; x < 8; ++x) {
+                    px[y * 8 + x] = (uint16_t)(100 * y + x);
+                }
+            }
+
+            // the identity passes frames through
+            {
+                zarr::Ingest ingest({}, shape);
+                CHECK(ingest.apply(frame) == frame);
+            }
+
+            // crop
+            {
+                zarr::Ingest ingest(
+                  { .roi_x = 2, .roi_y = 1, .roi_width = 5, .roi_height = 3 },
+                  shape);
+                const auto* out = ingest.apply(frame);
+                CHECK(out->frame_id == 7);
+                CHECK(out->shape.dims.width == 5);
+                CHECK(out->shape.dims.height == 3);
+                const auto* o = (const uint16_t*)out->data;
+                for (auto y = 0; y < 3; ++y) {
+                    for (auto x = 0; x < 5; ++x) {
+                        CHECK(o[y * 5 + x] == 100 * (y + 1) + x + 2);
+                    }
+                }
+            }
+
+            // crop and bin 2x2, dropping the partial bin on the right
+            {
+                zarr::Ingest ingest({ .roi_x = 1,
+                                      .roi_y = 2,
+                                      .binning = 2,
+                                      .binning_mode = zarr::BinningMode::Mean },
+                                    shape);
+                const auto* out = ingest.apply(frame);
+                CHECK(out->shape.dims.width == 3);
+                CHECK(out->shape.dims.height == 2);
+                CHECK(out->shape.type == SampleType_u16);
+                const auto* o = (const uint16_t*)out->data;
+                for (auto y = 0; y < 2; ++y) {
+                    for (auto x = 0; x < 3; ++x) {
+                        // mean of 100 * {r, r + 1} + {c, c + 1}, rounded
+                        const auto r = 2 + 2 * y, c = 1 + 2 * x;
+                        CHECK(o[y * 3 + x] == 100 * r + 50 + c + 1);
+                    }
+                }
+            }
+
+            // bin 2x2 across rows long enough for the vectorized path, with
+            // samples past the signed 16-bit range
+            {
+                const ImageShape wide = {
+                    .dims = { .channels = 1, .width = 40, .height = 2 },
+                    .type = SampleType_u16,
+                };
+                std::vector<uint8_t> wide_buf(sizeof(VideoFrame) +
+                                              40 * 2 * sizeof(uint16_t));
+                auto* wide_frame = (VideoFrame*)wide_buf.data();
+                wide_frame->bytes_of_frame = wide_buf.size();
+                wide_frame->shape = wide;
+                auto* w = (uint16_t*)wide_frame->data;
+                for (auto y = 0; y < 2; ++y) {
+                    for (auto x = 0; x < 40; ++x) {
+                        w[y * 40 + x] = (uint16_t)(33000 + 100 * y + x);
+                    }
+                }
+
+                zarr::Ingest ingest(
+                  { .binning = 2, .binning_mode = zarr::BinningMode::Mean },
+                  wide);
+                const auto* out = ingest.apply(wide_frame);
+                CHECK(out->shape.dims.width == 20);
+                CHECK(out->shape.dims.height == 1);
+                const auto* o = (const uint16_t*)out->data;
+                for (auto x = 0; x < 20; ++x) {
+                    CHECK(o[x] == 33000 + 50 + 2 * x + 1);
+                }
+            }
+
+            // summing saturates instead of wrapping
+            {
+                std::fill_n(px, 8 * 6, (uint16_t)40000);
+                zarr::Ingest ingest(
+                  { .binning = 3, .binning_mode = zarr::BinningMode::Sum },
+                  shape);
+                const auto* out = ingest.apply(frame);
+                CHECK(out->shape.dims.width == 2);
+                CHECK(out->shape.dims.height == 2);
+                const auto* o = (const uint16_t*)out->data;
+                for (auto i = 0; i < 4; ++i) {
+                    CHECK(o[i] == 65535);
+                }
+            }
+
+            // sums of u12 samples are stored as u16
+            {
+                ImageShape u12 = shape;
+                u12.type = SampleType_u12;
+                CHECK(zarr::transformed_shape({ .binning = 2,
+                                                .binning_mode =
+                                                  zarr::BinningMode::Sum },
+                                              u12)
+                        .type == SampleType_u16);
+            }
+
+            // sums of u8 samples are stored as u16, so they don't clip
+            {
+                const ImageShape u8 = {
+                    .dims = { .channels = 1, .width = 4, .height = 4 },
+                    .type = SampleType_u8,
+                };
+                std::vector<uint8_t> u8_buf(sizeof(VideoFrame) + 4 * 4);
+                auto* u8_frame = (VideoFrame*)u8_buf.data();
+                u8_frame->bytes_of_frame = u8_buf.size();
+                u8_frame->shape = u8;
+                std::fill_n(u8_frame->data, 4 * 4, (uint8_t)200);
+                u8_frame->data[0] = 255;
+
+                zarr::Ingest ingest(
+                  { .binning = 2, .binning_mode = zarr::BinningMode::Sum },
+                  u8);
+                const auto* out = ingest.apply(u8_frame);
+                CHECK(out->shape.type == SampleType_u16);
+                CHECK(out->shape.dims.width == 2);
+                CHECK(out->shape.dims.height == 2);
+                CHECK(out->bytes_of_frame ==
+                      sizeof(VideoFrame) + 2 * 2 * sizeof(uint16_t));
+                const auto* o = (const uint16_t*)out->data;
+                CHECK(o[0] == 255 + 3 * 200);
+                for (auto i = 1; i < 4; ++i) {
+                    CHECK(o[i] == 4 * 200);
+                }
+
+                // means of u8 samples stay u8
+                zarr::Ingest mean(
+                  { .binning = 2, .binning_mode = zarr::BinningMode::Mean },
+                  u8);
+                CHECK(mean.shape().type == SampleType_u8);
+                CHECK(mean.apply(u8_frame)->data[1] == 200);
+            }
+
+            // region of interest outside the frame
+            bool threw = false;
+            try {
+                zarr::validate_ingest_transform(
+                  { .roi_x = 4, .roi_width = 5 }, shape);
+            } catch (const std::exception&) {
+                threw = true;
+            }
+            CHECK(threw);
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+}
+#endif
@@ -0,0 +1,74 @@
+#ifndef H_ACQUIRE_ZARR_INGEST_TRANSFORM_V0
+#define H_ACQUIRE_ZARR_INGEST_TRANSFORM_V0
+
+#include "device/props/components.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace acquire::sink::zarr {
+enum class BinningMode
+{
+    Sum,
+    Mean,
+};
+
+/// @brief A crop and binning applied to each frame before it is written.
+/// @details The region of interest is given in pixels of the incoming frame.
+/// Binning then combines each `binning` x `binning` block of the region into
+/// one pixel, dropping any partial blocks along the right and bottom edges, as
+/// a camera would.
+struct IngestTransform
+{
+    uint32_t roi_x = 0;
+    uint32_t roi_y = 0;
+    // 0 takes the rest of the frame along this axis
+    uint32_t roi_width = 0;
+    uint32_t roi_height = 0;
+
+    uint32_t binning = 1;
+    BinningMode binning_mode = BinningMode::Mean;
+};
+
+/// @brief Check that a transform can be applied to frames of a given shape.
+/// @throw std::runtime_error if the region of interest falls outside the
+/// frame, the binning factor is 0, binning leaves no pixels, or @p shape has
+/// more than one channel and the transform bins.
+void
+validate_ingest_transform(const IngestTransform& transform,
+                          const ImageShape& shape);
+
+/// @brief Get the shape of frames after the transform, packed.
+/// @details Summed bins are stored in at least 16 bits, so the sum of u8,
+/// u10, u12, or u14 samples is u16 and the sum of i8 samples is i16.
+ImageShape
+transformed_shape(const IngestTransform& transform, const ImageShape& shape);
+
+/// @brief Applies an ingest transform to incoming frames, reusing a single
+/// output frame.
+/// @details Cropping and binning are done in one pass over the region of
+/// interest, so the rest of the frame is never read, and the writers only see
+/// the reduced frame. Bins are accumulated in a wider type and sums saturate
+/// at the largest value of the transformed sample type.
+struct Ingest
+{
+  public:
+    Ingest(const IngestTransform& transform, const ImageShape& shape);
+
+    /// @brief Transform a frame.
+    /// @return The transformed frame, valid until the next call.
+    /// @throw std::runtime_error if @p frame doesn't have the expected shape.
+    const VideoFrame* apply(const VideoFrame* frame);
+
+    const ImageShape& shape() const noexcept;
+
+  private:
+    IngestTransform transform_;
+    ImageShape in_shape_;
+    ImageShape out_shape_;
+    std::vector<uint8_t> buffer_;
+};
+} // namespace acquire::sink::zarr
+
+#endif // H_ACQUIRE_ZARR_INGEST_TRANSFORM_V0
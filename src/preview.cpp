@@ -0,0 +1,244 @@
+#include "preview.hh"
+#include "common.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace zarr = acquire::sink::zarr;
+namespace common = zarr::common;
+
+namespace {
+/// Copy every `step`-th pixel of every `step`-th row of the frame, with all of
+/// its channels, into a packed frame.
+template<typename T>
+void
+decimate(T* dst, const T* src, const ImageShape& shape, uint32_t step)
+{
+    const auto n_channels = common::channels(shape);
+    const auto channel_stride = common::channel_stride(shape);
+    const auto sample_stride = common::sample_stride(shape);
+    const auto row_stride = common::row_stride(shape);
+
+    const size_t out_width = (shape.dims.width + step - 1) / step;
+    const size_t out_height = (shape.dims.height + step - 1) / step;
+    const size_t px_stride = (size_t)step * sample_stride;
+
+    for (size_t y = 0; y < out_height; ++y) {
+        const T* row = src + y * step * row_stride;
+        T* out = dst + y * out_width * n_channels;
+        for (size_t c = 0; c < n_channels; ++c) {
+            const T* s = row + c * channel_stride;
+            for (size_t x = 0; x < out_width; ++x) {
+                out[x * n_channels + c] = s[x * px_stride];
+            }
+        }
+    }
+}
+} // namespace
+
+uint32_t
+zarr::preview_decimation(const ImageShape& shape,
+                         uint32_t max_width,
+                         uint32_t max_height)
+{
+    EXPECT(max_width > 0 && max_height > 0,
+           "Preview size must be positive.");
+
+    const uint32_t step_x = (shape.dims.width + max_width - 1) / max_width;
+    const uint32_t step_y = (shape.dims.height + max_height - 1) / max_height;
+    return std::max({ step_x, step_y, 1u });
+}
+
+zarr::Preview::Preview(uint32_t max_width,
+                       uint32_t max_height,
+                       double max_rate_hz)
+  : max_width_{ max_width }
+  , max_height_{ max_height }
+  , min_interval_{ 0 }
+  , sequence_{ 0 }
+{
+    EXPECT(max_width_ > 0 && max_height_ > 0,
+           "Preview size must be positive.");
+    EXPECT(max_rate_hz > 0, "Preview rate must be positive.");
+    min_interval_ =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1. / max_rate_hz));
+}
+
+bool
+zarr::Preview::offer(const VideoFrame* frame)
+{
+    CHECK(frame);
+
+    const auto now = std::chrono::steady_clock::now();
+    if (sequence_ > 0 && now - last_published_ < min_interval_) {
+        return false;
+    }
+
+    const auto& shape = frame->shape;
+    const auto step = preview_decimation(shape, max_width_, max_height_);
+    const uint32_t width = (shape.dims.width + step - 1) / step;
+    const uint32_t height = (shape.dims.height + step - 1) / step;
+    const auto n_channels = (uint32_t)common::channels(shape);
+    const size_t bytes_of_image =
+      (size_t)width * height * n_channels * bytes_of_type(shape.type);
+
+    back_.resize(sizeof(VideoFrame) + bytes_of_image);
+    auto* out = (VideoFrame*)back_.data();
+    std::memcpy(out, frame, sizeof(*out));
+    out->bytes_of_frame = back_.size();
+    out->shape.dims = {
+        .channels = n_channels,
+        .width = width,
+        .height = height,
+        .planes = 1,
+    };
+    out->shape.strides = {
+        .channels = 1,
+        .width = n_channels,
+        .height = (int64_t)width * n_channels,
+        .planes = (int64_t)width * height * n_channels,
+    };
+
+    switch (bytes_of_type(shape.type)) {
+        case 1:
+            decimate((uint8_t*)out->data, frame->data, shape, step);
+            break;
+        case 2:
+            decimate((uint16_t*)out->data,
+                     (const uint16_t*)frame->data,
+                     shape,
+                     step);
+            break;
+        case 4:
+            decimate((uint32_t*)out->data,
+                     (const uint32_t*)frame->data,
+                     shape,
+                     step);
+            break;
+        default:
+            throw std::runtime_error("Unsupported sample size.");
+    }
+
+    // never wait on a reader; try again with the next frame
+    std::unique_lock lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return false;
+    }
+    front_.swap(back_);
+    ++sequence_;
+    last_published_ = now;
+    return true;
+}
+
+bool
+zarr::Preview::latest(std::vector<uint8_t>& frame, uint64_t& sequence) const
+{
+    std::scoped_lock lock(mutex_);
+    if (sequence_ == 0 || sequence_ == sequence) {
+        return false;
+    }
+
+    frame = front_;
+    sequence = sequence_;
+    return true;
+}
+
+#ifndef NO_UNIT_TESTS
+#ifdef _WIN32
+#define acquire_export __declspec(dllexport)
+#else
+#define acquire_export
+#endif
+
+extern "C"
+{
+    acquire_export int unit_test__preview()
+    {
+        int retval = 0;
+        try {
+            const ImageShape shape = {
+                .dims = { .channels = 1, .width = 10, .height = 7 },
+                .type = SampleType_u16,
+            };
+            CHECK(zarr::preview_decimation(shape, 4, 4) == 3);
+            CHECK(zarr::preview_decimation(shape, 10, 7) == 1);
+
+            std::vector<uint8_t> buf(sizeof(VideoFrame) +
+                                     10 * 7 * sizeof(uint16_t));
+            auto* frame = (VideoFrame*)buf.data();
+            frame->bytes_of_frame = buf.size();
+            frame->shape = shape;
+            auto* px = (uint16_t*)frame->data;
+            for (auto i = 0; i < 10 * 7; ++i) {
+                px[i] = (uint16_t)i;
+            }
+
+            // every frame is published, given enough time between them
+            {
+                zarr::Preview preview(4, 4, 100);
+                std::vector<uint8_t> out;
+                uint64_t sequence = 0;
+                CHECK(!preview.latest(out, sequence));
+
+                frame->frame_id = 1;
+                CHECK(preview.offer(frame));
+                CHECK(preview.latest(out, sequence));
+                CHECK(sequence == 1);
+                CHECK(!preview.latest(out, sequence)); // nothing newer
+
+                const auto* p = (const VideoFrame*)out.data();
+                CHECK(p->frame_id == 1);
+                CHECK(p->shape.dims.width == 4);
+                CHECK(p->shape.dims.height == 3);
+                CHECK(p->bytes_of_frame == out.size());
+                const auto* o = (const uint16_t*)p->data;
+                for (auto y = 0; y < 3; ++y) {
+                    for (auto x = 0; x < 4; ++x) {
+                        CHECK(o[y * 4 + x] == 3 * y * 10 + 3 * x);
+                    }
+                }
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                frame->frame_id = 2;
+                CHECK(preview.offer(frame));
+                CHECK(preview.latest(out, sequence));
+                CHECK(sequence == 2);
+                CHECK(((const VideoFrame*)out.data())->frame_id == 2);
+            }
+
+            // capped at 1 Hz: the second frame comes too soon
+            {
+                zarr::Preview preview(16, 16, 1);
+                std::vector<uint8_t> out;
+                uint64_t sequence = 0;
+
+                frame->frame_id = 3;
+                CHECK(preview.offer(frame));
+                frame->frame_id = 4;
+                CHECK(!preview.offer(frame));
+                CHECK(preview.latest(out, sequence));
+                CHECK(sequence == 1);
+                CHECK(((const VideoFrame*)out.data())->frame_id == 3);
+            }
+
+            // the rate must be capped
+            bool threw = false;
+            try {
+                zarr::Preview preview(16, 16, 0);
+            } catch (const std::exception&) {
+                threw = true;
+            }
+            CHECK(threw);
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+}
+#endif
@@ -0,0 +1,65 @@
+#ifndef H_ACQUIRE_ZARR_PREVIEW_V0
+#define H_ACQUIRE_ZARR_PREVIEW_V0
+
+#include "device/props/components.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace acquire::sink::zarr {
+/// @brief Holds a decimated copy of the most recent frame for live display.
+/// @details The writer offers every frame; at most `max_rate_hz` times a
+/// second, the frame is decimated by an integer stride to fit within the
+/// requested size and published. Publishing never waits on a reader: if a
+/// reader holds the latest preview, the update is dropped and retried on the
+/// next frame. Readers on any thread poll for the latest preview.
+struct Preview
+{
+  public:
+    /// The rate cap when none is given, about a display's refresh rate.
+    static constexpr double default_max_rate_hz = 30;
+
+    /// @param max_width The largest width of a preview frame, in pixels.
+    /// @param max_height The largest height of a preview frame, in pixels.
+    /// @param max_rate_hz The most previews to publish per second. Must be
+    /// positive.
+    Preview(uint32_t max_width, uint32_t max_height, double max_rate_hz);
+
+    /// @brief Offer a frame for preview. Cheap when the rate cap says to skip
+    /// it.
+    /// @return True if the frame was published as the latest preview.
+    bool offer(const VideoFrame* frame);
+
+    /// @brief Copy out the latest preview, if it is newer than @p sequence.
+    /// @param[out] frame The preview, as a packed VideoFrame.
+    /// @param[in,out] sequence The sequence number of the last preview seen,
+    /// updated to the one copied out. Start from 0.
+    /// @return True if a newer preview was copied out.
+    bool latest(std::vector<uint8_t>& frame, uint64_t& sequence) const;
+
+  private:
+    uint32_t max_width_;
+    uint32_t max_height_;
+    std::chrono::steady_clock::duration min_interval_;
+    std::chrono::steady_clock::time_point last_published_;
+
+    // only touched by the writer
+    std::vector<uint8_t> back_;
+
+    mutable std::mutex mutex_;
+    std::vector<uint8_t> front_;
+    uint64_t sequence_;
+};
+
+/// @brief Get the stride at which to sample a frame so that it fits within
+/// @p max_width x @p max_height.
+uint32_t
+preview_decimation(const ImageShape& shape,
+                   uint32_t max_width,
+                   uint32_t max_height);
+} // namespace acquire::sink::zarr
+
+#endif // H_ACQUIRE_ZARR_PREVIEW_V0
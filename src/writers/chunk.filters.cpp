@@ -0,0 +1,501 @@
+#include "chunk.filters.hh"
+#include "../common.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace zarr = acquire::sink::zarr;
+namespace common = zarr::common;
+using json = nlohmann::json;
+
+namespace {
+// The kernels below are written as simple loops over contiguous samples so
+// that the compiler vectorizes them with the instruction set enabled by
+// `target_enable_simd`. Bit packing, which the compiler doesn't vectorize,
+// also has an AVX2 path.
+
+/// Replace each sample with its difference from the previous sample, walking
+/// backward so the previous sample is still unmodified when it is read.
+/// Inverted by numcodecs.Delta, i.e., a cumulative sum over the chunk.
+template<typename T>
+void
+delta_encode(T* data, size_t n)
+{
+    for (size_t i = n - 1; i > 0; --i) {
+        data[i] = (T)(data[i] - data[i - 1]);
+    }
+}
+
+/// Round the mantissa of IEEE 754 single-precision samples to `keepbits`
+/// bits, with ties to even. Same as numcodecs.BitRound.
+void
+bitround_float(uint32_t* data, size_t n, uint8_t keepbits)
+{
+    const int maskbits = 23 - keepbits;
+    if (maskbits <= 0) {
+        return;
+    }
+
+    const uint32_t mask = (0xFFFFFFFFu >> maskbits) << maskbits;
+    const uint32_t half_quantum = (1u << (maskbits - 1)) - 1;
+
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t b = data[i];
+        b += ((b >> maskbits) & 1) + half_quantum;
+        data[i] = b & mask;
+    }
+}
+
+/// Pack the low `Bits` bits of each sample into a big-endian bit stream, as
+/// TIFF and imagecodecs.packints do, in place. Groups of 4 samples fill
+/// exactly Bits / 2 bytes, so each group is written at or before the samples
+/// it was read from.
+template<int Bits>
+size_t
+pack_bits(uint8_t* buf, size_t n)
+{
+    static_assert(Bits % 2 == 0 && Bits < 16);
+    constexpr int bytes_per_group = Bits / 2;
+    constexpr uint64_t mask = (1u << Bits) - 1;
+
+    const auto* src = (const uint16_t*)buf;
+    uint8_t* dst = buf;
+
+    const size_t n_groups = n / 4;
+    size_t g = 0;
+#ifdef __AVX2__
+    // Pack 4 groups at a time, one in each 64-bit lane: join samples into
+    // pairs with a multiply-add, join pairs into groups with shifts, then
+    // shuffle each group's bytes into big-endian order at the front of its
+    // 128-bit lane. The high lane is stored after the low lane, over the low
+    // lane's unused bytes, and both stores end before the next samples read.
+    const auto sample_mask = _mm256_set1_epi16((int16_t)mask);
+    const auto pair_weights = _mm256_set1_epi32((1 << 16) | (1 << Bits));
+    const auto low_pair = _mm256_set1_epi64x(0xffffffff);
+    alignas(16) int8_t order[16];
+    for (int j = 0; j < 16; ++j) {
+        order[j] = -128;
+    }
+    for (int j = 0; j < bytes_per_group; ++j) {
+        order[j] = (int8_t)(bytes_per_group - 1 - j);
+        order[bytes_per_group + j] = (int8_t)(8 + bytes_per_group - 1 - j);
+    }
+    const auto big_endian =
+      _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)order));
+
+    for (; g + 4 <= n_groups; g += 4) {
+        auto v = _mm256_and_si256(
+          _mm256_loadu_si256((const __m256i*)(src + 4 * g)), sample_mask);
+        // s0 << Bits | s1 in the low 32 bits, s2 << Bits | s3 in the high
+        v = _mm256_madd_epi16(v, pair_weights);
+        v = _mm256_or_si256(
+          _mm256_slli_epi64(_mm256_and_si256(v, low_pair), 2 * Bits),
+          _mm256_srli_epi64(v, 32));
+        v = _mm256_shuffle_epi8(v, big_endian);
+
+        uint8_t* out = dst + g * bytes_per_group;
+        _mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i*)(out + 2 * bytes_per_group),
+                         _mm256_extracti128_si256(v, 1));
+    }
+#endif
+
+    for (; g < n_groups; ++g) {
+        const uint64_t bits = ((src[4 * g] & mask) << (3 * Bits)) |
+                              ((src[4 * g + 1] & mask) << (2 * Bits)) |
+                              ((src[4 * g + 2] & mask) << Bits) |
+                              (src[4 * g + 3] & mask);
+        for (int j = 0; j < bytes_per_group; ++j) {
+            dst[g * bytes_per_group + j] =
+              (uint8_t)(bits >> (8 * (bytes_per_group - 1 - j)));
+        }
+    }
+
+    // pack the remaining samples, zero-padding the last byte
+    size_t out = n_groups * bytes_per_group;
+    uint32_t acc = 0;
+    int n_bits = 0;
+    for (size_t i = 4 * n_groups; i < n; ++i) {
+        acc = (acc << Bits) | (src[i] & mask);
+        n_bits += Bits;
+        while (n_bits >= 8) {
+            n_bits -= 8;
+            dst[out++] = (uint8_t)(acc >> n_bits);
+        }
+    }
+    if (n_bits > 0) {
+        dst[out++] = (uint8_t)(acc << (8 - n_bits));
+    }
+
+    return out;
+}
+
+template<typename T>
+void
+apply_filter_impl(const zarr::FilterParams& filter,
+                  SampleType type,
+                  uint8_t* buf,
+                  size_t bytes_of_buf)
+{
+    const size_t n = bytes_of_buf / sizeof(T);
+    if (n == 0) {
+        return;
+    }
+
+    switch (filter.id) {
+        case zarr::FilterId::Delta:
+            delta_encode((T*)buf, n);
+            break;
+        case zarr::FilterId::BitRound:
+            if constexpr (std::is_floating_point_v<T>) {
+                bitround_float((uint32_t*)buf, n, filter.keepbits);
+                break;
+            }
+            throw std::runtime_error("BitRound is only supported for f32.");
+        default:
+            throw std::runtime_error("Invalid filter.");
+    }
+}
+} // namespace
+
+zarr::FilterParams::FilterParams()
+  : id{ FilterId::Delta }
+  , keepbits{ 0 }
+{
+}
+
+zarr::FilterParams::FilterParams(FilterId id, uint8_t keepbits)
+  : id{ id }
+  , keepbits{ keepbits }
+{
+}
+
+void
+zarr::validate_filter(const FilterParams& filter, SampleType type)
+{
+    switch (filter.id) {
+        case FilterId::Delta:
+            EXPECT(type != SampleType_f32,
+                   "Delta filter is not supported for pixel type %s.",
+                   common::sample_type_to_string(type));
+            break;
+        case FilterId::BitRound:
+            // numcodecs.BitRound only decodes floats, so rounding integers
+            // would need a codec of our own that standard readers lack
+            EXPECT(type == SampleType_f32,
+                   "BitRound filter is not supported for pixel type %s.",
+                   common::sample_type_to_string(type));
+            EXPECT(filter.keepbits > 0 && filter.keepbits <= 23,
+                   "BitRound filter expects keepbits in [1, 23]. Got %d.",
+                   filter.keepbits);
+            break;
+        case FilterId::PackBits:
+            EXPECT(type == SampleType_u10 || type == SampleType_u12 ||
+                     type == SampleType_u14,
+                   "PackBits filter is not supported for pixel type %s.",
+                   common::sample_type_to_string(type));
+            break;
+        case FilterId::TemporalDelta:
+            EXPECT(type != SampleType_f32,
+                   "TemporalDelta filter is not supported for pixel type %s.",
+                   common::sample_type_to_string(type));
+            break;
+        default:
+            throw std::runtime_error("Invalid filter.");
+    }
+}
+
+size_t
+zarr::apply_filter(const FilterParams& filter,
+                   SampleType type,
+                   uint8_t* buf,
+                   size_t bytes_of_buf)
+{
+    CHECK(buf);
+    EXPECT(filter.id != FilterId::TemporalDelta,
+           "TemporalDelta is applied while tiling.");
+
+    if (filter.id == FilterId::PackBits) {
+        const size_t n = bytes_of_buf / sizeof(uint16_t);
+        switch (type) {
+            case SampleType_u10:
+                return pack_bits<10>(buf, n);
+            case SampleType_u12:
+                return pack_bits<12>(buf, n);
+            case SampleType_u14:
+                return pack_bits<14>(buf, n);
+            default:
+                char err_msg[64];
+                snprintf(err_msg,
+                         sizeof(err_msg),
+                         "Cannot pack pixel type: %s",
+                         common::sample_type_to_string(type));
+                throw std::runtime_error(err_msg);
+        }
+    }
+
+    switch (type) {
+        case SampleType_u8:
+            apply_filter_impl<uint8_t>(filter, type, buf, bytes_of_buf);
+            break;
+        case SampleType_i8:
+            apply_filter_impl<int8_t>(filter, type, buf, bytes_of_buf);
+            break;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            apply_filter_impl<uint16_t>(filter, type, buf, bytes_of_buf);
+            break;
+        case SampleType_i16:
+            apply_filter_impl<int16_t>(filter, type, buf, bytes_of_buf);
+            break;
+        case SampleType_f32:
+            apply_filter_impl<float>(filter, type, buf, bytes_of_buf);
+            break;
+        default:
+            char err_msg[64];
+            snprintf(err_msg,
+                     sizeof(err_msg),
+                     "Unsupported pixel type: %s",
+                     common::sample_type_to_string(type));
+            throw std::runtime_error(err_msg);
+    }
+
+    return bytes_of_buf;
+}
+
+json
+zarr::filter_to_json(const FilterParams& filter, SampleType type)
+{
+    switch (filter.id) {
+        case FilterId::Delta: {
+            const std::string dtype = common::sample_type_to_dtype(type);
+            return json{ { "id", "delta" },
+                         { "dtype", dtype },
+                         { "astype", dtype } };
+        }
+        case FilterId::BitRound:
+            EXPECT(type == SampleType_f32,
+                   "BitRound filter is not supported for pixel type %s.",
+                   common::sample_type_to_string(type));
+            return json{ { "id", "bitround" },
+                         { "keepbits", filter.keepbits } };
+        case FilterId::PackBits:
+            return json{ { "id", "imagecodecs_packints" },
+                         { "dtype", common::sample_type_to_dtype(type) },
+                         { "bitspersample", common::bit_depth(type) },
+                         { "runlen", 0 } };
+        case FilterId::TemporalDelta:
+            // decode: for t from 1 to n - 1, chunk[t] += chunk[t - 1], i.e.,
+            // numcodecs.Delta along the append dimension
+            return json{ { "id", "acquire_temporal_delta" },
+                         { "dtype", common::sample_type_to_dtype(type) },
+                         { "axis", 0 } };
+        default:
+            throw std::runtime_error("Invalid filter.");
+    }
+}
+
+#ifndef NO_UNIT_TESTS
+#ifdef _WIN32
+#define acquire_export __declspec(dllexport)
+#else
+#define acquire_export
+#endif
+
+extern "C"
+{
+    acquire_export int unit_test__delta_filter()
+    {
+        int retval = 0;
+        try {
+            const zarr::FilterParams filter(zarr::FilterId::Delta);
+
+            std::vector<uint16_t> data(1000);
+            for (auto i = 0; i < data.size(); ++i) {
+                data.at(i) = (uint16_t)(3 * i * i + 7);
+            }
+            const auto expected = data;
+
+            CHECK(zarr::apply_filter(filter,
+                                     SampleType_u16,
+                                     (uint8_t*)data.data(),
+                                     data.size() * sizeof(uint16_t)) ==
+                  data.size() * sizeof(uint16_t));
+
+            // decode with a cumulative sum, as numcodecs does
+            CHECK(data.at(0) == expected.at(0));
+            for (auto i = 1; i < data.size(); ++i) {
+                data.at(i) = (uint16_t)(data.at(i) + data.at(i - 1));
+            }
+            CHECK(data == expected);
+
+            // wraps around for signed types
+            std::vector<int8_t> signed_data{ 127, -128, 0, 5 };
+            zarr::apply_filter(filter,
+                               SampleType_i8,
+                               (uint8_t*)signed_data.data(),
+                               signed_data.size());
+            CHECK(signed_data.at(0) == 127);
+            CHECK(signed_data.at(1) == 1);
+            CHECK(signed_data.at(2) == -128);
+            CHECK(signed_data.at(3) == 5);
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__bitround_filter()
+    {
+        int retval = 0;
+        try {
+            // floats keep the requested number of mantissa bits
+            {
+                const zarr::FilterParams filter(zarr::FilterId::BitRound, 2);
+                zarr::validate_filter(filter, SampleType_f32);
+
+                std::vector<float> data{ 1.f, 1.3f, 1.4f, -2.6f };
+                zarr::apply_filter(filter,
+                                   SampleType_f32,
+                                   (uint8_t*)data.data(),
+                                   data.size() * sizeof(float));
+                CHECK(data.at(0) == 1.f);
+                CHECK(data.at(1) == 1.25f);
+                CHECK(data.at(2) == 1.5f);
+                CHECK(data.at(3) == -2.5f);
+
+                const auto metadata =
+                  zarr::filter_to_json(filter, SampleType_f32);
+                CHECK(metadata["id"] == "bitround");
+                CHECK(metadata["keepbits"] == 2);
+            }
+
+            // invalid configurations are rejected
+            bool threw = false;
+            try {
+                zarr::validate_filter(
+                  zarr::FilterParams(zarr::FilterId::BitRound, 24),
+                  SampleType_f32);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            CHECK(threw);
+
+            // standard readers can't decode integer bit rounding
+            threw = false;
+            try {
+                zarr::validate_filter(
+                  zarr::FilterParams(zarr::FilterId::BitRound, 8),
+                  SampleType_u12);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            CHECK(threw);
+
+            threw = false;
+            try {
+                zarr::validate_filter(zarr::FilterParams(zarr::FilterId::Delta),
+                                      SampleType_f32);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            CHECK(threw);
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__packbits_filter()
+    {
+        int retval = 0;
+        try {
+            const zarr::FilterParams filter(zarr::FilterId::PackBits);
+            zarr::validate_filter(filter, SampleType_u12);
+
+            // 12-bit: 2 samples in 3 bytes
+            {
+                std::vector<uint16_t> data{ 0xABC, 0x123, 0xFFF, 0x001, 0x456 };
+                const auto nbytes =
+                  zarr::apply_filter(filter,
+                                     SampleType_u12,
+                                     (uint8_t*)data.data(),
+                                     data.size() * sizeof(uint16_t));
+                CHECK(nbytes == 8); // 60 bits, padded to 64
+
+                const uint8_t expected[] = { 0xAB, 0xC1, 0x23, 0xFF,
+                                             0xF0, 0x01, 0x45, 0x60 };
+                CHECK(memcmp(data.data(), expected, sizeof(expected)) == 0);
+            }
+
+            // round trip, ignoring the bits above the bit depth
+            for (const auto type :
+                 { SampleType_u10, SampleType_u12, SampleType_u14 }) {
+                const int bits = zarr::common::bit_depth(type);
+
+                std::vector<uint16_t> data(1001);
+                for (auto i = 0; i < data.size(); ++i) {
+                    data.at(i) = (uint16_t)(i * 7919);
+                }
+                std::vector<uint16_t> expected(data.size());
+                for (auto i = 0; i < data.size(); ++i) {
+                    expected.at(i) = data.at(i) & ((1 << bits) - 1);
+                }
+
+                const auto nbytes =
+                  zarr::apply_filter(filter,
+                                     type,
+                                     (uint8_t*)data.data(),
+                                     data.size() * sizeof(uint16_t));
+                CHECK(nbytes == (data.size() * bits + 7) / 8);
+
+                // unpack
+                const auto* packed = (const uint8_t*)data.data();
+                std::vector<uint16_t> unpacked;
+                uint32_t acc = 0;
+                int n_bits = 0;
+                for (auto i = 0; i < nbytes; ++i) {
+                    acc = (acc << 8) | packed[i];
+                    n_bits += 8;
+                    if (n_bits >= bits && unpacked.size() < expected.size()) {
+                        n_bits -= bits;
+                        unpacked.push_back(
+                          (uint16_t)((acc >> n_bits) & ((1 << bits) - 1)));
+                    }
+                }
+                CHECK(unpacked == expected);
+            }
+
+            // only for packable types
+            bool threw = false;
+            try {
+                zarr::validate_filter(filter, SampleType_u16);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            CHECK(threw);
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+} // extern "C"
+#endif // NO_UNIT_TESTS
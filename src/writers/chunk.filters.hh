@@ -0,0 +1,65 @@
+#ifndef H_ACQUIRE_ZARR_CHUNK_FILTERS_V0
+#define H_ACQUIRE_ZARR_CHUNK_FILTERS_V0
+
+#include "device/props/components.h"
+
+#include "nlohmann/json.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace acquire::sink::zarr {
+enum class FilterId : uint8_t
+{
+    Delta,
+    BitRound,
+    PackBits,
+    TemporalDelta,
+};
+
+/// @brief A filter applied to each chunk, in order, after tiling and before
+/// compression.
+/// @details PackBits packs u10, u12, and u14 samples into a contiguous
+/// big-endian bit stream, shrinking the chunk. It must be the last filter.
+/// TemporalDelta stores the first frame in a chunk along the append dimension
+/// as-is, and each frame after it as its difference from the frame before it.
+/// It is computed while tiling, not by `apply_filter`, so it must be the first
+/// filter.
+struct FilterParams
+{
+    FilterId id;
+
+    /// For BitRound, the number of mantissa bits to keep. BitRound is only
+    /// supported for f32 samples.
+    uint8_t keepbits;
+
+    FilterParams();
+    explicit FilterParams(FilterId id, uint8_t keepbits = 0);
+};
+
+/// @brief Check that a filter can be applied to samples of a given type.
+/// @throw std::runtime_error if @p filter is not valid for @p type.
+void
+validate_filter(const FilterParams& filter, SampleType type);
+
+/// @brief Apply a filter in place to a buffer of samples.
+/// @param filter The filter to apply.
+/// @param type The sample type of the buffer.
+/// @param buf The buffer to filter.
+/// @param bytes_of_buf The size of @p buf, in bytes.
+/// @return The number of bytes of filtered data at the start of @p buf.
+size_t
+apply_filter(const FilterParams& filter,
+             SampleType type,
+             uint8_t* buf,
+             size_t bytes_of_buf);
+
+/// @brief Get the numcodecs-compatible configuration for a filter.
+/// @param filter The filter.
+/// @param type The sample type of the array the filter is applied to.
+/// @return A JSON object suitable for the `filters` list of array metadata.
+nlohmann::json
+filter_to_json(const FilterParams& filter, SampleType type);
+} // namespace acquire::sink::zarr
+
+#endif // H_ACQUIRE_ZARR_CHUNK_FILTERS_V0
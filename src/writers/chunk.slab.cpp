@@ -0,0 +1,430 @@
+#include "chunk.slab.hh"
+#include "../common.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace zarr = acquire::sink::zarr;
+namespace fs = std::filesystem;
+
+zarr::ChunkSlab::ChunkSlab()
+  : data_{ nullptr }
+  , capacity_{ 0 }
+  , n_slots_{ 0 }
+  , stride_{ 0 }
+  , resident_bytes_{ 0 }
+  , file_offset_{ 0 }
+  , file_{ -1 }
+  , mapping_{ nullptr }
+{
+}
+
+zarr::ChunkSlab::~ChunkSlab() noexcept
+{
+    release_();
+}
+
+void
+zarr::ChunkSlab::back_with_file(const std::string& directory,
+                                size_t resident_bytes)
+{
+    EXPECT(!directory.empty(), "Spill directory must not be empty.");
+    EXPECT(fs::is_directory(directory),
+           "Spill directory %s does not exist.",
+           directory.c_str());
+    spill_directory_ = directory;
+    resident_bytes_ = resident_bytes;
+}
+
+void
+zarr::ChunkSlab::resize(size_t n_slots, size_t bytes_per_slot)
+{
+    const size_t stride =
+      (bytes_per_slot + slot_alignment - 1) / slot_alignment * slot_alignment;
+    const size_t bytes_of_slab = n_slots * stride;
+
+    if (bytes_of_slab > capacity_) {
+        release_();
+        allocate_(bytes_of_slab);
+    }
+
+    n_slots_ = n_slots;
+    stride_ = stride;
+}
+
+void
+zarr::ChunkSlab::zero() noexcept
+{
+    if (!data_) {
+        return;
+    }
+
+    const size_t bytes_of_slab = n_slots_ * stride_;
+#ifndef _WIN32
+    // Dropping the file's pages zeros them without writing them back, and
+    // without faulting in pages that were paged out.
+    if (file_ >= 0 && ftruncate((int)file_, 0) == 0 &&
+        ftruncate((int)file_, (off_t)(capacity_ - file_offset_)) == 0) {
+        memset(data_, 0, std::min(file_offset_, bytes_of_slab));
+        return;
+    }
+#endif
+    memset(data_, 0, bytes_of_slab);
+}
+
+void
+zarr::ChunkSlab::copy_from(const ChunkSlab& other)
+{
+    resize(other.n_slots_, other.stride_);
+    if (other.data_) {
+        memcpy(data_, other.data_, n_slots_ * stride_);
+    }
+}
+
+void
+zarr::ChunkSlab::swap(ChunkSlab& other) noexcept
+{
+    std::swap(data_, other.data_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(n_slots_, other.n_slots_);
+    std::swap(stride_, other.stride_);
+    std::swap(spill_directory_, other.spill_directory_);
+    std::swap(resident_bytes_, other.resident_bytes_);
+    std::swap(file_offset_, other.file_offset_);
+    std::swap(file_, other.file_);
+    std::swap(mapping_, other.mapping_);
+}
+
+void
+zarr::ChunkSlab::advise_cold() noexcept
+{
+#ifdef MADV_COLD
+    if (file_ >= 0 && capacity_ > file_offset_) {
+        madvise(data_ + file_offset_, capacity_ - file_offset_, MADV_COLD);
+    }
+#endif
+}
+
+void
+zarr::ChunkSlab::advise_page_out() noexcept
+{
+#ifdef MADV_PAGEOUT
+    if (file_ >= 0 && capacity_ > file_offset_) {
+        madvise(data_ + file_offset_, capacity_ - file_offset_, MADV_PAGEOUT);
+    }
+#endif
+}
+
+void
+zarr::ChunkSlab::allocate_(size_t bytes)
+{
+#ifdef _WIN32
+    const size_t resident_bytes = 0;
+#else
+    const auto page_size = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t resident_bytes = resident_bytes_ / page_size * page_size;
+#endif
+
+    if (spill_directory_.empty() || resident_bytes >= bytes) {
+        data_ = (uint8_t*)::operator new(bytes, std::align_val_t{ alignment });
+        capacity_ = bytes;
+        return;
+    }
+
+#ifdef _WIN32
+    char path[MAX_PATH];
+    EXPECT(GetTempFileNameA(spill_directory_.c_str(), "azr", 0, path),
+           "Failed to name a scratch file in %s.",
+           spill_directory_.c_str());
+
+    HANDLE file = CreateFileA(path,
+                              GENERIC_READ | GENERIC_WRITE,
+                              0,
+                              nullptr,
+                              CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_TEMPORARY |
+                                FILE_FLAG_DELETE_ON_CLOSE,
+                              nullptr);
+    EXPECT(file != INVALID_HANDLE_VALUE,
+           "Failed to create scratch file %s.",
+           path);
+
+    HANDLE mapping = CreateFileMappingA(file,
+                                        nullptr,
+                                        PAGE_READWRITE,
+                                        (DWORD)((uint64_t)bytes >> 32),
+                                        (DWORD)(bytes & 0xffffffff),
+                                        nullptr);
+    void* data =
+      mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes)
+              : nullptr;
+    if (!data) {
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        throw std::runtime_error("Failed to map scratch file.");
+    }
+
+    file_ = (intptr_t)file;
+    mapping_ = mapping;
+#else
+    // reserve the whole slab in anonymous memory, then map the file over the
+    // part past what stays resident
+    void* data = mmap(nullptr,
+                      bytes,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1,
+                      0);
+    EXPECT(data != MAP_FAILED,
+           "Failed to reserve %zu bytes: %s",
+           bytes,
+           strerror(errno));
+
+    std::string path =
+      (fs::path(spill_directory_) / "acquire-zarr-XXXXXX").string();
+    const int fd = mkstemp(path.data());
+    if (fd < 0) {
+        const int err = errno;
+        munmap(data, bytes);
+        throw std::runtime_error("Failed to create a scratch file in " +
+                                 spill_directory_ + ": " + strerror(err));
+    }
+
+    // the descriptor and the mapping keep the file alive
+    unlink(path.c_str());
+
+    const size_t bytes_of_file = bytes - resident_bytes;
+    void* tail = MAP_FAILED;
+    if (ftruncate(fd, (off_t)bytes_of_file) == 0) {
+        tail = mmap((uint8_t*)data + resident_bytes,
+                    bytes_of_file,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_FIXED,
+                    fd,
+                    0);
+    }
+    if (tail == MAP_FAILED) {
+        const int err = errno;
+        munmap(data, bytes);
+        close(fd);
+        throw std::runtime_error(std::string("Failed to map scratch file: ") +
+                                 strerror(err));
+    }
+
+    file_ = fd;
+    file_offset_ = resident_bytes;
+#endif
+
+    data_ = (uint8_t*)data;
+    capacity_ = bytes;
+}
+
+void
+zarr::ChunkSlab::release_() noexcept
+{
+    if (!data_) {
+        return;
+    }
+
+    if (file_ == -1) {
+        ::operator delete(data_, std::align_val_t{ alignment });
+    } else {
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+        CloseHandle((HANDLE)mapping_);
+        CloseHandle((HANDLE)file_);
+        mapping_ = nullptr;
+#else
+        // unmaps the resident part and the file-backed part alike
+        munmap(data_, capacity_);
+        close((int)file_);
+#endif
+        file_ = -1;
+        file_offset_ = 0;
+    }
+
+    data_ = nullptr;
+    capacity_ = 0;
+}
+
+uint8_t*
+zarr::ChunkSlab::slot(size_t i) noexcept
+{
+    return data_ + i * stride_;
+}
+
+const uint8_t*
+zarr::ChunkSlab::slot(size_t i) const noexcept
+{
+    return data_ + i * stride_;
+}
+
+size_t
+zarr::ChunkSlab::n_slots() const noexcept
+{
+    return n_slots_;
+}
+
+size_t
+zarr::ChunkSlab::stride() const noexcept
+{
+    return stride_;
+}
+
+bool
+zarr::ChunkSlab::empty() const noexcept
+{
+    return n_slots_ == 0;
+}
+
+bool
+zarr::ChunkSlab::is_file_backed() const noexcept
+{
+    return file_ != -1;
+}
+
+size_t
+zarr::ChunkSlab::bytes_spilled() const noexcept
+{
+    return file_ == -1 ? 0 : capacity_ - file_offset_;
+}
+
+#ifndef NO_UNIT_TESTS
+#ifdef _WIN32
+#define acquire_export __declspec(dllexport)
+#else
+#define acquire_export
+#endif
+
+extern "C"
+{
+    acquire_export int unit_test__chunk_slab()
+    {
+        int retval = 0;
+        try {
+            zarr::ChunkSlab slab;
+            CHECK(slab.empty());
+
+            slab.resize(5, 100);
+            CHECK(slab.n_slots() == 5);
+            CHECK(slab.stride() == 128);
+            CHECK((uintptr_t)slab.slot(0) % zarr::ChunkSlab::alignment == 0);
+            for (auto i = 1; i < 5; ++i) {
+                CHECK(slab.slot(i) == slab.slot(i - 1) + 128);
+            }
+
+            memset(slab.slot(0), 0xff, 5 * slab.stride());
+            slab.zero();
+            for (auto i = 0; i < 5 * slab.stride(); ++i) {
+                CHECK(slab.slot(0)[i] == 0);
+            }
+
+            // shrinking keeps the allocation
+            uint8_t* data = slab.slot(0);
+            slab.resize(2, 64);
+            CHECK(slab.n_slots() == 2);
+            CHECK(slab.stride() == 64);
+            CHECK(slab.slot(0) == data);
+
+            // growing past the allocation reallocates, still aligned
+            slab.resize(100, 4096);
+            CHECK(slab.stride() == 4096);
+            CHECK((uintptr_t)slab.slot(0) % zarr::ChunkSlab::alignment == 0);
+            slab.zero();
+            CHECK(slab.slot(99)[4095] == 0);
+            CHECK(!slab.is_file_backed());
+
+            // a file-backed slab behaves the same, and leaves no file behind
+            const auto dir = fs::temp_directory_path() / "acquire-spill";
+            fs::create_directories(dir);
+            {
+                zarr::ChunkSlab spilled;
+                spilled.back_with_file(dir.string());
+                spilled.resize(3, 5000);
+                CHECK(spilled.is_file_backed());
+                CHECK(spilled.stride() == 5056);
+                CHECK((uintptr_t)spilled.slot(0) %
+                        zarr::ChunkSlab::alignment ==
+                      0);
+
+                memset(spilled.slot(0), 0xab, 3 * spilled.stride());
+                CHECK(spilled.slot(2)[5055] == 0xab);
+                spilled.zero();
+                for (auto i = 0; i < 3 * spilled.stride(); ++i) {
+                    CHECK(spilled.slot(0)[i] == 0);
+                }
+
+                // swapping carries the mapping along
+                zarr::ChunkSlab other;
+                other.resize(1, 64);
+                spilled.slot(1)[7] = 42;
+                other.swap(spilled);
+                CHECK(other.is_file_backed());
+                CHECK(!spilled.is_file_backed());
+                CHECK(other.slot(1)[7] == 42);
+                CHECK(other.bytes_spilled() == 3 * other.stride());
+            }
+            CHECK(fs::is_empty(dir));
+
+            // only the part past what stays resident is file-backed
+            {
+                zarr::ChunkSlab spilled;
+                spilled.back_with_file(dir.string(), 64 * 1024 + 100);
+                spilled.resize(8, 32 * 1024);
+                CHECK(spilled.is_file_backed());
+#ifndef _WIN32
+                CHECK(spilled.bytes_spilled() > 0);
+                CHECK(spilled.bytes_spilled() <= 6 * 32 * 1024);
+#endif
+
+                for (auto i = 0; i < 8; ++i) {
+                    memset(spilled.slot(i), i + 1, spilled.stride());
+                }
+                spilled.advise_cold();
+                spilled.advise_page_out();
+                for (auto i = 0; i < 8; ++i) {
+                    CHECK(spilled.slot(i)[0] == i + 1);
+                    CHECK(spilled.slot(i)[spilled.stride() - 1] == i + 1);
+                }
+
+                spilled.zero();
+                for (auto i = 0; i < 8 * spilled.stride(); ++i) {
+                    CHECK(spilled.slot(0)[i] == 0);
+                }
+
+                // nothing to spill if it all stays resident
+                zarr::ChunkSlab resident;
+                resident.back_with_file(dir.string(), 1 << 20);
+                resident.resize(8, 32 * 1024);
+                CHECK(!resident.is_file_backed());
+                CHECK(resident.bytes_spilled() == 0);
+            }
+            CHECK(fs::is_empty(dir));
+            fs::remove_all(dir);
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+}
+#endif
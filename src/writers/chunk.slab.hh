@@ -0,0 +1,90 @@
+#ifndef H_ACQUIRE_ZARR_CHUNK_SLAB_V0
+#define H_ACQUIRE_ZARR_CHUNK_SLAB_V0
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace acquire::sink::zarr {
+/// @brief A single contiguous allocation divided into fixed-stride slots, one
+/// per chunk.
+/// @details The slab starts on a page boundary, and each slot starts on a
+/// cache line boundary, so chunk addresses are predictable from the chunk
+/// index alone and the whole slab can be registered for I/O at once.
+/// The tail of a slab may instead map a scratch file, so that under memory
+/// pressure the OS pages the least recently touched chunks in it out to the
+/// file rather than failing the allocation.
+struct ChunkSlab
+{
+  public:
+    static constexpr size_t alignment = 4096;
+    static constexpr size_t slot_alignment = 64;
+
+    ChunkSlab();
+    ChunkSlab(const ChunkSlab&) = delete;
+    ChunkSlab& operator=(const ChunkSlab&) = delete;
+    ~ChunkSlab() noexcept;
+
+    /// @brief Map a scratch file created in @p directory for all but the
+    /// first @p resident_bytes of the slab, rounded down to a page, from the
+    /// next allocation on. The file is deleted when the slab releases it, or
+    /// if the process exits first.
+    /// @note On Windows, the file backs the whole slab.
+    void back_with_file(const std::string& directory,
+                        size_t resident_bytes = 0);
+
+    /// @brief Lay out the slab for @p n_slots slots of at least
+    /// @p bytes_per_slot bytes each. Only reallocates if the slab would grow.
+    void resize(size_t n_slots, size_t bytes_per_slot);
+
+    /// @brief Fill every slot with zeros.
+    void zero() noexcept;
+
+    /// @brief Copy the layout and contents of @p other.
+    void copy_from(const ChunkSlab& other);
+
+    void swap(ChunkSlab& other) noexcept;
+
+    /// @brief Hint that the file-backed part of the slab won't be touched
+    /// again soon, so the OS reclaims its pages before others under memory
+    /// pressure. No-op where unsupported.
+    void advise_cold() noexcept;
+
+    /// @brief Hint that the OS write the file-backed part of the slab out to
+    /// its scratch file and reclaim its pages now. No-op where unsupported.
+    void advise_page_out() noexcept;
+
+    uint8_t* slot(size_t i) noexcept;
+    const uint8_t* slot(size_t i) const noexcept;
+
+    size_t n_slots() const noexcept;
+    size_t stride() const noexcept;
+    bool empty() const noexcept;
+    bool is_file_backed() const noexcept;
+
+    /// @brief The number of bytes of the slab mapped from its scratch file.
+    size_t bytes_spilled() const noexcept;
+
+  private:
+    uint8_t* data_;
+    size_t capacity_;
+    size_t n_slots_;
+    size_t stride_;
+
+    // if nonempty, where to create the scratch file
+    std::string spill_directory_;
+    // how much of the slab to keep in memory, when spilling
+    size_t resident_bytes_;
+    // where the file-backed part of the slab starts
+    size_t file_offset_;
+    // the scratch file's descriptor, or HANDLE on Windows
+    intptr_t file_;
+    // the file mapping HANDLE on Windows
+    void* mapping_;
+
+    void allocate_(size_t bytes);
+    void release_() noexcept;
+};
+} // namespace acquire::sink::zarr
+
+#endif // H_ACQUIRE_ZARR_CHUNK_SLAB_V0
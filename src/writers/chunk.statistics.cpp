@@ -0,0 +1,294 @@
+#include "chunk.statistics.hh"
+#include "../common.hh"
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+namespace zarr = acquire::sink::zarr;
+namespace common = zarr::common;
+using json = nlohmann::json;
+
+namespace {
+/// The lowest value of an integer sample type, i.e., the lower edge of the
+/// first histogram bin.
+int64_t
+range_min(SampleType type)
+{
+    switch (type) {
+        case SampleType_i8:
+        case SampleType_i16:
+            return -(int64_t{ 1 } << (common::bit_depth(type) - 1));
+        default:
+            return 0;
+    }
+}
+
+/// The number of bits to shift a sample, less the range minimum, right by to
+/// get its histogram bin.
+unsigned
+bin_shift(SampleType type)
+{
+    size_t bits_per_bin = 0;
+    for (size_t n = zarr::ChunkStatistics::n_bins; n > 1; n >>= 1) {
+        ++bits_per_bin;
+    }
+    return common::bit_depth(type) - bits_per_bin;
+}
+
+// The min/max/sum loop is written as a simple reduction so that the compiler
+// vectorizes it with the instruction set enabled by `target_enable_simd`.
+template<typename T>
+void
+update_row(const T* px,
+           size_t n,
+           double& min,
+           double& max,
+           double& sum,
+           uint64_t* histogram,
+           SampleType type)
+{
+    using Acc = std::conditional_t<std::is_floating_point_v<T>,
+                                   double,
+                                   std::conditional_t<std::is_signed_v<T>,
+                                                      int64_t,
+                                                      uint64_t>>;
+
+    T lo = px[0], hi = px[0];
+    Acc acc = 0;
+    for (size_t i = 0; i < n; ++i) {
+        lo = std::min(lo, px[i]);
+        hi = std::max(hi, px[i]);
+        acc += (Acc)px[i];
+    }
+
+    min = std::min(min, (double)lo);
+    max = std::max(max, (double)hi);
+    sum += (double)acc;
+
+    if constexpr (!std::is_floating_point_v<T>) {
+        const int64_t offset = range_min(type);
+        const unsigned shift = bin_shift(type);
+        constexpr uint64_t last_bin = zarr::ChunkStatistics::n_bins - 1;
+        for (size_t i = 0; i < n; ++i) {
+            // samples past the bit depth land in the last bin
+            const auto bin = (uint64_t)((int64_t)px[i] - offset) >> shift;
+            ++histogram[std::min(bin, last_bin)];
+        }
+    }
+}
+} // namespace
+
+zarr::ChunkStatistics::ChunkStatistics()
+{
+    reset();
+}
+
+void
+zarr::ChunkStatistics::update(const uint8_t* row,
+                              size_t n_samples,
+                              SampleType type)
+{
+    if (n_samples == 0) {
+        return;
+    }
+
+    switch (type) {
+        case SampleType_u8:
+            update_row(
+              row, n_samples, min_, max_, sum_, histogram_.data(), type);
+            break;
+        case SampleType_i8:
+            update_row((const int8_t*)row,
+                       n_samples,
+                       min_,
+                       max_,
+                       sum_,
+                       histogram_.data(),
+                       type);
+            break;
+        case SampleType_u10:
+        case SampleType_u12:
+        case SampleType_u14:
+        case SampleType_u16:
+            update_row((const uint16_t*)row,
+                       n_samples,
+                       min_,
+                       max_,
+                       sum_,
+                       histogram_.data(),
+                       type);
+            break;
+        case SampleType_i16:
+            update_row((const int16_t*)row,
+                       n_samples,
+                       min_,
+                       max_,
+                       sum_,
+                       histogram_.data(),
+                       type);
+            break;
+        case SampleType_f32:
+            update_row((const float*)row,
+                       n_samples,
+                       min_,
+                       max_,
+                       sum_,
+                       histogram_.data(),
+                       type);
+            break;
+        default:
+            throw std::runtime_error("Unsupported sample type.");
+    }
+
+    count_ += n_samples;
+}
+
+void
+zarr::ChunkStatistics::reset() noexcept
+{
+    count_ = 0;
+    min_ = std::numeric_limits<double>::infinity();
+    max_ = -std::numeric_limits<double>::infinity();
+    sum_ = 0;
+    histogram_.fill(0);
+}
+
+uint64_t
+zarr::ChunkStatistics::count() const noexcept
+{
+    return count_;
+}
+
+double
+zarr::ChunkStatistics::min() const noexcept
+{
+    return min_;
+}
+
+double
+zarr::ChunkStatistics::max() const noexcept
+{
+    return max_;
+}
+
+double
+zarr::ChunkStatistics::mean() const noexcept
+{
+    return count_ ? sum_ / (double)count_ : 0.;
+}
+
+const std::array<uint64_t, zarr::ChunkStatistics::n_bins>&
+zarr::ChunkStatistics::histogram() const noexcept
+{
+    return histogram_;
+}
+
+json
+zarr::chunk_statistics_header_to_json(SampleType type)
+{
+    json header = {
+        { "dtype", common::sample_type_to_dtype(type) },
+        { "histogram_bins", ChunkStatistics::n_bins },
+    };
+
+    if (type == SampleType_f32) {
+        header["histogram_range"] = nullptr;
+    } else {
+        const int64_t lo = range_min(type);
+        header["histogram_range"] = {
+            lo, lo + (int64_t{ 1 } << common::bit_depth(type))
+        };
+    }
+
+    return header;
+}
+
+json
+zarr::chunk_statistics_to_json(const ChunkStatistics& stats,
+                               const std::vector<size_t>& chunk_key,
+                               SampleType type)
+{
+    json line = {
+        { "chunk", chunk_key },
+        { "count", stats.count() },
+        { "min", stats.min() },
+        { "max", stats.max() },
+        { "mean", stats.mean() },
+    };
+
+    if (type == SampleType_f32) {
+        line["histogram"] = nullptr;
+    } else {
+        line["histogram"] = stats.histogram();
+    }
+
+    return line;
+}
+
+#ifndef NO_UNIT_TESTS
+#ifdef _WIN32
+#define acquire_export __declspec(dllexport)
+#else
+#define acquire_export
+#endif
+
+extern "C"
+{
+    acquire_export int unit_test__chunk_statistics()
+    {
+        int retval = 0;
+        try {
+            // u12 samples: bins are 256 wide over [0, 4096)
+            zarr::ChunkStatistics stats;
+            const std::vector<uint16_t> row1 = { 0, 255, 256, 4095 };
+            const std::vector<uint16_t> row2 = { 1000, 5000 }; // out of range
+            stats.update(
+              (const uint8_t*)row1.data(), row1.size(), SampleType_u12);
+            stats.update(
+              (const uint8_t*)row2.data(), row2.size(), SampleType_u12);
+
+            CHECK(stats.count() == 6);
+            CHECK(stats.min() == 0);
+            CHECK(stats.max() == 5000);
+            CHECK(stats.mean() == (0 + 255 + 256 + 4095 + 1000 + 5000) / 6.);
+
+            const auto& histogram = stats.histogram();
+            CHECK(histogram.at(0) == 2);
+            CHECK(histogram.at(1) == 1);
+            CHECK(histogram.at(3) == 1);
+            CHECK(histogram.at(15) == 2);
+
+            const auto header =
+              zarr::chunk_statistics_header_to_json(SampleType_u12);
+            CHECK(header["histogram_range"][1] == 4096);
+
+            // signed samples are binned from the bottom of their range
+            stats.reset();
+            CHECK(stats.count() == 0);
+            const std::vector<int8_t> row3 = { -128, -1, 0, 127 };
+            stats.update(
+              (const uint8_t*)row3.data(), row3.size(), SampleType_i8);
+            CHECK(stats.min() == -128);
+            CHECK(stats.max() == 127);
+            CHECK(stats.histogram().at(0) == 1);
+            CHECK(stats.histogram().at(7) == 1);
+            CHECK(stats.histogram().at(8) == 1);
+            CHECK(stats.histogram().at(15) == 1);
+
+            const auto line =
+              zarr::chunk_statistics_to_json(stats, { 0, 1, 2 }, SampleType_i8);
+            CHECK(line["chunk"][2] == 2);
+            CHECK(line["count"] == 4);
+            CHECK(line["histogram"].size() == zarr::ChunkStatistics::n_bins);
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+}
+#endif
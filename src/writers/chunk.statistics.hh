@@ -0,0 +1,69 @@
+#ifndef H_ACQUIRE_ZARR_CHUNK_STATISTICS_V0
+#define H_ACQUIRE_ZARR_CHUNK_STATISTICS_V0
+
+#include "device/props/components.h"
+#include "nlohmann/json.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace acquire::sink::zarr {
+/// @brief Summary statistics of the samples written to one chunk.
+/// @details Updated row by row as frames are tiled, so that viewers and QC
+/// tools can pick contrast limits without reading the chunks back. Padding in
+/// ragged chunks is never counted.
+struct ChunkStatistics
+{
+  public:
+    /// The histogram divides the range of the sample type into this many
+    /// equal bins.
+    static constexpr size_t n_bins = 16;
+
+    /// The name of the statistics file, stored alongside the array's chunks.
+    static constexpr char filename[] = "chunk_statistics.jsonl";
+
+    ChunkStatistics();
+
+    /// @brief Add a row of contiguous samples.
+    /// @param row The samples.
+    /// @param n_samples The number of samples in @p row.
+    /// @param type The type of the samples.
+    void update(const uint8_t* row, size_t n_samples, SampleType type);
+
+    void reset() noexcept;
+
+    uint64_t count() const noexcept;
+    double min() const noexcept;
+    double max() const noexcept;
+    double mean() const noexcept;
+
+    /// @brief The number of samples in each bin. All zeros for f32 samples,
+    /// which have no fixed range.
+    const std::array<uint64_t, n_bins>& histogram() const noexcept;
+
+  private:
+    uint64_t count_;
+    double min_;
+    double max_;
+    double sum_;
+    std::array<uint64_t, n_bins> histogram_;
+};
+
+/// @brief Describe the histogram bins for a sample type, as the first line of
+/// the statistics file.
+nlohmann::json
+chunk_statistics_header_to_json(SampleType type);
+
+/// @brief Get one chunk's statistics as a line of the statistics file.
+/// @param stats The statistics.
+/// @param chunk_key The chunk's index along each dimension, slowest first.
+/// @param type The type of the samples.
+nlohmann::json
+chunk_statistics_to_json(const ChunkStatistics& stats,
+                         const std::vector<size_t>& chunk_key,
+                         SampleType type);
+} // namespace acquire::sink::zarr
+
+#endif // H_ACQUIRE_ZARR_CHUNK_STATISTICS_V0
@@ -0,0 +1,228 @@
+#include "chunk.transpose.hh"
+#include "../common.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace zarr = acquire::sink::zarr;
+
+namespace {
+// Each tile spans one cache line of elements. The inner loop is a plain
+// strided copy, which the compiler unrolls and vectorizes for each element
+// type.
+template<typename T>
+void
+transpose_tiled(T* dst, const T* src, size_t rows, size_t cols)
+{
+    constexpr size_t tile = std::max<size_t>(64 / sizeof(T), 8);
+
+    for (size_t r0 = 0; r0 < rows; r0 += tile) {
+        const size_t r1 = std::min(r0 + tile, rows);
+        for (size_t c0 = 0; c0 < cols; c0 += tile) {
+            const size_t c1 = std::min(c0 + tile, cols);
+            for (size_t r = r0; r < r1; ++r) {
+                const T* in = src + r * cols;
+                for (size_t c = c0; c < c1; ++c) {
+                    dst[c * rows + r] = in[c];
+                }
+            }
+        }
+    }
+}
+
+// wide elements are already contiguous runs, so copy each one whole
+void
+transpose_elements(uint8_t* dst,
+                   const uint8_t* src,
+                   size_t rows,
+                   size_t cols,
+                   size_t bytes_per_element)
+{
+    constexpr size_t tile = 8;
+
+    for (size_t r0 = 0; r0 < rows; r0 += tile) {
+        const size_t r1 = std::min(r0 + tile, rows);
+        for (size_t c0 = 0; c0 < cols; c0 += tile) {
+            const size_t c1 = std::min(c0 + tile, cols);
+            for (size_t r = r0; r < r1; ++r) {
+                for (size_t c = c0; c < c1; ++c) {
+                    std::memcpy(dst + (c * rows + r) * bytes_per_element,
+                                src + (r * cols + c) * bytes_per_element,
+                                bytes_per_element);
+                }
+            }
+        }
+    }
+}
+} // namespace
+
+const char*
+zarr::chunk_order_to_string(ChunkOrder order)
+{
+    switch (order) {
+        case ChunkOrder::C:
+            return "C";
+        case ChunkOrder::F:
+            return "F";
+        default:
+            throw std::runtime_error("Unknown chunk order.");
+    }
+}
+
+void
+zarr::transpose(uint8_t* dst,
+                const uint8_t* src,
+                size_t rows,
+                size_t cols,
+                size_t bytes_per_element)
+{
+    switch (bytes_per_element) {
+        case 1:
+            transpose_tiled(dst, src, rows, cols);
+            break;
+        case 2:
+            transpose_tiled((uint16_t*)dst, (const uint16_t*)src, rows, cols);
+            break;
+        case 4:
+            transpose_tiled((uint32_t*)dst, (const uint32_t*)src, rows, cols);
+            break;
+        case 8:
+            transpose_tiled((uint64_t*)dst, (const uint64_t*)src, rows, cols);
+            break;
+        default:
+            transpose_elements(dst, src, rows, cols, bytes_per_element);
+            break;
+    }
+}
+
+void
+zarr::chunk_to_f_order(uint8_t* chunk,
+                       std::vector<uint8_t>& scratch,
+                       const std::vector<size_t>& chunk_shape,
+                       size_t bytes_per_sample)
+{
+    CHECK(chunk);
+    CHECK(bytes_per_sample > 0);
+
+    size_t n_samples = 1;
+    for (const auto& size : chunk_shape) {
+        CHECK(size > 0);
+        n_samples *= size;
+    }
+
+    const size_t bytes_of_chunk = n_samples * bytes_per_sample;
+    if (scratch.size() < bytes_of_chunk) {
+        scratch.resize(bytes_of_chunk);
+    }
+
+    // Reversing the dimensions is a sequence of 2D transposes: move the
+    // slowest remaining dimension behind those already moved, which travel
+    // together as one element.
+    const uint8_t* src = chunk;
+    uint8_t* dst = scratch.data();
+    size_t bytes_per_element = bytes_per_sample;
+    size_t cols = n_samples;
+    for (auto i = 0; i + 1 < chunk_shape.size(); ++i) {
+        const size_t rows = chunk_shape.at(i);
+        cols /= rows;
+
+        // a dimension of size 1 moves for free
+        if (rows > 1 && cols > 1) {
+            transpose(dst, src, rows, cols, bytes_per_element);
+            src = dst;
+            dst = (dst == chunk) ? scratch.data() : chunk;
+        }
+        bytes_per_element *= rows;
+    }
+
+    if (src != chunk) {
+        std::memcpy(chunk, src, bytes_of_chunk);
+    }
+}
+
+#ifndef NO_UNIT_TESTS
+#ifdef _WIN32
+#define acquire_export __declspec(dllexport)
+#else
+#define acquire_export
+#endif
+
+namespace {
+/// Fill a chunk with the row-major index of each sample, reorder it, and
+/// check that each sample lands at its column-major index.
+template<typename T>
+void
+check_f_order(const std::vector<size_t>& shape)
+{
+    size_t n = 1;
+    for (const auto& size : shape) {
+        n *= size;
+    }
+
+    std::vector<T> chunk(n);
+    for (size_t i = 0; i < n; ++i) {
+        chunk[i] = (T)i;
+    }
+
+    std::vector<uint8_t> scratch;
+    zarr::chunk_to_f_order((uint8_t*)chunk.data(), scratch, shape, sizeof(T));
+
+    std::vector<size_t> idx(shape.size(), 0);
+    for (size_t i = 0; i < n; ++i) {
+        // i is the row-major index of idx
+        size_t f_index = 0;
+        for (auto d = shape.size(); d-- > 0;) {
+            f_index = f_index * shape.at(d) + idx.at(d);
+        }
+        CHECK(chunk.at(f_index) == (T)i);
+
+        for (auto d = shape.size(); d-- > 0;) {
+            if (++idx.at(d) < shape.at(d)) {
+                break;
+            }
+            idx.at(d) = 0;
+        }
+    }
+}
+} // namespace
+
+extern "C"
+{
+    acquire_export int unit_test__chunk_transpose()
+    {
+        int retval = 0;
+        try {
+            // 2D, with an element size that takes the generic path
+            const size_t rows = 5, cols = 11, bytes_per_element = 3;
+            std::vector<uint8_t> src(rows * cols * bytes_per_element);
+            for (auto i = 0; i < src.size(); ++i) {
+                src[i] = (uint8_t)i;
+            }
+            std::vector<uint8_t> dst(src.size());
+            zarr::transpose(
+              dst.data(), src.data(), rows, cols, bytes_per_element);
+            for (auto r = 0; r < rows; ++r) {
+                for (auto c = 0; c < cols; ++c) {
+                    CHECK(std::memcmp(&dst[(c * rows + r) * 3],
+                                      &src[(r * cols + c) * 3],
+                                      3) == 0);
+                }
+            }
+
+            check_f_order<uint8_t>({ 70, 3 });
+            check_f_order<uint16_t>({ 3, 1, 4, 5 });
+            check_f_order<uint16_t>({ 8, 2, 3, 40, 33 });
+            check_f_order<uint32_t>({ 2, 17, 9 });
+            check_f_order<uint32_t>({ 1, 1, 6 });
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+}
+#endif
@@ -0,0 +1,49 @@
+#ifndef H_ACQUIRE_ZARR_CHUNK_TRANSPOSE_V0
+#define H_ACQUIRE_ZARR_CHUNK_TRANSPOSE_V0
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace acquire::sink::zarr {
+/// @brief The order of samples within a chunk.
+enum class ChunkOrder
+{
+    /// Row-major: the last dimension (x) varies fastest.
+    C,
+    /// Column-major: the first dimension (time) varies fastest, so that the
+    /// samples of a pixel's time series are contiguous within each chunk.
+    F,
+};
+
+/// @brief Get the name of a chunk order, as declared in the array metadata.
+const char*
+chunk_order_to_string(ChunkOrder order);
+
+/// @brief Transpose a dense 2D array of fixed-size elements.
+/// @details Works in square tiles so that both the rows read and the rows
+/// written stay in cache.
+/// @param dst The transposed array, @p cols x @p rows.
+/// @param src The array to transpose, @p rows x @p cols.
+/// @param bytes_per_element The size of each element, in bytes.
+void
+transpose(uint8_t* dst,
+          const uint8_t* src,
+          size_t rows,
+          size_t cols,
+          size_t bytes_per_element);
+
+/// @brief Reorder a row-major chunk into column-major order, in place.
+/// @param chunk The chunk.
+/// @param scratch A buffer to transpose through, grown as needed.
+/// @param chunk_shape The size of the chunk along each dimension, slowest
+/// first, as in the array metadata.
+/// @param bytes_per_sample The size of each sample, in bytes.
+void
+chunk_to_f_order(uint8_t* chunk,
+                 std::vector<uint8_t>& scratch,
+                 const std::vector<size_t>& chunk_shape,
+                 size_t bytes_per_sample);
+} // namespace acquire::sink::zarr
+
+#endif // H_ACQUIRE_ZARR_CHUNK_TRANSPOSE_V0
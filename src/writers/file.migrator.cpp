@@ -0,0 +1,318 @@
+#include "file.migrator.hh"
+#include "../common.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+
+namespace zarr = acquire::sink::zarr;
+
+namespace {
+// copy in blocks, so that pacing is smooth and memory use is bounded
+constexpr size_t bytes_per_block = 1 << 20;
+} // namespace
+
+zarr::FileMigrator::FileMigrator(const std::string& source_root,
+                                 const std::string& destination_root,
+                                 double max_bytes_per_second)
+  : source_root_{ fs::absolute(source_root).lexically_normal() }
+  , destination_root_{ fs::absolute(destination_root).lexically_normal() }
+  , max_bytes_per_second_{ max_bytes_per_second }
+  , done_{ false }
+  , abandoned_{ false }
+  , throttled_{ max_bytes_per_second > 0 }
+  , failed_{ false }
+  , bytes_migrated_{ 0 }
+  , next_copy_{ std::chrono::steady_clock::now() }
+{
+    EXPECT(max_bytes_per_second_ >= 0,
+           "Migration rate must not be negative.");
+    EXPECT(source_root_ != destination_root_,
+           "Cannot migrate %s to itself.",
+           source_root_.string().c_str());
+
+    thread_ = std::thread([this] { run_(); });
+}
+
+zarr::FileMigrator::~FileMigrator() noexcept
+{
+    {
+        std::scoped_lock lock(mutex_);
+        done_ = true;
+        abandoned_ = true;
+    }
+    cv_.notify_all();
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void
+zarr::FileMigrator::enqueue(const std::string& path)
+{
+    {
+        std::scoped_lock lock(mutex_);
+        EXPECT(!done_, "Cannot queue %s after finishing.", path.c_str());
+        queue_.push(path);
+    }
+    cv_.notify_one();
+}
+
+bool
+zarr::FileMigrator::finish(const std::vector<std::string>& last_paths)
+{
+    // acquisition is over, so stop pacing and drain the queue
+    throttled_ = false;
+    {
+        std::scoped_lock lock(mutex_);
+        done_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    std::set<fs::path> last;
+    for (const auto& path : last_paths) {
+        last.insert(fs::absolute(path).lexically_normal());
+    }
+
+    // files never queued, e.g., chunk statistics
+    std::vector<fs::path> remaining;
+    if (fs::is_directory(source_root_)) {
+        for (const auto& entry :
+             fs::recursive_directory_iterator(source_root_)) {
+            const auto path = entry.path().lexically_normal();
+            if (entry.is_regular_file() && !last.contains(path)) {
+                remaining.push_back(path);
+            }
+        }
+    }
+    std::sort(remaining.begin(), remaining.end());
+
+    for (const auto& path : remaining) {
+        if (!migrate_(path)) {
+            failed_ = true;
+        }
+    }
+    for (const auto& path : last_paths) {
+        if (fs::exists(path) && !migrate_(path)) {
+            failed_ = true;
+        }
+    }
+
+    if (failed_) {
+        LOGE("Some files could not be migrated and remain in %s.",
+             source_root_.string().c_str());
+        return false;
+    }
+
+    std::error_code ec;
+    fs::remove_all(source_root_, ec);
+    if (ec) {
+        LOGE("Failed to remove %s: %s",
+             source_root_.string().c_str(),
+             ec.message().c_str());
+    }
+
+    return true;
+}
+
+size_t
+zarr::FileMigrator::bytes_migrated() const noexcept
+{
+    return bytes_migrated_;
+}
+
+void
+zarr::FileMigrator::run_()
+{
+    while (true) {
+        fs::path path;
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return done_ || !queue_.empty(); });
+            if (abandoned_ || queue_.empty()) {
+                return;
+            }
+            path = queue_.front();
+            queue_.pop();
+        }
+
+        if (!migrate_(path)) {
+            failed_ = true;
+        }
+    }
+}
+
+bool
+zarr::FileMigrator::migrate_(const fs::path& path)
+{
+    const auto source = fs::absolute(path).lexically_normal();
+    const auto relative_path = source.lexically_relative(source_root_);
+    if (relative_path.empty() || *relative_path.begin() == "..") {
+        LOGE("Cannot migrate %s, which is outside of %s.",
+             source.string().c_str(),
+             source_root_.string().c_str());
+        return false;
+    }
+
+    const auto destination = destination_root_ / relative_path;
+    auto partial = destination;
+    partial += ".partial";
+
+    try {
+        fs::create_directories(destination.parent_path());
+
+        {
+            std::ifstream in(source, std::ios::binary);
+            EXPECT(in.is_open(),
+                   "Failed to open %s.",
+                   source.string().c_str());
+            std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+            EXPECT(out.is_open(),
+                   "Failed to open %s.",
+                   partial.string().c_str());
+
+            std::vector<char> block(bytes_per_block);
+            while (in) {
+                in.read(block.data(), (std::streamsize)block.size());
+                const auto n = (size_t)in.gcount();
+                if (n == 0) {
+                    break;
+                }
+                out.write(block.data(), (std::streamsize)n);
+                EXPECT(out.good(),
+                       "Failed to write %s.",
+                       partial.string().c_str());
+
+                bytes_migrated_ += n;
+                throttle_(n);
+            }
+            EXPECT(in.eof(), "Failed to read %s.", source.string().c_str());
+        }
+
+        fs::rename(partial, destination);
+        fs::remove(source);
+    } catch (const std::exception& exc) {
+        LOGE("Failed to migrate %s: %s",
+             source.string().c_str(),
+             exc.what());
+
+        std::error_code ec;
+        fs::remove(partial, ec);
+        return false;
+    }
+
+    return true;
+}
+
+void
+zarr::FileMigrator::throttle_(size_t bytes)
+{
+    if (!throttled_) {
+        return;
+    }
+
+    // don't bank time spent idle as credit for a burst
+    using namespace std::chrono;
+    const auto copy_time = duration_cast<steady_clock::duration>(
+      duration<double>((double)bytes / max_bytes_per_second_));
+    next_copy_ = std::max(next_copy_, steady_clock::now()) + copy_time;
+    std::this_thread::sleep_until(next_copy_);
+}
+
+#ifndef NO_UNIT_TESTS
+#ifdef _WIN32
+#define acquire_export __declspec(dllexport)
+#else
+#define acquire_export
+#endif
+
+namespace {
+void
+write_file(const fs::path& path, size_t bytes, char fill)
+{
+    fs::create_directories(path.parent_path());
+    std::ofstream ofs(path, std::ios::binary);
+    const std::string data(bytes, fill);
+    ofs.write(data.data(), (std::streamsize)data.size());
+}
+} // namespace
+
+extern "C"
+{
+    acquire_export int unit_test__file_migrator()
+    {
+        const fs::path source_dir = fs::temp_directory_path() / "acquire";
+        const fs::path destination_dir =
+          fs::temp_directory_path() / "acquire-migrated";
+        int retval = 0;
+
+        try {
+            fs::remove_all(source_dir);
+            fs::remove_all(destination_dir);
+
+            const auto chunk = source_dir / "0" / "0" / "1";
+            const auto statistics =
+              source_dir / "0" / "chunk_statistics.jsonl";
+            const auto metadata = source_dir / "0" / ".zarray";
+            write_file(chunk, 3 * bytes_per_block / 2, 'c');
+            write_file(statistics, 10, 's');
+            write_file(metadata, 20, 'm');
+
+            // 1.5 MiB at 10 MiB/s takes at least 150 ms
+            const auto start = std::chrono::steady_clock::now();
+            {
+                zarr::FileMigrator migrator(source_dir.string(),
+                                            destination_dir.string(),
+                                            10. * bytes_per_block);
+                migrator.enqueue(chunk.string());
+
+                while (fs::exists(chunk)) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+                CHECK(std::chrono::steady_clock::now() - start >=
+                      std::chrono::milliseconds(140));
+                CHECK(fs::exists(metadata)); // not until finished
+
+                CHECK(migrator.finish({ metadata.string() }));
+                CHECK(migrator.bytes_migrated() ==
+                      3 * bytes_per_block / 2 + 10 + 20);
+            }
+
+            CHECK(!fs::exists(source_dir));
+            CHECK(fs::file_size(destination_dir / "0" / "0" / "1") ==
+                  3 * bytes_per_block / 2);
+            CHECK(fs::file_size(destination_dir / "0" /
+                                "chunk_statistics.jsonl") == 10);
+            CHECK(fs::file_size(destination_dir / "0" / ".zarray") == 20);
+
+            std::ifstream ifs(destination_dir / "0" / ".zarray");
+            CHECK(ifs.get() == 'm');
+
+            // nothing is left half-copied
+            for (const auto& entry :
+                 fs::recursive_directory_iterator(destination_dir)) {
+                CHECK(entry.path().extension() != ".partial");
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(source_dir)) {
+            fs::remove_all(source_dir);
+        }
+        if (fs::exists(destination_dir)) {
+            fs::remove_all(destination_dir);
+        }
+        return retval;
+    }
+}
+#endif
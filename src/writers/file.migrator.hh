@@ -0,0 +1,77 @@
+#ifndef H_ACQUIRE_ZARR_FILE_MIGRATOR_V0
+#define H_ACQUIRE_ZARR_FILE_MIGRATOR_V0
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace acquire::sink::zarr {
+/// @brief Moves closed files from fast scratch storage to bulk storage in the
+/// background.
+/// @details Files are moved one at a time, on a thread of their own, to the
+/// same path relative to the destination root as they have relative to the
+/// source root. Each is copied to a temporary name, renamed into place, and
+/// only then removed from the source. While acquiring, copies are paced to at
+/// most `max_bytes_per_second`, so that migration doesn't starve the writers.
+struct FileMigrator
+{
+  public:
+    /// @param source_root The directory files are migrated out of.
+    /// @param destination_root The directory standing in for @p source_root
+    /// on bulk storage.
+    /// @param max_bytes_per_second The most bytes to copy per second while
+    /// acquiring, or 0 to copy as fast as possible.
+    FileMigrator(const std::string& source_root,
+                 const std::string& destination_root,
+                 double max_bytes_per_second);
+    ~FileMigrator() noexcept;
+
+    /// @brief Queue a file for migration. The file must not be written to
+    /// again.
+    void enqueue(const std::string& path);
+
+    /// @brief Migrate every queued file at full speed, then every other file
+    /// left under the source root, then @p last_paths in order, and remove
+    /// the source root.
+    /// @param last_paths Files to migrate after all others, e.g., metadata,
+    /// so that a reader never finds metadata describing missing chunks.
+    /// @return True iff every file was migrated.
+    [[nodiscard]] bool finish(const std::vector<std::string>& last_paths);
+
+    /// @brief The number of bytes migrated so far.
+    size_t bytes_migrated() const noexcept;
+
+  private:
+    fs::path source_root_;
+    fs::path destination_root_;
+    double max_bytes_per_second_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::queue<fs::path> queue_;
+    bool done_;      // no more files are coming
+    bool abandoned_; // leave what is queued behind
+
+    std::atomic<bool> throttled_;
+    std::atomic<bool> failed_;
+    std::atomic<size_t> bytes_migrated_;
+    std::chrono::steady_clock::time_point next_copy_;
+
+    std::thread thread_;
+
+    void run_();
+    [[nodiscard]] bool migrate_(const fs::path& path);
+    void throttle_(size_t bytes);
+};
+} // namespace acquire::sink::zarr
+
+#endif // H_ACQUIRE_ZARR_FILE_MIGRATOR_V0
@@ -1,9 +1,64 @@
 #include "file.sink.hh"
 
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <latch>
+#include <set>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace zarr = acquire::sink::zarr;
 
+namespace {
+/// Run @p job for each index in [0, n) on the thread pool and wait for all of
+/// them.
+/// @return True iff every job succeeded.
+bool
+run_in_parallel(zarr::common::ThreadPool& thread_pool,
+                size_t n,
+                const std::function<bool(size_t, std::string&)>& job)
+{
+    if (n == 0) {
+        return true;
+    }
+
+    std::atomic<bool> all_successful = true;
+    std::latch latch(n);
+    for (size_t i = 0; i < n; ++i) {
+        thread_pool.push_to_job_queue(
+          [i, &job, &latch, &all_successful](std::string& err) -> bool {
+              bool success = false;
+              try {
+                  success = all_successful && job(i, err);
+              } catch (const std::exception& exc) {
+                  err = exc.what();
+              } catch (...) {
+                  err = "(unknown)";
+              }
+
+              all_successful = all_successful && success;
+              latch.count_down();
+              return success;
+          });
+    }
+    latch.wait();
+
+    return all_successful;
+}
+} // namespace
+
 template<>
 zarr::Sink*
 zarr::sink_open<zarr::FileSink>(const std::string& uri)
@@ -27,10 +82,18 @@ zarr::sink_close<zarr::FileSink>(Sink* sink_)
 
 zarr::FileSink::FileSink(const std::string& uri)
   : file_{ new struct file }
+  , path_{ uri }
 {
     CHECK(file_create(file_, uri.c_str(), uri.size() + 1));
 }
 
+zarr::FileSink::FileSink(const fs::path& path, struct file* file)
+  : file_{ file }
+  , path_{ path }
+{
+    CHECK(file_);
+}
+
 zarr::FileSink::~FileSink()
 {
     if (file_) {
@@ -46,22 +109,167 @@ zarr::FileSink::write(size_t offset, const uint8_t* buf, size_t bytes_of_buf)
         return false;
     }
 
+    if (rate_limiter_) {
+        rate_limiter_->acquire(bytes_of_buf);
+    }
+
     return file_write(file_, offset, buf, buf + bytes_of_buf);
 }
 
+bool
+zarr::FileSink::truncate(size_t size)
+{
+    if (!file_) {
+        return false;
+    }
+
+    std::error_code ec;
+    fs::resize_file(path_, size, ec);
+    if (ec) {
+        LOGE("Failed to truncate %s: %s",
+             path_.string().c_str(),
+             ec.message().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool
+zarr::FileSink::start_writeback()
+{
+    if (!file_) {
+        return false;
+    }
+
+#ifdef __linux__
+    // 0 bytes means through the end of the file
+    if (sync_file_range(file_->fid, 0, 0, SYNC_FILE_RANGE_WRITE) != 0) {
+        LOGE("Failed to start writeback of %s: %s",
+             path_.string().c_str(),
+             strerror(errno));
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+bool
+zarr::FileSink::sync()
+{
+    if (!file_) {
+        return false;
+    }
+
+#ifdef _WIN32
+    const bool success = FlushFileBuffers((HANDLE)file_->hfile);
+#elif defined(__APPLE__)
+    const bool success = fsync(file_->fid) == 0;
+#else
+    const bool success = fdatasync(file_->fid) == 0;
+#endif
+    if (!success) {
+        LOGE("Failed to sync %s.", path_.string().c_str());
+    }
+
+    return success;
+}
+
+bool
+zarr::FileSink::preallocate(size_t bytes)
+{
+    if (!file_ || bytes == 0) {
+        return false;
+    }
+
+#ifdef _WIN32
+    FILE_ALLOCATION_INFO info{};
+    info.AllocationSize.QuadPart = (LONGLONG)bytes;
+    return SetFileInformationByHandle(
+      (HANDLE)file_->hfile, FileAllocationInfo, &info, sizeof(info));
+#elif defined(__APPLE__)
+    // contiguous if possible, else in any extents
+    fstore_t store = {
+        F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, (off_t)bytes, 0
+    };
+    if (fcntl(file_->fid, F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        return fcntl(file_->fid, F_PREALLOCATE, &store) != -1;
+    }
+    return true;
+#else
+    // keep the size, so that writes of less than an upper bound leave no
+    // trailing zeros
+    return fallocate(file_->fid, FALLOC_FL_KEEP_SIZE, 0, (off_t)bytes) == 0;
+#endif
+}
+
 zarr::FileCreator::FileCreator(std::shared_ptr<common::ThreadPool> thread_pool)
   : thread_pool_(thread_pool)
 {
+#ifndef _WIN32
+    data_root_fd_ = -1;
+#endif
+}
+
+zarr::FileCreator::FileCreator(std::shared_ptr<common::ThreadPool> thread_pool,
+                               const std::string& data_root,
+                               const std::vector<std::string>& stripe_roots,
+                               std::shared_ptr<RateLimiter> rate_limiter)
+  : thread_pool_(thread_pool)
+  , data_root_(data_root)
+  , rate_limiter_(rate_limiter)
+{
+    for (const auto& root : stripe_roots) {
+        stripe_roots_.push_back(fs::absolute(root));
+    }
+#ifndef _WIN32
+    data_root_fd_ = -1;
+#endif
+}
+
+zarr::FileCreator::~FileCreator() noexcept
+{
+#ifndef _WIN32
+    if (data_root_fd_ >= 0) {
+        close(data_root_fd_);
+    }
+#endif
 }
 
 bool
-zarr::FileCreator::create_chunk_sinks(const std::string& base_uri,
-                                      const std::vector<Dimension>& dimensions,
-                                      std::vector<Sink*>& chunk_sinks)
+zarr::FileCreator::create_chunk_sinks(
+  const std::string& base_uri,
+  const std::vector<Dimension>& dimensions,
+  std::vector<Sink*>& chunk_sinks,
+  const std::vector<size_t>& bytes_to_preallocate)
 {
     const std::string base_dir =
       base_uri.starts_with("file://") ? base_uri.substr(7) : base_uri;
 
+#ifndef _WIN32
+    // striped files are opened by path, to link each into the tree
+    if (stripe_roots_.empty()) {
+        std::vector<size_t> dirs_per_level;
+        for (auto i = dimensions.size() - 2; i >= 1; --i) {
+            const auto n_chunks =
+              common::chunks_along_dimension(dimensions.at(i));
+            CHECK(n_chunks);
+            dirs_per_level.push_back(n_chunks);
+        }
+
+        const auto n_chunks =
+          common::chunks_along_dimension(dimensions.front());
+        CHECK(n_chunks);
+        return make_tree_at_(base_dir,
+                             dirs_per_level,
+                             n_chunks,
+                             chunk_sinks,
+                             bytes_to_preallocate);
+    }
+#endif
+
     std::queue<fs::path> paths;
     paths.push(base_dir);
 
@@ -104,17 +312,41 @@ zarr::FileCreator::create_chunk_sinks(const std::string& base_uri,
         }
     }
 
-    return make_files_(paths, chunk_sinks);
+    return make_files_(paths, chunk_sinks, true, bytes_to_preallocate);
 }
 
 bool
-zarr::FileCreator::create_shard_sinks(const std::string& base_uri,
-                                      const std::vector<Dimension>& dimensions,
-                                      std::vector<Sink*>& shard_sinks)
+zarr::FileCreator::create_shard_sinks(
+  const std::string& base_uri,
+  const std::vector<Dimension>& dimensions,
+  std::vector<Sink*>& shard_sinks,
+  const std::vector<size_t>& bytes_to_preallocate)
 {
     const std::string base_dir =
       base_uri.starts_with("file://") ? base_uri.substr(7) : base_uri;
 
+#ifndef _WIN32
+    // striped files are opened by path, to link each into the tree
+    if (stripe_roots_.empty()) {
+        std::vector<size_t> dirs_per_level;
+        for (auto i = dimensions.size() - 2; i >= 1; --i) {
+            const auto n_shards =
+              common::shards_along_dimension(dimensions.at(i));
+            CHECK(n_shards);
+            dirs_per_level.push_back(n_shards);
+        }
+
+        const auto n_shards =
+          common::shards_along_dimension(dimensions.front());
+        CHECK(n_shards);
+        return make_tree_at_(base_dir,
+                             dirs_per_level,
+                             n_shards,
+                             shard_sinks,
+                             bytes_to_preallocate);
+    }
+#endif
+
     std::queue<fs::path> paths;
     paths.push(base_dir);
 
@@ -159,7 +391,7 @@ zarr::FileCreator::create_shard_sinks(const std::string& base_uri,
         }
     }
 
-    return make_files_(paths, shard_sinks);
+    return make_files_(paths, shard_sinks, true, bytes_to_preallocate);
 }
 
 bool
@@ -177,7 +409,7 @@ zarr::FileCreator::create_metadata_sinks(const std::vector<std::string>& paths,
         file_paths.push(p);
     }
 
-    return make_files_(file_paths, metadata_sinks);
+    return make_files_(file_paths, metadata_sinks, false, {});
 }
 
 bool
@@ -244,16 +476,49 @@ zarr::FileCreator::make_dirs_(std::queue<fs::path>& dir_paths)
 }
 
 bool
-zarr::FileCreator::make_files_(std::queue<fs::path>& file_paths,
-                               std::vector<Sink*>& files)
+zarr::FileCreator::make_files_(
+  std::queue<fs::path>& file_paths,
+  std::vector<Sink*>& files,
+  bool stripe,
+  const std::vector<size_t>& bytes_to_preallocate)
 {
     if (file_paths.empty()) {
         return true;
     }
 
+    const auto n_files = file_paths.size();
+    CHECK(bytes_to_preallocate.empty() ||
+          bytes_to_preallocate.size() == n_files);
+    auto preallocate_bytes = [&bytes_to_preallocate](size_t i) -> size_t {
+        return bytes_to_preallocate.empty() ? 0 : bytes_to_preallocate.at(i);
+    };
+
+    // where each file's bytes live, if not at its own path
+    std::vector<fs::path> targets(n_files);
+    if (stripe && !stripe_roots_.empty()) {
+        std::set<fs::path> target_dirs;
+        for (auto i = 0; i < n_files; ++i) {
+            const auto filename = file_paths.front();
+            file_paths.pop();
+
+            const auto& root = stripe_roots_.at(i % stripe_roots_.size());
+            targets.at(i) = root / filename.lexically_relative(data_root_);
+            target_dirs.insert(targets.at(i).parent_path());
+
+            file_paths.push(filename);
+        }
+
+        std::queue<fs::path> dir_paths;
+        for (const auto& dir : target_dirs) {
+            dir_paths.push(dir);
+        }
+        if (!make_dirs_(dir_paths)) {
+            return false;
+        }
+    }
+
     std::atomic<bool> all_successful = true;
 
-    const auto n_files = file_paths.size();
     files.resize(n_files);
     std::fill(files.begin(), files.end(), nullptr);
     std::latch latch(n_files);
@@ -265,14 +530,34 @@ zarr::FileCreator::make_files_(std::queue<fs::path>& file_paths,
         Sink** psink = files.data() + i;
 
         thread_pool_->push_to_job_queue(
-          [filename, psink, &latch, &all_successful](std::string& err) -> bool {
+          [filename,
+           target = targets.at(i),
+           rate_limiter = stripe ? rate_limiter_ : nullptr,
+           bytes = preallocate_bytes(i),
+           psink,
+           &latch,
+           &all_successful](std::string& err) -> bool {
               bool success = false;
 
               try {
-                  if (all_successful) {
-                      *psink =
-                        (FileSink*)sink_open<FileSink>(filename.string());
+                  FileSink* sink = nullptr;
+                  if (all_successful && target.empty()) {
+                      sink = (FileSink*)sink_open<FileSink>(filename.string());
+                  } else if (all_successful) {
+                      sink = (FileSink*)sink_open<FileSink>(target.string());
+
+                      // replace whatever a previous run left behind
+                      std::error_code ec;
+                      fs::remove(filename, ec);
+                      fs::create_symlink(target, filename);
                   }
+                  if (sink) {
+                      sink->rate_limiter_ = rate_limiter;
+
+                      // best effort; not every filesystem can
+                      sink->preallocate(bytes);
+                  }
+                  *psink = sink;
                   success = true;
               } catch (const std::exception& exc) {
                   char buf[128];
@@ -303,6 +588,163 @@ zarr::FileCreator::make_files_(std::queue<fs::path>& file_paths,
     return all_successful;
 }
 
+#ifndef _WIN32
+int
+zarr::FileCreator::open_base_dir_(const fs::path& base_dir)
+{
+    const auto relative_dir = data_root_.empty()
+                                ? fs::path()
+                                : base_dir.lexically_relative(data_root_);
+    if (relative_dir.empty() || *relative_dir.begin() == "..") {
+        std::error_code ec;
+        fs::create_directories(base_dir, ec);
+        return open(base_dir.c_str(), O_RDONLY | O_DIRECTORY);
+    }
+
+    if (data_root_fd_ < 0) {
+        std::error_code ec;
+        fs::create_directories(data_root_, ec);
+        data_root_fd_ = open(data_root_.c_str(), O_RDONLY | O_DIRECTORY);
+        if (data_root_fd_ < 0) {
+            return -1;
+        }
+    }
+
+    // walk down from the data root, one level at a time
+    int fd = openat(data_root_fd_, ".", O_RDONLY | O_DIRECTORY);
+    for (const auto& name : relative_dir) {
+        if (fd < 0 || name == ".") {
+            continue;
+        }
+        if (mkdirat(fd, name.c_str(), 0777) != 0 && errno != EEXIST) {
+            close(fd);
+            return -1;
+        }
+        const int child_fd = openat(fd, name.c_str(), O_RDONLY | O_DIRECTORY);
+        close(fd);
+        fd = child_fd;
+    }
+    return fd;
+}
+
+bool
+zarr::FileCreator::make_tree_at_(
+  const fs::path& base_dir,
+  const std::vector<size_t>& dirs_per_level,
+  size_t files_per_dir,
+  std::vector<Sink*>& files,
+  const std::vector<size_t>& bytes_to_preallocate)
+{
+    // every directory names its children the same way
+    size_t max_children = files_per_dir;
+    for (const auto& n_dirs : dirs_per_level) {
+        max_children = std::max(max_children, n_dirs);
+    }
+    std::vector<std::string> names(max_children);
+    for (auto i = 0; i < names.size(); ++i) {
+        names.at(i) = std::to_string(i);
+    }
+
+    const int base_fd = open_base_dir_(base_dir);
+    if (base_fd < 0) {
+        LOGE("Failed to open directory '%s': %s.",
+             base_dir.string().c_str(),
+             strerror(errno));
+        return false;
+    }
+
+    // the open directories of the current level, with their paths
+    std::vector<int> dir_fds{ base_fd };
+    std::vector<fs::path> dir_paths{ base_dir };
+    auto close_dirs = [&dir_fds]() {
+        for (const auto& fd : dir_fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        dir_fds.clear();
+    };
+
+    for (const auto& n_dirs : dirs_per_level) {
+        std::vector<int> child_fds(dir_fds.size() * n_dirs, -1);
+        std::vector<fs::path> child_paths(child_fds.size());
+
+        const bool success = run_in_parallel(
+          *thread_pool_, dir_fds.size(), [&](size_t i, std::string& err) {
+              for (auto k = 0; k < n_dirs; ++k) {
+                  const char* name = names.at(k).c_str();
+                  const auto j = i * n_dirs + k;
+                  child_paths.at(j) = dir_paths.at(i) / names.at(k);
+
+                  if (mkdirat(dir_fds.at(i), name, 0777) != 0 &&
+                      errno != EEXIST) {
+                      err = "Failed to create directory '" +
+                            child_paths.at(j).string() +
+                            "': " + strerror(errno);
+                      return false;
+                  }
+
+                  child_fds.at(j) =
+                    openat(dir_fds.at(i), name, O_RDONLY | O_DIRECTORY);
+                  if (child_fds.at(j) < 0) {
+                      err = "Failed to open directory '" +
+                            child_paths.at(j).string() +
+                            "': " + strerror(errno);
+                      return false;
+                  }
+              }
+              return true;
+          });
+
+        close_dirs();
+        dir_fds = std::move(child_fds);
+        dir_paths = std::move(child_paths);
+
+        if (!success) {
+            close_dirs();
+            return false;
+        }
+    }
+
+    const auto n_files = dir_fds.size() * files_per_dir;
+    CHECK(bytes_to_preallocate.empty() ||
+          bytes_to_preallocate.size() == n_files);
+    files.assign(n_files, nullptr);
+
+    const bool success = run_in_parallel(
+      *thread_pool_, dir_fds.size(), [&](size_t i, std::string& err) {
+          for (auto k = 0; k < files_per_dir; ++k) {
+              const auto j = i * files_per_dir + k;
+              const int fd = openat(dir_fds.at(i),
+                                    names.at(k).c_str(),
+                                    O_RDWR | O_CREAT | O_TRUNC,
+                                    0666);
+              if (fd < 0) {
+                  err = "Failed to create file '" +
+                        (dir_paths.at(i) / names.at(k)).string() +
+                        "': " + strerror(errno);
+                  return false;
+              }
+
+              auto* file = new ::file;
+              file->fid = fd;
+
+              auto* sink = new FileSink(dir_paths.at(i) / names.at(k), file);
+              sink->rate_limiter_ = rate_limiter_;
+              if (!bytes_to_preallocate.empty()) {
+                  sink->preallocate(bytes_to_preallocate.at(j));
+              }
+              files.at(j) = sink;
+          }
+          return true;
+      });
+
+    close_dirs();
+
+    return success;
+}
+#endif
+
 #ifndef NO_UNIT_TESTS
 #ifdef _WIN32
 #define acquire_export __declspec(dllexport)
@@ -415,5 +857,258 @@ extern "C"
         }
         return retval;
     }
+
+    acquire_export int unit_test__file_creator__create_nested_chunk_sinks()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s\n", err.c_str()); });
+            zarr::FileCreator file_creator{ thread_pool };
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x", DimensionType_Space, 10, 2, 0); // 5 chunks
+            dims.emplace_back("y", DimensionType_Space, 4, 2, 0);  // 2 chunks
+            dims.emplace_back("c", DimensionType_Channel, 3, 1, 0); // 3 chunks
+            dims.emplace_back(
+              "t", DimensionType_Time, 0, 3, 0); // 3 timepoints per chunk
+
+            // the second time around, every directory and file already
+            // exists, and the files are truncated
+            const uint8_t data[] = { 1, 2, 3 };
+            for (auto pass = 0; pass < 2; ++pass) {
+                std::vector<zarr::Sink*> files;
+                CHECK(file_creator.create_chunk_sinks(
+                  base_dir.string(), dims, files));
+                CHECK(files.size() == 3 * 2 * 5);
+
+                // files come out in chunk order
+                for (auto i = 0; i < files.size(); ++i) {
+                    const auto* sink =
+                      dynamic_cast<zarr::FileSink*>(files.at(i));
+                    CHECK(sink);
+                    CHECK(sink->path_ == base_dir / std::to_string(i / 10) /
+                                           std::to_string(i / 5 % 2) /
+                                           std::to_string(i % 5));
+                    CHECK(fs::file_size(sink->path_) == 0);
+                    CHECK(files.at(i)->write(0, data, sizeof(data) - pass));
+                    zarr::sink_close<zarr::FileSink>(files.at(i));
+                }
+            }
+
+            for (auto c = 0; c < 3; ++c) {
+                for (auto y = 0; y < 2; ++y) {
+                    for (auto x = 0; x < 5; ++x) {
+                        CHECK(fs::is_regular_file(
+                          base_dir / std::to_string(c) / std::to_string(y) /
+                          std::to_string(x)));
+                    }
+                }
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__file_creator__create_trees_under_data_root()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        const fs::path other_dir = fs::temp_directory_path() / "acquire-other";
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s\n", err.c_str()); });
+
+            // the data root doesn't exist until the first tree is made
+            const auto data_root = base_dir / "0";
+            zarr::FileCreator file_creator{
+                thread_pool, data_root.string(), {}, nullptr
+            };
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x", DimensionType_Space, 4, 2, 0); // 2 chunks
+            dims.emplace_back("y", DimensionType_Space, 6, 2, 0); // 3 chunks
+            dims.emplace_back("t", DimensionType_Time, 0, 3, 0);
+
+            // one tree per flush, each a level or more below the data root,
+            // then one outside it
+            const std::vector<fs::path> tree_roots = {
+                data_root / "0",
+                data_root / "1",
+                data_root / "2" / "0",
+                other_dir,
+            };
+            for (const auto& tree_root : tree_roots) {
+                std::vector<zarr::Sink*> files;
+                CHECK(file_creator.create_chunk_sinks(
+                  tree_root.string(), dims, files));
+                CHECK(files.size() == 3 * 2);
+
+                for (auto i = 0; i < files.size(); ++i) {
+                    const auto* sink =
+                      dynamic_cast<zarr::FileSink*>(files.at(i));
+                    CHECK(sink);
+                    CHECK(sink->path_ == tree_root / std::to_string(i / 2) /
+                                           std::to_string(i % 2));
+                    zarr::sink_close<zarr::FileSink>(files.at(i));
+                    CHECK(fs::is_regular_file(tree_root /
+                                              std::to_string(i / 2) /
+                                              std::to_string(i % 2)));
+                }
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        for (const auto& dir : { base_dir, other_dir }) {
+            if (fs::exists(dir)) {
+                fs::remove_all(dir);
+            }
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__file_creator__stripe_chunk_sinks()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        const fs::path stripe_dir =
+          fs::temp_directory_path() / "acquire-stripes";
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s\n", err.c_str()); });
+
+            const std::vector<std::string> stripe_roots{
+                (stripe_dir / "a" / "0").string(),
+                (stripe_dir / "b" / "0").string(),
+                (stripe_dir / "c" / "0").string(),
+            };
+            zarr::FileCreator file_creator{ thread_pool,
+                                            (base_dir / "0").string(),
+                                            stripe_roots,
+                                            nullptr };
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x", DimensionType_Space, 10, 2, 0); // 5 chunks
+            dims.emplace_back("y", DimensionType_Space, 4, 2, 0);  // 2 chunks
+            dims.emplace_back(
+              "z", DimensionType_Space, 0, 3, 0); // 3 timepoints per chunk
+
+            std::vector<zarr::Sink*> files;
+            CHECK(file_creator.create_chunk_sinks(
+              (base_dir / "0" / "0").string(), dims, files));
+
+            CHECK(files.size() == 5 * 2);
+            for (auto i = 0; i < files.size(); ++i) {
+                const uint8_t byte = (uint8_t)i;
+                CHECK(files.at(i)->write(0, &byte, 1));
+                sink_close<zarr::FileSink>(files.at(i));
+            }
+
+            // each file lives in one stripe, round-robin in chunk order, and
+            // is linked into the array
+            for (auto y = 0; y < 2; ++y) {
+                for (auto x = 0; x < 5; ++x) {
+                    const auto i = y * 5 + x;
+                    const auto key = fs::path("0") / std::to_string(y) /
+                                     std::to_string(x);
+                    const auto link = base_dir / "0" / key;
+                    CHECK(fs::is_symlink(link));
+
+                    for (auto r = 0; r < stripe_roots.size(); ++r) {
+                        const auto target = fs::path(stripe_roots.at(r)) / key;
+                        CHECK(fs::exists(target) == (r == i % 3));
+                    }
+
+                    std::ifstream ifs(link, std::ios::binary);
+                    CHECK(ifs.get() == i);
+                }
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        if (fs::exists(stripe_dir)) {
+            fs::remove_all(stripe_dir);
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__file_sink__sync()
+    {
+        const fs::path path = fs::temp_directory_path() / "acquire-sync";
+        int retval = 0;
+
+        try {
+            auto* sink = (zarr::FileSink*)zarr::sink_open<zarr::FileSink>(
+              path.string());
+            CHECK(sink);
+
+            const std::vector<uint8_t> data(1 << 16, 7);
+            CHECK(sink->write(0, data.data(), data.size()));
+            CHECK(sink->start_writeback());
+            CHECK(sink->write(data.size(), data.data(), data.size()));
+            CHECK(sink->sync());
+            zarr::sink_close<zarr::FileSink>(sink);
+
+            CHECK(fs::file_size(path) == 2 * data.size());
+
+            // preallocating reserves storage but leaves the size alone
+            fs::remove(path);
+            sink = (zarr::FileSink*)zarr::sink_open<zarr::FileSink>(
+              path.string());
+            const bool preallocated = sink->preallocate(1 << 20);
+#ifndef _WIN32
+            struct stat st;
+            CHECK(fstat(sink->file_->fid, &st) == 0);
+            CHECK(!preallocated || st.st_blocks * 512 >= (1 << 20));
+#endif
+            CHECK(sink->write(0, data.data(), data.size()));
+            zarr::sink_close<zarr::FileSink>(sink);
+            CHECK(fs::file_size(path) == data.size());
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(path)) {
+            fs::remove(path);
+        }
+        return retval;
+    }
 } // extern "C"
 #endif // NO_UNIT_TESTS
\ No newline at end of file
@@ -2,23 +2,60 @@
 #define H_ACQUIRE_STORAGE_ZARR_FILESYSTEM_SINK_V0
 
 #include "sink.hh"
+#include "rate.limiter.hh"
 #include "platform.h"
 
 #include <filesystem>
+#include <memory>
 
 namespace fs = std::filesystem;
 
 namespace acquire::sink::zarr {
+/// @brief When written chunks are forced out of the page cache to storage.
+enum class Durability
+{
+    /// Leave writeback to the OS.
+    None,
+    /// Start writeback as each flush is written, and wait for it before
+    /// closing files on rollover.
+    PerRollover,
+    /// Wait for writeback after each flush.
+    PerFlush,
+};
+
 struct FileSink : public Sink
 {
     explicit FileSink(const std::string& uri);
+
+    /// @brief Take ownership of a file already opened at @p path.
+    FileSink(const fs::path& path, struct file* file);
     ~FileSink() override;
 
     [[nodiscard]] bool write(size_t offset,
                              const uint8_t* buf,
                              size_t bytes_of_buf) override;
 
+    /// @brief Cut the file down to @p size bytes, e.g., after rewriting it
+    /// with less data.
+    [[nodiscard]] bool truncate(size_t size);
+
+    /// @brief Start writing the file's dirty pages to storage, without
+    /// waiting. A no-op where the OS has no way to do so.
+    [[nodiscard]] bool start_writeback();
+
+    /// @brief Wait until the file's data is on storage.
+    [[nodiscard]] bool sync();
+
+    /// @brief Reserve storage for the first @p bytes of the file, in as few
+    /// extents as the filesystem allows, without changing its size.
+    /// @return False if the filesystem can't, which is harmless.
+    bool preallocate(size_t bytes);
+
     struct file* file_;
+    fs::path path_;
+
+    // if set, each write waits its turn under the device's I/O limits
+    std::shared_ptr<RateLimiter> rate_limiter_;
 };
 
 struct FileCreator
@@ -26,17 +63,41 @@ struct FileCreator
   public:
     FileCreator() = delete;
     explicit FileCreator(std::shared_ptr<common::ThreadPool> thread_pool);
-    ~FileCreator() noexcept = default;
 
+    /// @brief Stripe the chunk or shard files of an array across several
+    /// directories, e.g., on different drives.
+    /// @details File i of each call goes to the same path relative to
+    /// `stripe_roots[i % stripe_roots.size()]` as it has relative to
+    /// @p data_root, and a symbolic link to it takes its place under
+    /// @p data_root, so that readers find every file where they expect it.
+    /// @param data_root The root of the array.
+    /// @param stripe_roots The directories to stripe across, each standing in
+    /// for @p data_root. If empty, files are created in place.
+    /// @param rate_limiter If set, limits writes to the chunk or shard files.
+    /// @note On POSIX systems, @p data_root is held open from the first
+    /// files created under it until the creator is destroyed, so that each
+    /// tree under it is created relative to it.
+    FileCreator(std::shared_ptr<common::ThreadPool> thread_pool,
+                const std::string& data_root,
+                const std::vector<std::string>& stripe_roots,
+                std::shared_ptr<RateLimiter> rate_limiter);
+    FileCreator(const FileCreator&) = delete;
+    FileCreator& operator=(const FileCreator&) = delete;
+    ~FileCreator() noexcept;
+
+    /// @param bytes_to_preallocate If nonempty, the size of each file, or an
+    /// upper bound on it, to reserve storage for up front.
     [[nodiscard]] bool create_chunk_sinks(
       const std::string& base_uri,
       const std::vector<Dimension>& dimensions,
-      std::vector<Sink*>& chunk_sinks);
+      std::vector<Sink*>& chunk_sinks,
+      const std::vector<size_t>& bytes_to_preallocate = {});
 
     [[nodiscard]] bool create_shard_sinks(
       const std::string& base_uri,
       const std::vector<Dimension>& dimensions,
-      std::vector<Sink*>& shard_sinks);
+      std::vector<Sink*>& shard_sinks,
+      const std::vector<size_t>& bytes_to_preallocate = {});
 
     [[nodiscard]] bool create_metadata_sinks(
       const std::vector<std::string>& paths,
@@ -44,6 +105,13 @@ struct FileCreator
 
   private:
     std::shared_ptr<common::ThreadPool> thread_pool_;
+    fs::path data_root_;
+    std::vector<fs::path> stripe_roots_;
+    std::shared_ptr<RateLimiter> rate_limiter_;
+#ifndef _WIN32
+    // the open data root, or -1 if not yet opened
+    int data_root_fd_;
+#endif
 
     /// @brief Parallel create a collection of directories.
     /// @param[in] dir_paths The directories to create.
@@ -54,9 +122,42 @@ struct FileCreator
     /// @param[in,out] file_paths The files to create. Unlike `make_dirs_`,
     /// this function drains the queue.
     /// @param[out] files The files created.
+    /// @param[in] stripe If true, stripe the files across the stripe roots.
+    /// @param[in] bytes_to_preallocate If nonempty, how much storage to
+    /// reserve for each file.
     /// @return True iff all files were created successfully.
-    [[nodiscard]] bool make_files_(std::queue<fs::path>& file_paths,
-                                   std::vector<Sink*>& files);
+    [[nodiscard]] bool make_files_(
+      std::queue<fs::path>& file_paths,
+      std::vector<Sink*>& files,
+      bool stripe,
+      const std::vector<size_t>& bytes_to_preallocate);
+
+#ifndef _WIN32
+    /// @brief Create @p base_dir if need be and open it, relative to the
+    /// open data root if @p base_dir is under it.
+    /// @return The directory's descriptor, which the caller closes, or -1.
+    int open_base_dir_(const fs::path& base_dir);
+
+    /// @brief Parallel create a tree of directories and the files at its
+    /// leaves, each relative to its parent's open directory, so that no path
+    /// is resolved more than one level deep.
+    /// @param[in] base_dir The root of the tree.
+    /// @param[in] dirs_per_level The number of directories in each directory
+    /// of the level above, outermost first, named "0", "1", ....
+    /// @param[in] files_per_dir The number of files in each leaf directory,
+    /// named the same way. Files that already exist are truncated.
+    /// @param[out] files The files created, in the same order as
+    /// `make_files_`.
+    /// @param[in] bytes_to_preallocate If nonempty, how much storage to
+    /// reserve for each file.
+    /// @return True iff all directories and files were created successfully.
+    [[nodiscard]] bool make_tree_at_(
+      const fs::path& base_dir,
+      const std::vector<size_t>& dirs_per_level,
+      size_t files_per_dir,
+      std::vector<Sink*>& files,
+      const std::vector<size_t>& bytes_to_preallocate);
+#endif
 };
 } // namespace acquire::sink::zarr
 
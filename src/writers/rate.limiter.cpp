@@ -0,0 +1,142 @@
+#include "rate.limiter.hh"
+#include "../common.hh"
+
+#include <algorithm>
+#include <thread>
+
+namespace zarr = acquire::sink::zarr;
+
+double
+zarr::RateLimiter::Bucket::take(double n, double seconds_elapsed)
+{
+    if (rate == 0) {
+        return 0;
+    }
+
+    tokens = std::min(capacity, tokens + seconds_elapsed * rate) - n;
+    return tokens < 0 ? -tokens / rate : 0;
+}
+
+zarr::RateLimiter::RateLimiter(double bytes_per_second,
+                               double writes_per_second,
+                               double burst_seconds)
+  : last_refill_{ std::chrono::steady_clock::now() }
+  , ns_throttled_{ 0 }
+  , writes_throttled_{ 0 }
+{
+    EXPECT(bytes_per_second >= 0 && writes_per_second >= 0,
+           "Rate limits must not be negative.");
+    EXPECT(burst_seconds >= 0, "Burst must not be negative.");
+
+    // both buckets start full
+    bytes_ = {
+        .rate = bytes_per_second,
+        .capacity = bytes_per_second * burst_seconds,
+        .tokens = bytes_per_second * burst_seconds,
+    };
+    writes_ = {
+        .rate = writes_per_second,
+        .capacity = writes_per_second * burst_seconds,
+        .tokens = writes_per_second * burst_seconds,
+    };
+}
+
+void
+zarr::RateLimiter::acquire(size_t bytes)
+{
+    using namespace std::chrono;
+
+    double wait_s;
+    {
+        std::scoped_lock lock(mutex_);
+        const auto now = steady_clock::now();
+        const double elapsed_s = duration<double>(now - last_refill_).count();
+        last_refill_ = now;
+
+        wait_s = std::max(bytes_.take((double)bytes, elapsed_s),
+                          writes_.take(1, elapsed_s));
+    }
+
+    if (wait_s > 0) {
+        // count the time actually slept, which may overshoot the wait
+        const auto start = steady_clock::now();
+        std::this_thread::sleep_for(duration<double>(wait_s));
+        ns_throttled_ +=
+          duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        ++writes_throttled_;
+    }
+}
+
+std::chrono::nanoseconds
+zarr::RateLimiter::time_throttled() const noexcept
+{
+    return std::chrono::nanoseconds(ns_throttled_.load());
+}
+
+uint64_t
+zarr::RateLimiter::writes_throttled() const noexcept
+{
+    return writes_throttled_;
+}
+
+#ifndef NO_UNIT_TESTS
+#ifdef _WIN32
+#define acquire_export __declspec(dllexport)
+#else
+#define acquire_export
+#endif
+
+extern "C"
+{
+    acquire_export int unit_test__rate_limiter()
+    {
+        using namespace std::chrono;
+
+        int retval = 0;
+        try {
+            // unlimited: nothing waits
+            {
+                zarr::RateLimiter limiter(0, 0, 1);
+                for (auto i = 0; i < 1000; ++i) {
+                    limiter.acquire(1 << 20);
+                }
+                CHECK(limiter.writes_throttled() == 0);
+            }
+
+            // 1 MB/s with a 100 ms burst: the first 100 kB go out at once,
+            // the next 200 kB take 200 ms
+            {
+                zarr::RateLimiter limiter(1e6, 0, 0.1);
+                const auto start = steady_clock::now();
+                limiter.acquire(100'000);
+                CHECK(limiter.writes_throttled() == 0);
+
+                limiter.acquire(100'000);
+                limiter.acquire(100'000);
+                const auto elapsed = steady_clock::now() - start;
+                CHECK(elapsed >= milliseconds(190));
+                CHECK(limiter.writes_throttled() == 2);
+                CHECK(limiter.time_throttled() >= milliseconds(190));
+            }
+
+            // 100 writes/s with no burst: 10 writes take about 100 ms
+            {
+                zarr::RateLimiter limiter(0, 100, 0);
+                const auto start = steady_clock::now();
+                for (auto i = 0; i < 10; ++i) {
+                    limiter.acquire(1);
+                }
+                CHECK(steady_clock::now() - start >= milliseconds(90));
+                CHECK(limiter.writes_throttled() == 10);
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+}
+#endif
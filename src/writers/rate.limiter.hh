@@ -0,0 +1,61 @@
+#ifndef H_ACQUIRE_ZARR_RATE_LIMITER_V0
+#define H_ACQUIRE_ZARR_RATE_LIMITER_V0
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace acquire::sink::zarr {
+/// @brief Caps the bandwidth and write rate of the sinks sharing it.
+/// @details Two token buckets, one counting bytes and one counting writes,
+/// refill at their rates and hold at most `burst_seconds` worth of tokens, so
+/// that writes after a pause go out at once while a sustained stream is
+/// smoothed to the caps. A write larger than the burst is let through on
+/// credit and the writes after it wait off the debt, so no write is refused.
+/// Safe to share between threads; each writer waits out its own debt.
+struct RateLimiter
+{
+  public:
+    /// @param bytes_per_second The most bytes to write per second, or 0 for
+    /// no limit.
+    /// @param writes_per_second The most writes per second, or 0 for no
+    /// limit.
+    /// @param burst_seconds How many seconds' worth of each cap may be spent
+    /// at once after a pause.
+    RateLimiter(double bytes_per_second,
+                double writes_per_second,
+                double burst_seconds);
+
+    /// @brief Wait until a write of @p bytes is allowed.
+    void acquire(size_t bytes);
+
+    /// @brief The time writers have spent waiting, summed over writers.
+    std::chrono::nanoseconds time_throttled() const noexcept;
+
+    /// @brief The number of writes that had to wait.
+    uint64_t writes_throttled() const noexcept;
+
+  private:
+    struct Bucket
+    {
+        double rate;     // tokens per second, 0 if unlimited
+        double capacity; // tokens
+        double tokens;   // negative when in debt
+
+        /// Take @p n tokens and return how long to wait them off.
+        double take(double n, double seconds_elapsed);
+    };
+
+    std::mutex mutex_;
+    Bucket bytes_;
+    Bucket writes_;
+    std::chrono::steady_clock::time_point last_refill_;
+
+    std::atomic<int64_t> ns_throttled_;
+    std::atomic<uint64_t> writes_throttled_;
+};
+} // namespace acquire::sink::zarr
+
+#endif // H_ACQUIRE_ZARR_RATE_LIMITER_V0
@@ -2,9 +2,16 @@
 #include "writer.hh"
 #include "../zarr.hh"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <functional>
 #include <latch>
+#include <span>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 namespace zarr = acquire::sink::zarr;
 
@@ -101,6 +108,285 @@ chunk_internal_offset(size_t frame_id,
 
     return offset * tile_size;
 }
+
+/// Find the index along the append dimension of the given frame within its
+/// chunk.
+size_t
+append_chunk_internal_index(size_t frame_id,
+                            const std::vector<zarr::Dimension>& dims)
+{
+    size_t frames_per_plane = 1;
+    for (auto i = 2; i < dims.size() - 1; ++i) {
+        frames_per_plane *= dims.at(i).array_size_px;
+    }
+
+    CHECK(frames_per_plane);
+    CHECK(dims.back().chunk_size_px);
+    return (frame_id / frames_per_plane) % dims.back().chunk_size_px;
+}
+
+/// Replace each sample in `cur` with its difference from the corresponding
+/// sample in `prev`, with wraparound, and each sample in `prev` with the
+/// original sample in `cur`, so that `prev` holds the row the next frame's
+/// difference is taken from.
+template<typename T>
+void
+delta_row(uint8_t* __restrict cur, uint8_t* __restrict prev, size_t nbytes)
+{
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2);
+
+    size_t i = 0;
+#ifdef __AVX2__
+    for (; i + sizeof(__m256i) <= nbytes; i += sizeof(__m256i)) {
+        const auto c = _mm256_loadu_si256((const __m256i*)(cur + i));
+        const auto p = _mm256_loadu_si256((const __m256i*)(prev + i));
+        const auto d = sizeof(T) == 1 ? _mm256_sub_epi8(c, p)
+                                      : _mm256_sub_epi16(c, p);
+        _mm256_storeu_si256((__m256i*)(cur + i), d);
+        _mm256_storeu_si256((__m256i*)(prev + i), c);
+    }
+#endif
+
+    auto* c = (T*)(cur + i);
+    auto* p = (T*)(prev + i);
+    for (size_t k = 0; k < (nbytes - i) / sizeof(T); ++k) {
+        const T v = c[k];
+        c[k] = (T)(v - p[k]);
+        p[k] = v;
+    }
+}
+
+/// Copy samples spaced `stride` samples apart in a row of a frame to be
+/// contiguous in a chunk.
+template<typename T>
+void
+gather_row(uint8_t* dst, const uint8_t* src, size_t n_samples, size_t stride)
+{
+    static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4);
+
+    size_t i = 0;
+#ifdef __AVX2__
+    // Gather the 32-bit word starting at each of 8 samples, then narrow the
+    // words to samples. Each read may run up to 3 bytes past its sample, so
+    // narrow samples stop short of the last ones in the row.
+    const auto bytes_per_sample = (int)(stride * sizeof(T));
+    const auto offsets = _mm256_mullo_epi32(
+      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+      _mm256_set1_epi32(bytes_per_sample));
+    const auto gather8 = [&](size_t k) {
+        return _mm256_i32gather_epi32(
+          (const int*)(src + k * stride * sizeof(T)), offsets, 1);
+    };
+
+    if constexpr (sizeof(T) == 4) {
+        for (; i + 8 <= n_samples; i += 8) {
+            _mm256_storeu_si256((__m256i*)(dst + i * sizeof(T)), gather8(i));
+        }
+    } else if constexpr (sizeof(T) == 2) {
+        const auto mask = _mm256_set1_epi32(0xffff);
+        for (; i + 16 + 2 <= n_samples; i += 16) {
+            const auto a = _mm256_and_si256(gather8(i), mask);
+            const auto b = _mm256_and_si256(gather8(i + 8), mask);
+            // packing works within 128-bit lanes, so put the lanes in order
+            const auto ab = _mm256_permute4x64_epi64(
+              _mm256_packus_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256((__m256i*)(dst + i * sizeof(T)), ab);
+        }
+    } else {
+        const auto mask = _mm256_set1_epi32(0xff);
+        const auto order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        for (; i + 32 + 2 <= n_samples; i += 32) {
+            const auto a = _mm256_and_si256(gather8(i), mask);
+            const auto b = _mm256_and_si256(gather8(i + 8), mask);
+            const auto c = _mm256_and_si256(gather8(i + 16), mask);
+            const auto d = _mm256_and_si256(gather8(i + 24), mask);
+            const auto abcd =
+              _mm256_packus_epi16(_mm256_packus_epi32(a, b),
+                                  _mm256_packus_epi32(c, d));
+            _mm256_storeu_si256((__m256i*)(dst + i),
+                                _mm256_permutevar8x32_epi32(abcd, order));
+        }
+    }
+#endif
+
+    auto* d = (T*)dst;
+    const auto* s = (const T*)src;
+    for (; i < n_samples; ++i) {
+        d[i] = s[i * stride];
+    }
+}
+
+#ifdef __AVX2__
+/// Byte shuffle masks that pick the samples of each of `C` interleaved
+/// channels out of 16 bytes of samples, as `masks[c * C + b]` for channel c
+/// and the b-th 16 bytes of a run of 16 * C bytes. Bytes of other channels,
+/// and of other runs of 16 bytes, are zeroed.
+template<typename T, size_t C>
+constexpr std::array<std::array<int8_t, 16>, C * C>
+deinterleave_masks()
+{
+    std::array<std::array<int8_t, 16>, C * C> masks{};
+    for (size_t c = 0; c < C; ++c) {
+        for (size_t b = 0; b < C; ++b) {
+            for (size_t k = 0; k < 16; ++k) {
+                const size_t sample = k / sizeof(T);
+                const size_t byte = (sample * C + c) * sizeof(T) +
+                                    k % sizeof(T);
+                masks[c * C + b][k] =
+                  byte / 16 == b ? (int8_t)(byte % 16) : (int8_t)-128;
+            }
+        }
+    }
+    return masks;
+}
+#endif
+
+/// Split a row of samples from `C` interleaved channels into one contiguous row
+/// per channel, so that each row of the frame is read once no matter how many
+/// channels it holds. With AVX2, every 32 bytes of each channel are assembled
+/// from byte shuffles of 32 * C bytes of the row, 16 bytes per 128-bit lane.
+template<typename T, size_t C>
+void
+deinterleave_row(uint8_t* const* dsts, const uint8_t* src, size_t n_samples)
+{
+    size_t i = 0;
+#ifdef __AVX2__
+    static constexpr auto masks = deinterleave_masks<T, C>();
+    __m256i m[C * C];
+    for (size_t k = 0; k < C * C; ++k) {
+        m[k] = _mm256_broadcastsi128_si256(
+          _mm_loadu_si128((const __m128i*)masks[k].data()));
+    }
+
+    constexpr size_t samples_per_run = 16 / sizeof(T);
+    for (; i + 2 * samples_per_run <= n_samples; i += 2 * samples_per_run) {
+        // the low lanes hold one run of 16 * C bytes, the high lanes the next
+        const uint8_t* run = src + i * C * sizeof(T);
+        __m256i v[C];
+        for (size_t b = 0; b < C; ++b) {
+            v[b] = _mm256_inserti128_si256(
+              _mm256_castsi128_si256(
+                _mm_loadu_si128((const __m128i*)(run + 16 * b))),
+              _mm_loadu_si128((const __m128i*)(run + 16 * (C + b))),
+              1);
+        }
+
+        for (size_t c = 0; c < C; ++c) {
+            auto out = _mm256_shuffle_epi8(v[0], m[c * C]);
+            for (size_t b = 1; b < C; ++b) {
+                out = _mm256_or_si256(out,
+                                      _mm256_shuffle_epi8(v[b], m[c * C + b]));
+            }
+            _mm256_storeu_si256((__m256i*)(dsts[c] + i * sizeof(T)), out);
+        }
+    }
+#endif
+
+    const auto* s = (const T*)src;
+    T* d[C];
+    for (size_t c = 0; c < C; ++c) {
+        d[c] = (T*)dsts[c];
+    }
+
+    for (; i < n_samples; ++i) {
+        for (size_t c = 0; c < C; ++c) {
+            d[c][i] = s[i * C + c];
+        }
+    }
+}
+
+using DeinterleaveFn = void (*)(uint8_t* const*, const uint8_t*, size_t);
+
+template<typename T>
+DeinterleaveFn
+deinterleave_fn(size_t n_channels)
+{
+    switch (n_channels) {
+        case 2:
+            return deinterleave_row<T, 2>;
+        case 3:
+            return deinterleave_row<T, 3>;
+        case 4:
+            return deinterleave_row<T, 4>;
+        default:
+            return nullptr;
+    }
+}
+
+/// Get a kernel to de-interleave rows of `n_channels` channels of
+/// `bytes_per_px`-byte samples, or nullptr if there is no specialized kernel
+/// and each channel should be gathered on its own.
+DeinterleaveFn
+deinterleave_fn(size_t bytes_per_px, size_t n_channels)
+{
+    switch (bytes_per_px) {
+        case 1:
+            return deinterleave_fn<uint8_t>(n_channels);
+        case 2:
+            return deinterleave_fn<uint16_t>(n_channels);
+        case 4:
+            return deinterleave_fn<uint32_t>(n_channels);
+        default:
+            return nullptr;
+    }
+}
+
+/// Get the number of Blosc internal threads to give each chunk in a flush.
+/// When a flush has at least as many chunks as there are threads available to
+/// it, we parallelize across chunks only. Otherwise, the spare threads are
+/// split evenly among the chunks, and Blosc compresses blocks within each chunk
+/// in parallel.
+int
+compression_threads_per_chunk(size_t n_chunks, size_t n_threads)
+{
+    if (n_chunks == 0 || n_chunks >= n_threads) {
+        return 1;
+    }
+
+    return (int)(n_threads / n_chunks);
+}
+
+/// Chunks no larger than this are compressed without probing, since the probe
+/// would cost nearly as much as compressing the whole chunk.
+constexpr size_t compression_probe_bytes = 1 << 16;
+
+/// Chunks whose probe compresses by less than this fraction of its size are
+/// stored uncompressed.
+constexpr double min_compression_savings = 0.05;
+
+/// Check whether a chunk is worth compressing by compressing a block from its
+/// middle. Noisy data, e.g., from an sCMOS camera at high gain, can cost the
+/// full compression time and save next to nothing.
+bool
+is_incompressible(const uint8_t* buf,
+                  size_t bytes_of_buf,
+                  const zarr::BloscCompressionParams& params,
+                  size_t typesize)
+{
+    if (bytes_of_buf <= compression_probe_bytes) {
+        return false;
+    }
+
+    // keep the probe aligned to samples so that shuffling sees whole samples
+    size_t offset = (bytes_of_buf - compression_probe_bytes) / 2;
+    offset -= offset % typesize;
+
+    std::vector<uint8_t> tmp(compression_probe_bytes + BLOSC_MAX_OVERHEAD);
+    const auto nb = blosc_compress_ctx(params.clevel,
+                                       params.shuffle,
+                                       typesize,
+                                       compression_probe_bytes,
+                                       buf + offset,
+                                       tmp.data(),
+                                       tmp.size(),
+                                       params.codec_id.c_str(),
+                                       0 /* blocksize - 0:automatic */,
+                                       1);
+
+    // on failure, leave it to the full compression to report the error
+    return nb > 0 && (double)nb > (1. - min_compression_savings) *
+                                    (double)compression_probe_bytes;
+}
 } // end ::{anonymous} namespace
 
 bool
@@ -158,8 +444,27 @@ zarr::downsample(const ArrayConfig& config, ArrayConfig& downsampled_config)
       std::to_string(std::stoi(downsampled_data_root.filename()) + 1));
     downsampled_config.data_root = downsampled_data_root.string();
 
-    // copy the Blosc compression parameters
+    // and so do the stripes standing in for it
+    downsampled_config.stripe_roots.clear();
+    for (const auto& root : config.stripe_roots) {
+        fs::path downsampled_root = root;
+        downsampled_root.replace_filename(downsampled_data_root.filename());
+        downsampled_config.stripe_roots.push_back(downsampled_root.string());
+    }
+    downsampled_config.migrator = config.migrator;
+    downsampled_config.rate_limiter = config.rate_limiter;
+    downsampled_config.durability = config.durability;
+
+    // copy the compression parameters and filters
     downsampled_config.compression_params = config.compression_params;
+    downsampled_config.filters = config.filters;
+    downsampled_config.zstd_dictionary_bytes = config.zstd_dictionary_bytes;
+    downsampled_config.chunk_statistics = config.chunk_statistics;
+    downsampled_config.deduplicate_chunks = config.deduplicate_chunks;
+    downsampled_config.chunk_order = config.chunk_order;
+    downsampled_config.max_flush_latency_ms = config.max_flush_latency_ms;
+    downsampled_config.memory_budget_bytes = config.memory_budget_bytes;
+    downsampled_config.spill_directory = config.spill_directory;
 
     // can we downsample downsampled_config?
     for (auto i = 0; i < config.dimensions.size(); ++i) {
@@ -179,35 +484,89 @@ zarr::downsample(const ArrayConfig& config, ArrayConfig& downsampled_config)
 zarr::Writer::Writer(const ArrayConfig& config,
                      std::shared_ptr<common::ThreadPool> thread_pool)
   : config_{ config }
+  , chunks_are_compressed_{ false }
+  , statistics_sink_{ nullptr }
+  , statistics_offset_{ 0 }
+  , last_write_{ std::chrono::steady_clock::now() }
   , thread_pool_{ thread_pool }
   , bytes_to_flush_{ 0 }
   , frames_written_{ 0 }
   , append_chunk_index_{ 0 }
   , is_finalizing_{ false }
+  , is_checkpointing_{ false }
+  , chunks_compressed_{ 0 }
+  , chunks_stored_raw_{ 0 }
 {
     data_root_ = config_.data_root;
+    file_creator_ = std::make_unique<FileCreator>(thread_pool_,
+                                                  data_root_,
+                                                  config_.stripe_roots,
+                                                  config_.rate_limiter);
+
+    const auto& filters = config_.filters;
+    for (auto i = 0; i < filters.size(); ++i) {
+        validate_filter(filters.at(i), config_.image_shape.type);
+        EXPECT(filters.at(i).id != FilterId::PackBits ||
+                 i == filters.size() - 1,
+               "PackBits must be the last filter.");
+        EXPECT(filters.at(i).id != FilterId::TemporalDelta || i == 0,
+               "TemporalDelta must be the first filter.");
+
+        // readers undo the temporal delta frame by frame
+        EXPECT(filters.at(i).id != FilterId::TemporalDelta ||
+                 config_.chunk_order == ChunkOrder::C,
+               "TemporalDelta requires C order chunks.");
+    }
+
+    if (config_.zstd_dictionary_bytes > 0) {
+        EXPECT(config_.compression_params.has_value() &&
+                 config_.compression_params->codec_id ==
+                   compression_codec_as_string<BloscCodecId::Zstd>(),
+               "A zstd dictionary requires zstd compression.");
+
+        // the dictionary would be trained on partially filled chunks
+        EXPECT(config_.max_flush_latency_ms == 0,
+               "A zstd dictionary cannot be used with a maximum flush "
+               "latency.");
+    }
 }
 
 bool
 zarr::Writer::write(const VideoFrame* frame)
 {
-    validate_frame_(frame);
-    if (chunk_buffers_.empty()) {
+    CHECK(frame);
+    return write(
+      frame->data, frame->bytes_of_frame - sizeof(*frame), frame->shape);
+}
+
+bool
+zarr::Writer::write(const uint8_t* data,
+                    size_t bytes_of_data,
+                    const ImageShape& shape)
+{
+    CHECK(data);
+    validate_frame_(shape);
+    if (chunk_slab_.empty()) {
         make_buffers_();
     }
 
-    // split the incoming frame into tiles and write them to the chunk buffers
-    const auto& dimensions = config_.dimensions;
-
-    const auto bytes_written = write_frame_to_chunks_(
-      frame->data, frame->bytes_of_frame - sizeof(*frame));
-    const auto bytes_of_frame = frame->bytes_of_frame - sizeof(*frame);
+    // split the incoming frame into tiles and write them to the chunk buffers,
+    // reading rows in place if the frame is padded
+    const auto bytes_written =
+      write_frame_to_chunks_(data, bytes_of_data, shape);
+    const auto n_channels = common::channels(shape);
+    const auto bytes_of_frame = n_channels * shape.dims.width *
+                                shape.dims.height * bytes_of_type(shape.type);
     CHECK(bytes_written == bytes_of_frame);
     bytes_to_flush_ += bytes_written;
-    ++frames_written_;
+
+    // each channel counts as its own frame along the channel dimension
+    frames_written_ += n_channels;
 
     if (should_flush_()) {
         flush_();
+    } else if (should_checkpoint_()) {
+        checkpoint_();
     }
 
     return true;
@@ -220,6 +579,20 @@ zarr::Writer::finalize()
     flush_();
     close_files_();
     is_finalizing_ = false;
+
+    if (statistics_sink_) {
+        sink_close<FileSink>(statistics_sink_);
+        statistics_sink_ = nullptr;
+        statistics_offset_ = 0;
+    }
+
+    if (chunks_compressed_ > 0) {
+        LOG("Stored %llu of %llu chunks in %s uncompressed (%.1f%%).",
+            (unsigned long long)chunks_stored_raw_,
+            (unsigned long long)chunks_compressed_,
+            data_root_.c_str(),
+            100. * (double)chunks_stored_raw_ / (double)chunks_compressed_);
+    }
 }
 
 const zarr::ArrayConfig&
@@ -235,44 +608,126 @@ zarr::Writer::frames_written() const noexcept
 }
 
 void
-zarr::Writer::make_buffers_() noexcept
+zarr::Writer::make_buffers_()
 {
     const size_t n_chunks =
       common::number_of_chunks_in_memory(config_.dimensions);
-    chunk_buffers_.resize(n_chunks); // no-op if already the correct size
 
     const auto bytes_per_chunk =
       common::bytes_per_chunk(config_.dimensions, config_.image_shape.type);
 
-    for (auto& buf : chunk_buffers_) {
-        buf.resize(bytes_per_chunk);
-        std::fill_n(buf.begin(), bytes_per_chunk, 0);
+    size_t bytes_per_compressed_chunk = 0;
+    if (config_.compression_params.has_value()) {
+        bytes_per_compressed_chunk = bytes_per_chunk + BLOSC_MAX_OVERHEAD;
+        if (config_.zstd_dictionary_bytes > 0) {
+            bytes_per_compressed_chunk =
+              std::max(bytes_per_compressed_chunk,
+                       ZstdDictionary::compress_bound(bytes_per_chunk));
+        }
+    }
+
+    if (chunk_slab_.empty() && config_.memory_budget_bytes > 0) {
+        // Raw and compressed chunks, plus a copy of the raw chunks for
+        // checkpoints, are all in memory at once. Spill only the bytes over
+        // budget, from the ends of the raw chunks and their copy alike, since
+        // the two trade places at each checkpoint. The compressed chunks stay
+        // in memory, since they are written out as soon as they're made.
+        const size_t n_raw_slabs = config_.max_flush_latency_ms > 0 ? 2 : 1;
+        const size_t bytes_of_chunks = n_chunks * bytes_per_chunk;
+        const size_t bytes_total = n_raw_slabs * bytes_of_chunks +
+                                   n_chunks * bytes_per_compressed_chunk;
+
+        if (bytes_total > config_.memory_budget_bytes) {
+            const auto spill_directory =
+              config_.spill_directory.empty()
+                ? fs::temp_directory_path().string()
+                : config_.spill_directory;
+
+            const size_t bytes_over = bytes_total - config_.memory_budget_bytes;
+            const size_t bytes_to_spill =
+              std::min((bytes_over + n_raw_slabs - 1) / n_raw_slabs,
+                       bytes_of_chunks);
+            chunk_slab_.back_with_file(spill_directory,
+                                       bytes_of_chunks - bytes_to_spill);
+            if (n_raw_slabs > 1) {
+                checkpoint_slab_.back_with_file(
+                  spill_directory, bytes_of_chunks - bytes_to_spill);
+            }
+            LOG("Spilling %llu bytes of %s to %s.",
+                (unsigned long long)(n_raw_slabs * bytes_to_spill),
+                data_root_.c_str(),
+                spill_directory.c_str());
+        }
+    }
+
+    // no-op after the first call, since the layout doesn't change
+    chunk_slab_.resize(n_chunks, bytes_per_chunk);
+    chunk_slab_.zero();
+
+    if (config_.compression_params.has_value()) {
+        compressed_slab_.resize(n_chunks, bytes_per_compressed_chunk);
+    }
+
+    chunk_sizes_.assign(n_chunks, bytes_per_chunk);
+    chunks_are_compressed_ = false;
+
+    if (!config_.filters.empty() &&
+        config_.filters.front().id == FilterId::TemporalDelta) {
+        previous_planes_.resize(n_chunks * bytes_per_chunk /
+                                config_.dimensions.back().chunk_size_px);
+    }
+
+    if (config_.chunk_statistics) {
+        chunk_statistics_.resize(n_chunks);
+        for (auto& stats : chunk_statistics_) {
+            stats.reset();
+        }
     }
 }
 
-void
-zarr::Writer::validate_frame_(const VideoFrame* frame)
+const uint8_t*
+zarr::Writer::chunk_data_(size_t chunk_index) const noexcept
 {
-    CHECK(frame);
+    return chunks_are_compressed_ ? compressed_slab_.slot(chunk_index)
+                                  : chunk_slab_.slot(chunk_index);
+}
 
-    EXPECT(frame->shape.dims.width == config_.image_shape.dims.width,
+void
+zarr::Writer::validate_frame_(const ImageShape& shape)
+{
+    EXPECT(shape.dims.width == config_.image_shape.dims.width,
            "Expected frame to have %d columns. Got %d.",
            config_.image_shape.dims.width,
-           frame->shape.dims.width);
+           shape.dims.width);
 
-    EXPECT(frame->shape.dims.height == config_.image_shape.dims.height,
+    EXPECT(shape.dims.height == config_.image_shape.dims.height,
            "Expected frame to have %d rows. Got %d.",
            config_.image_shape.dims.height,
-           frame->shape.dims.height);
+           shape.dims.height);
 
-    EXPECT(frame->shape.type == config_.image_shape.type,
+    EXPECT(shape.type == config_.image_shape.type,
            "Expected frame to have pixel type %s. Got %s.",
            common::sample_type_to_string(config_.image_shape.type),
-           common::sample_type_to_string(frame->shape.type));
+           common::sample_type_to_string(shape.type));
+
+    // interleaved channels are scattered along the third dimension, so each
+    // frame must fill it exactly
+    const auto n_channels = common::channels(shape);
+    if (n_channels > 1) {
+        const auto& dims = config_.dimensions;
+        EXPECT(dims.size() > 3 && dims.at(2).kind == DimensionType_Channel &&
+                 dims.at(2).array_size_px == n_channels,
+               "Expected a channel dimension of size %zu after the spatial "
+               "dimensions for a frame with %zu channels.",
+               n_channels,
+               n_channels);
+    }
 }
 
 size_t
-zarr::Writer::write_frame_to_chunks_(const uint8_t* buf, size_t buf_size)
+zarr::Writer::write_frame_to_chunks_(const uint8_t* buf,
+                                     size_t buf_size,
+                                     const ImageShape& frame_shape)
 {
     // break the frame into tiles and write them to the chunk buffers
     const auto image_shape = config_.image_shape;
@@ -281,6 +736,37 @@ zarr::Writer::write_frame_to_chunks_(const uint8_t* buf, size_t buf_size)
     const auto frame_cols = image_shape.dims.width;
     const auto frame_rows = image_shape.dims.height;
 
+    // strides of the incoming frame, in samples
+    const auto n_channels = common::channels(frame_shape);
+    const auto channel_stride = common::channel_stride(frame_shape);
+    const auto sample_stride = common::sample_stride(frame_shape);
+    const auto row_stride = common::row_stride(frame_shape);
+    EXPECT(common::bytes_of_strided_frame(frame_shape) <= buf_size,
+           "Expected a frame buffer of at least %zu bytes. Got %zu.",
+           common::bytes_of_strided_frame(frame_shape),
+           buf_size);
+
+    void (*gather)(uint8_t*, const uint8_t*, size_t, size_t) = nullptr;
+    switch (bytes_per_px) {
+        case 1:
+            gather = gather_row<uint8_t>;
+            break;
+        case 2:
+            gather = gather_row<uint16_t>;
+            break;
+        case 4:
+            gather = gather_row<uint32_t>;
+            break;
+        default:
+            throw std::runtime_error("Unsupported sample size.");
+    }
+
+    // pixel-interleaved channels are split in a single pass over each row
+    const auto deinterleave =
+      channel_stride == 1 && sample_stride == n_channels
+        ? deinterleave_fn(bytes_per_px, n_channels)
+        : nullptr;
+
     const auto& dimensions = config_.dimensions;
     const auto tile_cols = dimensions.at(0).chunk_size_px;
     const auto tile_rows = dimensions.at(1).chunk_size_px;
@@ -294,21 +780,49 @@ zarr::Writer::write_frame_to_chunks_(const uint8_t* buf, size_t buf_size)
     const auto n_tiles_y = (frame_rows + tile_rows - 1) / tile_rows;
 
     // don't take the frame id from the incoming frame, as the camera may have
-    // dropped frames
-    const auto frame_id = frames_written_;
-
-    // offset among the chunks in the lattice
-    const auto group_offset = tile_group_offset(frame_id, dimensions);
-    // offset within the chunk
-    const auto chunk_offset =
-      chunk_internal_offset(frame_id, dimensions, image_shape.type);
+    // dropped frames; each channel is its own frame along the channel
+    // dimension
+    std::vector<size_t> group_offsets(n_channels), chunk_offsets(n_channels);
+    for (auto c = 0; c < n_channels; ++c) {
+        const auto frame_id = frames_written_ + c;
+
+        // offset among the chunks in the lattice
+        group_offsets.at(c) = tile_group_offset(frame_id, dimensions);
+        // offset within the chunk
+        chunk_offsets.at(c) =
+          chunk_internal_offset(frame_id, dimensions, image_shape.type);
+    }
 
+    // with temporal delta, each frame but the first in a chunk along the
+    // append dimension is stored as its difference from the frame before it,
+    // which is kept in previous_planes_
+    const bool temporal_delta =
+      !config_.filters.empty() &&
+      config_.filters.front().id == FilterId::TemporalDelta;
+    const bool first_plane =
+      append_chunk_internal_index(frames_written_, dimensions) == 0;
+    const auto bytes_per_chunk =
+      common::bytes_per_chunk(dimensions, image_shape.type);
+    const auto bytes_of_plane =
+      bytes_per_chunk / dimensions.back().chunk_size_px;
+    const auto delta = bytes_per_px == 1 ? delta_row<uint8_t>
+                                         : delta_row<uint16_t>;
+
+    std::vector<size_t> chunk_idxs(n_channels);
+    std::vector<uint8_t*> chunk_its(n_channels), chunk_ends(n_channels);
+    std::vector<uint8_t*> chunk_starts(n_channels);
     for (auto i = 0; i < n_tiles_y; ++i) {
         // TODO (aliddell): we can optimize this when tiles_per_frame_x_ is 1
         for (auto j = 0; j < n_tiles_x; ++j) {
-            const auto c = group_offset + i * n_tiles_x + j;
-            auto& chunk = chunk_buffers_.at(c);
-            auto chunk_it = chunk.begin() + chunk_offset;
+            for (auto c = 0; c < n_channels; ++c) {
+                const auto idx = group_offsets.at(c) + i * n_tiles_x + j;
+                CHECK(idx < chunk_slab_.n_slots());
+                chunk_idxs.at(c) = idx;
+                uint8_t* chunk_start = chunk_slab_.slot(idx);
+                chunk_starts.at(c) = chunk_start;
+                chunk_ends.at(c) = chunk_start + bytes_per_chunk;
+                chunk_its.at(c) = chunk_start + chunk_offsets.at(c);
+            }
 
             for (auto k = 0; k < tile_rows; ++k) {
                 const auto frame_row = i * tile_rows + k;
@@ -319,18 +833,77 @@ zarr::Writer::write_frame_to_chunks_(const uint8_t* buf, size_t buf_size)
                       std::min(frame_col + tile_cols, frame_cols) - frame_col;
 
                     const auto region_start =
-                      bytes_per_px * (frame_row * frame_cols + frame_col);
+                      bytes_per_px *
+                      (frame_row * row_stride + frame_col * sample_stride);
                     const auto nbytes = region_width * bytes_per_px;
-                    const auto region_stop = region_start + nbytes;
+                    const auto region_stop =
+                      region_start +
+                      bytes_per_px * ((region_width - 1) * sample_stride +
+                                      (n_channels - 1) * channel_stride + 1);
                     EXPECT(region_stop <= buf_size, "Buffer overflow");
 
+                    for (auto c = 0; c < n_channels; ++c) {
+                        EXPECT(chunk_its.at(c) + nbytes <= chunk_ends.at(c),
+                               "Buffer overflow");
+                    }
+
                     // copy region
-                    EXPECT(chunk_it + nbytes <= chunk.end(), "Buffer overflow");
-                    std::copy(buf + region_start, buf + region_stop, chunk_it);
+                    if (deinterleave) {
+                        deinterleave(
+                          chunk_its.data(), buf + region_start, region_width);
+                    } else {
+                        for (auto c = 0; c < n_channels; ++c) {
+                            const uint8_t* src =
+                              buf + region_start +
+                              bytes_per_px * c * channel_stride;
+                            if (sample_stride == 1) {
+                                std::copy(src, src + nbytes, chunk_its.at(c));
+                            } else {
+                                gather(chunk_its.at(c),
+                                       src,
+                                       region_width,
+                                       sample_stride);
+                            }
+                        }
+                    }
+
+                    // statistics see the frame as written, before any
+                    // temporal delta is taken against it
+                    if (!chunk_statistics_.empty()) {
+                        for (auto c = 0; c < n_channels; ++c) {
+                            chunk_statistics_.at(chunk_idxs.at(c))
+                              .update(chunk_its.at(c),
+                                      region_width,
+                                      image_shape.type);
+                        }
+                    }
+
+                    if (temporal_delta) {
+                        for (auto c = 0; c < n_channels; ++c) {
+                            // the same row of the chunk's previous plane
+                            const size_t offset =
+                              chunk_idxs.at(c) * bytes_of_plane +
+                              (chunk_its.at(c) - chunk_starts.at(c)) %
+                                bytes_of_plane;
+                            CHECK(offset + nbytes <= previous_planes_.size());
+                            uint8_t* previous =
+                              previous_planes_.data() + offset;
+                            if (first_plane) {
+                                std::copy(chunk_its.at(c),
+                                          chunk_its.at(c) + nbytes,
+                                          previous);
+                            } else {
+                                delta(chunk_its.at(c), previous, nbytes);
+                            }
+                        }
+                    }
+
+                    bytes_written += n_channels * nbytes;
+                }
 
-                    bytes_written += (region_stop - region_start);
+                for (auto& chunk_it : chunk_its) {
+                    chunk_it += bytes_per_row;
                 }
-                chunk_it += bytes_per_row;
             }
         }
     }
@@ -340,6 +913,12 @@ zarr::Writer::write_frame_to_chunks_(const uint8_t* buf, size_t buf_size)
 
 bool
 zarr::Writer::should_flush_() const
+{
+    return frames_written_ % frames_before_flush_() == 0;
+}
+
+size_t
+zarr::Writer::frames_before_flush_() const
 {
     const auto& dims = config_.dimensions;
     size_t frames_before_flush = dims.back().chunk_size_px;
@@ -348,7 +927,115 @@ zarr::Writer::should_flush_() const
     }
 
     CHECK(frames_before_flush > 0);
-    return frames_written_ % frames_before_flush == 0;
+    return frames_before_flush;
+}
+
+void
+zarr::Writer::reorder_buffers_() noexcept
+{
+    if (config_.chunk_order == ChunkOrder::C) {
+        return;
+    }
+
+    TRACE("Reordering");
+
+    std::vector<size_t> chunk_shape;
+    for (auto dim = config_.dimensions.rbegin();
+         dim != config_.dimensions.rend();
+         ++dim) {
+        chunk_shape.push_back(dim->chunk_size_px);
+    }
+    const auto bytes_per_px = bytes_of_type(config_.image_shape.type);
+
+    std::scoped_lock lock(buffers_mutex_);
+    std::latch latch(chunk_sizes_.size());
+    for (auto i = 0; i < chunk_sizes_.size(); ++i) {
+        thread_pool_->push_to_job_queue(
+          [&chunk_shape,
+           bytes_per_px,
+           buf = chunk_slab_.slot(i),
+           &latch](std::string& err) -> bool {
+              bool success = false;
+
+              try {
+                  // each thread keeps its scratch buffer across flushes
+                  thread_local std::vector<uint8_t> scratch;
+                  chunk_to_f_order(buf, scratch, chunk_shape, bytes_per_px);
+                  success = true;
+              } catch (const std::exception& exc) {
+                  char msg[128];
+                  snprintf(msg,
+                           sizeof(msg),
+                           "Failed to reorder chunk: %s",
+                           exc.what());
+                  err = msg;
+              } catch (...) {
+                  err = "Failed to reorder chunk (unknown)";
+              }
+              latch.count_down();
+
+              return success;
+          });
+    }
+
+    // wait for all threads to finish
+    latch.wait();
+}
+
+void
+zarr::Writer::filter_buffers_() noexcept
+{
+    // nothing to do if there are no filters left to apply after tiling
+    if (std::all_of(config_.filters.begin(),
+                    config_.filters.end(),
+                    [](const FilterParams& filter) {
+                        return filter.id == FilterId::TemporalDelta;
+                    })) {
+        return;
+    }
+
+    TRACE("Filtering");
+
+    const auto& filters = config_.filters;
+    const auto type = config_.image_shape.type;
+
+    std::scoped_lock lock(buffers_mutex_);
+    std::latch latch(chunk_sizes_.size());
+    for (auto i = 0; i < chunk_sizes_.size(); ++i) {
+        thread_pool_->push_to_job_queue(
+          [&filters,
+           type,
+           buf = chunk_slab_.slot(i),
+           bytes_of_chunk = &chunk_sizes_.at(i),
+           &latch](std::string& err) -> bool {
+              bool success = false;
+
+              try {
+                  for (const auto& filter : filters) {
+                      if (filter.id == FilterId::TemporalDelta) {
+                          continue; // already applied while tiling
+                      }
+                      *bytes_of_chunk =
+                        apply_filter(filter, type, buf, *bytes_of_chunk);
+                  }
+
+                  success = true;
+              } catch (const std::exception& exc) {
+                  char msg[128];
+                  snprintf(
+                    msg, sizeof(msg), "Failed to filter chunk: %s", exc.what());
+                  err = msg;
+              } catch (...) {
+                  err = "Failed to filter chunk (unknown)";
+              }
+              latch.count_down();
+
+              return success;
+          });
+    }
+
+    // wait for all threads to finish
+    latch.wait();
 }
 
 void
@@ -361,37 +1048,60 @@ zarr::Writer::compress_buffers_() noexcept
     TRACE("Compressing");
 
     BloscCompressionParams params = config_.compression_params.value();
-    const auto bytes_per_px = bytes_of_type(config_.image_shape.type);
+
+    // packed samples no longer align to bytes_of_type, so shuffle bytes
+    const bool is_packed = !config_.filters.empty() &&
+                           config_.filters.back().id == FilterId::PackBits;
+    const auto bytes_per_px =
+      is_packed ? 1 : bytes_of_type(config_.image_shape.type);
 
     std::scoped_lock lock(buffers_mutex_);
-    std::latch latch(chunk_buffers_.size());
-    for (auto i = 0; i < chunk_buffers_.size(); ++i) {
-        auto& chunk = chunk_buffers_.at(i);
 
-        thread_pool_->push_to_job_queue([&params,
-                                         buf = &chunk,
+    // with few chunks to a flush, let Blosc split each chunk among the pool
+    // threads no other job or writer is using, so that writers flushing at
+    // the same time don't oversubscribe the CPU
+    const size_t n_chunks = chunk_sizes_.size();
+    const size_t n_spare_threads = thread_pool_->borrow_idle_threads(n_chunks);
+    const int n_internal_threads =
+      compression_threads_per_chunk(n_chunks, n_chunks + n_spare_threads);
+
+    std::latch latch(chunk_sizes_.size());
+    for (auto i = 0; i < chunk_sizes_.size(); ++i) {
+        thread_pool_->push_to_job_queue([this,
+                                         &params,
+                                         src = chunk_slab_.slot(i),
+                                         dst = compressed_slab_.slot(i),
+                                         bytes_of_dst =
+                                           compressed_slab_.stride(),
+                                         bytes_of_chunk = &chunk_sizes_.at(i),
                                          bytes_per_px,
+                                         n_internal_threads,
                                          &latch](std::string& err) -> bool {
             bool success = false;
-            const size_t bytes_of_chunk = buf->size();
 
             try {
-                const auto tmp_size = bytes_of_chunk + BLOSC_MAX_OVERHEAD;
-                std::vector<uint8_t> tmp(tmp_size);
+                // clevel 0 has Blosc store the chunk as-is, with its header,
+                // so readers decode it like any other chunk
+                const bool store_raw = is_incompressible(
+                  src, *bytes_of_chunk, params, bytes_per_px);
+                if (store_raw) {
+                    ++chunks_stored_raw_;
+                }
+                ++chunks_compressed_;
+
                 const auto nb =
-                  blosc_compress_ctx(params.clevel,
+                  blosc_compress_ctx(store_raw ? 0 : params.clevel,
                                      params.shuffle,
                                      bytes_per_px,
-                                     bytes_of_chunk,
-                                     buf->data(),
-                                     tmp.data(),
-                                     tmp_size,
+                                     *bytes_of_chunk,
+                                     src,
+                                     dst,
+                                     bytes_of_dst,
                                      params.codec_id.c_str(),
                                      0 /* blocksize - 0:automatic */,
-                                     1);
-
-                tmp.resize(nb);
-                buf->swap(tmp);
+                                     n_internal_threads);
+                EXPECT(nb > 0, "Blosc returned %d.", nb);
+                *bytes_of_chunk = nb;
 
                 success = true;
             } catch (const std::exception& exc) {
@@ -410,6 +1120,87 @@ zarr::Writer::compress_buffers_() noexcept
 
     // wait for all threads to finish
     latch.wait();
+    thread_pool_->return_threads(n_spare_threads);
+
+    chunks_are_compressed_ = true;
+}
+
+void
+zarr::Writer::train_zstd_dictionary_()
+{
+    TRACE("Training zstd dictionary");
+
+    std::vector<uint8_t> dictionary;
+    {
+        std::scoped_lock lock(buffers_mutex_);
+        std::vector<std::span<const uint8_t>> samples;
+        for (auto i = 0; i < chunk_sizes_.size(); ++i) {
+            samples.emplace_back(chunk_slab_.slot(i), chunk_sizes_.at(i));
+        }
+        dictionary =
+          train_zstd_dictionary(samples, config_.zstd_dictionary_bytes);
+    }
+
+    // fall back to Blosc for the whole array, so that every chunk is
+    // compressed the same way
+    if (dictionary.empty()) {
+        LOGE("Could not train a zstd dictionary for %s. Falling back to Blosc.",
+             data_root_.c_str());
+        config_.zstd_dictionary_bytes = 0;
+        return;
+    }
+
+    const auto dictionary_path =
+      fs::path(data_root_) / ZstdDictionary::filename;
+    common::write_string(dictionary_path.string(),
+                         std::string(dictionary.begin(), dictionary.end()));
+
+    zstd_dictionary_ = std::make_shared<ZstdDictionary>(
+      std::move(dictionary), config_.compression_params->clevel);
+}
+
+void
+zarr::Writer::compress_buffers_with_zstd_dictionary_() noexcept
+{
+    TRACE("Compressing with zstd dictionary");
+
+    std::scoped_lock lock(buffers_mutex_);
+    std::latch latch(chunk_sizes_.size());
+    for (auto i = 0; i < chunk_sizes_.size(); ++i) {
+        thread_pool_->push_to_job_queue(
+          [dictionary = zstd_dictionary_.get(),
+           src = chunk_slab_.slot(i),
+           dst = compressed_slab_.slot(i),
+           bytes_of_dst = compressed_slab_.stride(),
+           bytes_of_chunk = &chunk_sizes_.at(i),
+           &latch](std::string& err) -> bool {
+              bool success = false;
+
+              try {
+                  *bytes_of_chunk = dictionary->compress(
+                    src, *bytes_of_chunk, dst, bytes_of_dst);
+
+                  success = true;
+              } catch (const std::exception& exc) {
+                  char msg[128];
+                  snprintf(msg,
+                           sizeof(msg),
+                           "Failed to compress chunk: %s",
+                           exc.what());
+                  err = msg;
+              } catch (...) {
+                  err = "Failed to compress chunk (unknown)";
+              }
+              latch.count_down();
+
+              return success;
+          });
+    }
+
+    // wait for all threads to finish
+    latch.wait();
+
+    chunks_are_compressed_ = true;
 }
 
 void
@@ -419,9 +1210,29 @@ zarr::Writer::flush_()
         return;
     }
 
-    // compress buffers and write out
-    compress_buffers_();
+    // reorder, filter, and compress buffers and write out
+    reorder_buffers_();
+    filter_buffers_();
+    if (config_.zstd_dictionary_bytes > 0 && !zstd_dictionary_) {
+        train_zstd_dictionary_();
+    }
+    if (zstd_dictionary_) {
+        compress_buffers_with_zstd_dictionary_();
+    } else {
+        compress_buffers_();
+    }
+
+    // once compressed, the raw chunks aren't read again before they're reset
+    if (chunks_are_compressed_) {
+        chunk_slab_.advise_cold();
+    }
+
     CHECK(flush_impl_());
+    write_back_files_();
+
+    if (!chunk_statistics_.empty()) {
+        write_chunk_statistics_();
+    }
 
     if (should_rollover_()) {
         rollover_();
@@ -432,14 +1243,158 @@ zarr::Writer::flush_()
 
     // reset state
     bytes_to_flush_ = 0;
+    last_write_ = std::chrono::steady_clock::now();
+}
+
+bool
+zarr::Writer::should_checkpoint_() const
+{
+    if (config_.max_flush_latency_ms == 0 || bytes_to_flush_ == 0) {
+        return false;
+    }
+
+    const auto latency = std::chrono::steady_clock::now() - last_write_;
+    return latency >= std::chrono::milliseconds(config_.max_flush_latency_ms);
+}
+
+void
+zarr::Writer::checkpoint_()
+{
+    TRACE("Checkpointing");
+
+    // keep the unfiltered chunks to go on filling after this write
+    checkpoint_slab_.copy_from(chunk_slab_);
+    // and write what's spilled of them out while this write goes on
+    checkpoint_slab_.advise_page_out();
+
+    reorder_buffers_();
+    filter_buffers_();
+    compress_buffers_();
+    is_checkpointing_ = true;
+    const bool flushed = flush_impl_();
+    is_checkpointing_ = false;
+    CHECK(flushed);
+    write_back_files_();
+
+    chunk_slab_.swap(checkpoint_slab_);
+    chunk_sizes_.assign(
+      chunk_sizes_.size(),
+      common::bytes_per_chunk(config_.dimensions, config_.image_shape.type));
+    chunks_are_compressed_ = false;
+
+    last_write_ = std::chrono::steady_clock::now();
+}
+
+void
+zarr::Writer::write_chunk_statistics_()
+{
+    const auto& dims = config_.dimensions;
+    const auto type = config_.image_shape.type;
+
+    if (!statistics_sink_) {
+        const auto path = fs::path(data_root_) / ChunkStatistics::filename;
+        fs::create_directories(path.parent_path());
+        statistics_sink_ = sink_open<FileSink>(path.string());
+        statistics_offset_ = 0;
+
+        const auto header =
+          chunk_statistics_header_to_json(type).dump() + "\n";
+        CHECK(statistics_sink_->write(
+          statistics_offset_, (const uint8_t*)header.c_str(), header.size()));
+        statistics_offset_ += header.size();
+    }
+
+    // the chunks in memory all share one index along the append dimension
+    CHECK(frames_written_ > 0);
+    const size_t append_idx = (frames_written_ - 1) / frames_before_flush_();
+
+    std::string lines;
+    for (auto i = 0; i < chunk_statistics_.size(); ++i) {
+        const auto& stats = chunk_statistics_.at(i);
+        if (stats.count() == 0) {
+            continue;
+        }
+
+        // chunk keys run from the slowest dimension to the fastest
+        std::vector<size_t> key(dims.size());
+        key.front() = append_idx;
+        size_t idx = i;
+        for (auto d = 0; d < dims.size() - 1; ++d) {
+            const auto n_chunks = common::chunks_along_dimension(dims.at(d));
+            key.at(dims.size() - 1 - d) = idx % n_chunks;
+            idx /= n_chunks;
+        }
+
+        lines += chunk_statistics_to_json(stats, key, type).dump() + "\n";
+    }
+
+    CHECK(statistics_sink_->write(
+      statistics_offset_, (const uint8_t*)lines.c_str(), lines.size()));
+    statistics_offset_ += lines.size();
+}
+
+void
+zarr::Writer::write_back_files_()
+{
+    switch (config_.durability) {
+        case Durability::None:
+            break;
+        case Durability::PerRollover:
+            // spread writeback out over the acquisition, rather than leaving
+            // the OS to write a storm of dirty pages at once
+            for (Sink* sink_ : sinks_) {
+                if (auto* sink = dynamic_cast<FileSink*>(sink_)) {
+                    CHECK(sink->start_writeback());
+                }
+            }
+            break;
+        case Durability::PerFlush:
+            sync_files_();
+            break;
+    }
+}
+
+void
+zarr::Writer::sync_files_()
+{
+    // wait on every file at once
+    std::atomic<bool> all_successful = true;
+    std::latch latch(sinks_.size());
+    for (Sink* sink_ : sinks_) {
+        thread_pool_->push_to_job_queue(
+          [sink = dynamic_cast<FileSink*>(sink_), &latch, &all_successful](
+            std::string& err) -> bool {
+              const bool success = !sink || sink->sync();
+              if (!success) {
+                  err = "Failed to sync " + sink->path_.string();
+              }
+              all_successful = all_successful && success;
+              latch.count_down();
+              return success;
+          });
+    }
+    latch.wait();
+
+    CHECK(all_successful);
 }
 
 void
 zarr::Writer::close_files_()
 {
+    // flushes only started writeback, so finish it
+    if (config_.durability == Durability::PerRollover) {
+        sync_files_();
+    }
+
     for (Sink* sink_ : sinks_) {
         if (auto* sink = dynamic_cast<FileSink*>(sink_)) {
+            const auto path = sink->path_.string();
             sink_close<FileSink>(sink_);
+
+            // closed files are never written again
+            if (config_.migrator) {
+                config_.migrator->enqueue(path);
+            }
         }
     }
     sinks_.clear();
@@ -752,6 +1707,76 @@ extern "C"
         return retval;
     }
 
+    acquire_export int unit_test__compression_threads_per_chunk()
+    {
+        int retval = 0;
+        try {
+            // at least as many chunks as threads: parallelize across chunks
+            CHECK(compression_threads_per_chunk(64, 64) == 1);
+            CHECK(compression_threads_per_chunk(128, 64) == 1);
+            CHECK(compression_threads_per_chunk(1, 1) == 1);
+
+            // fewer chunks than threads: parallelize within chunks
+            CHECK(compression_threads_per_chunk(1, 64) == 64);
+            CHECK(compression_threads_per_chunk(4, 64) == 16);
+            CHECK(compression_threads_per_chunk(3, 64) == 21);
+            CHECK(compression_threads_per_chunk(63, 64) == 1);
+
+            // degenerate
+            CHECK(compression_threads_per_chunk(0, 64) == 1);
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__is_incompressible()
+    {
+        int retval = 0;
+        try {
+            const zarr::BloscCompressionParams params("zstd", 1, 1);
+
+            // smooth data compresses well
+            std::vector<uint16_t> smooth(1 << 16);
+            for (auto i = 0; i < smooth.size(); ++i) {
+                smooth.at(i) = (uint16_t)(i / 64);
+            }
+            CHECK(!is_incompressible((const uint8_t*)smooth.data(),
+                                     smooth.size() * sizeof(uint16_t),
+                                     params,
+                                     sizeof(uint16_t)));
+
+            // noise over the full range of the type doesn't
+            std::vector<uint16_t> noise(1 << 16);
+            uint32_t seed = 1;
+            for (auto& px : noise) {
+                seed = seed * 1664525u + 1013904223u;
+                px = (uint16_t)(seed >> 16);
+            }
+            CHECK(is_incompressible((const uint8_t*)noise.data(),
+                                    noise.size() * sizeof(uint16_t),
+                                    params,
+                                    sizeof(uint16_t)));
+
+            // chunks no larger than the probe are always compressed
+            CHECK(!is_incompressible((const uint8_t*)noise.data(),
+                                     compression_probe_bytes,
+                                     params,
+                                     sizeof(uint16_t)));
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+
     acquire_export int unit_test__writer__write_frame_to_chunks()
     {
         const auto base_dir = fs::temp_directory_path() / "acquire";
@@ -855,6 +1880,9 @@ extern "C"
                                            5,
                                            1); // 5 timepoints / chunk, 1 shard
 
+            config.stripe_roots.push_back(
+              (fs::path("stripe") / "data" / "root" / "0").string());
+
             zarr::ArrayConfig downsampled_config;
             CHECK(zarr::downsample(config, downsampled_config));
 
@@ -900,6 +1928,9 @@ extern "C"
             // check data root
             CHECK(downsampled_config.data_root ==
                   (base_dir / "data" / "root" / "1").string());
+            CHECK(downsampled_config.stripe_roots.size() == 1);
+            CHECK(downsampled_config.stripe_roots.at(0) ==
+                  (fs::path("stripe") / "data" / "root" / "1").string());
 
             // check compression params
             CHECK(!downsampled_config.compression_params.has_value());
@@ -6,10 +6,19 @@
 
 #include "../common.hh"
 #include "blosc.compressor.hh"
+#include "chunk.filters.hh"
+#include "chunk.slab.hh"
+#include "chunk.statistics.hh"
+#include "chunk.transpose.hh"
+#include "file.migrator.hh"
 #include "file.sink.hh"
+#include "zstd.dictionary.hh"
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <filesystem>
+#include <memory>
 
 namespace fs = std::filesystem;
 
@@ -22,6 +31,55 @@ struct ArrayConfig
     std::vector<Dimension> dimensions;
     std::string data_root;
     std::optional<BloscCompressionParams> compression_params;
+    std::vector<FilterParams> filters;
+
+    /// If nonzero, compress chunks with a zstd dictionary of at most this many
+    /// bytes, trained on the chunks of the first flush, in place of Blosc.
+    /// Requires zstd compression parameters.
+    size_t zstd_dictionary_bytes = 0;
+
+    /// If true, compute min, max, mean, and a histogram of each chunk while
+    /// tiling, and append them to a statistics file alongside the chunks.
+    bool chunk_statistics = false;
+
+    /// If true, write chunks whose compressed bytes repeat within a shard only
+    /// once, and point every repeat's shard index entry at the same bytes.
+    /// Only Zarr V3 honors this.
+    bool deduplicate_chunks = false;
+
+    /// The order of samples within each chunk. Chunks are tiled row-major and
+    /// transposed before filtering if column-major order is requested.
+    ChunkOrder chunk_order = ChunkOrder::C;
+
+    /// If nonzero, write partially filled chunks when a frame arrives more
+    /// than this many milliseconds after the last write, and write them again
+    /// as they fill. Bounds how long frames wait in memory while frames keep
+    /// arriving; frames before a pause wait for the next frame or finalize.
+    /// Requires a zstd dictionary not be used.
+    uint32_t max_flush_latency_ms = 0;
+
+    /// If nonzero, and the chunks held in memory between flushes would take
+    /// more than this many bytes, back the excess of the uncompressed chunks
+    /// with scratch files in `spill_directory` (the system temporary
+    /// directory if empty), which the OS pages in and out as memory allows.
+    size_t memory_budget_bytes = 0;
+    std::string spill_directory;
+
+    /// If nonempty, directories to stripe chunk or shard files across, each
+    /// standing in for `data_root`. Each file is linked into `data_root`.
+    std::vector<std::string> stripe_roots;
+
+    /// If set, chunk or shard files are queued for migration to bulk storage
+    /// as they are closed.
+    std::shared_ptr<FileMigrator> migrator;
+
+    /// If set, limits the bandwidth and write rate of chunk or shard files,
+    /// shared by every array of the device.
+    std::shared_ptr<RateLimiter> rate_limiter;
+
+    /// When chunk or shard files are forced out to storage, bounding how
+    /// much is lost if the machine goes down.
+    Durability durability = Durability::None;
 };
 
 /// @brief Downsample the writer configuration to a lower resolution.
@@ -44,6 +102,15 @@ struct Writer
     virtual ~Writer() noexcept = default;
 
     [[nodiscard]] bool write(const VideoFrame* frame);
+
+    /// @brief Write a frame given as a view into a buffer, e.g., a region of
+    /// a larger frame.
+    /// @param data The first sample of the frame.
+    /// @param bytes_of_data The number of bytes readable from @p data.
+    /// @param shape The shape of the frame, with strides into @p data.
+    [[nodiscard]] bool write(const uint8_t* data,
+                             size_t bytes_of_data,
+                             const ImageShape& shape);
     void finalize();
 
     const ArrayConfig& config() const noexcept;
@@ -54,11 +121,35 @@ struct Writer
     ArrayConfig config_;
 
     /// Chunking
-    std::vector<std::vector<uint8_t>> chunk_buffers_;
+    ChunkSlab chunk_slab_;
+    ChunkSlab compressed_slab_;
+    // the number of bytes of each chunk to write out, filtered or compressed
+    std::vector<size_t> chunk_sizes_;
+    bool chunks_are_compressed_;
+
+    /// Statistics, one per chunk in memory if enabled
+    std::vector<ChunkStatistics> chunk_statistics_;
+    Sink* statistics_sink_;
+    size_t statistics_offset_;
+
+    /// Temporal delta
+    // the last plane written to each chunk, as it was before its difference
+    // from the plane before it was taken
+    std::vector<uint8_t> previous_planes_;
+
+    /// Compression
+    std::shared_ptr<ZstdDictionary> zstd_dictionary_;
+
+    /// Checkpointing partially filled chunks
+    // a copy of the unfiltered chunks, which filtering overwrites
+    ChunkSlab checkpoint_slab_;
+    std::chrono::steady_clock::time_point last_write_;
 
     /// Filesystem
     std::string data_root_;
     std::vector<Sink*> sinks_;
+    // kept across flushes, to keep the data root open
+    std::unique_ptr<FileCreator> file_creator_;
 
     /// Multithreading
     std::shared_ptr<common::ThreadPool> thread_pool_;
@@ -69,15 +160,34 @@ struct Writer
     uint32_t frames_written_;
     uint32_t append_chunk_index_;
     bool is_finalizing_;
-
-    void make_buffers_() noexcept;
-    void validate_frame_(const VideoFrame* frame);
-    size_t write_frame_to_chunks_(const uint8_t* buf, size_t buf_size);
+    // set while writing partially filled chunks, which will be written again
+    bool is_checkpointing_;
+
+    /// Instrumentation
+    std::atomic<uint64_t> chunks_compressed_;
+    std::atomic<uint64_t> chunks_stored_raw_;
+
+    void make_buffers_();
+    const uint8_t* chunk_data_(size_t chunk_index) const noexcept;
+    void validate_frame_(const ImageShape& shape);
+    size_t write_frame_to_chunks_(const uint8_t* buf,
+                                  size_t buf_size,
+                                  const ImageShape& frame_shape);
     bool should_flush_() const;
+    size_t frames_before_flush_() const;
+    void reorder_buffers_() noexcept;
+    void filter_buffers_() noexcept;
     void compress_buffers_() noexcept;
+    void train_zstd_dictionary_();
+    void compress_buffers_with_zstd_dictionary_() noexcept;
+    void write_chunk_statistics_();
+    bool should_checkpoint_() const;
+    void checkpoint_();
     void flush_();
     [[nodiscard]] virtual bool flush_impl_() = 0;
     virtual bool should_rollover_() const = 0;
+    void write_back_files_();
+    void sync_files_();
     void close_files_();
     void rollover_();
 };
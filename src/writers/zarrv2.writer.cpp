@@ -2,6 +2,7 @@
 #include "../zarr.hh"
 
 #include <cmath>
+#include <fstream>
 #include <latch>
 #include <stdexcept>
 
@@ -17,34 +18,39 @@ zarr::ZarrV2Writer::ZarrV2Writer(
 bool
 zarr::ZarrV2Writer::flush_impl_()
 {
-    // create chunk files
-    CHECK(sinks_.empty());
+    // create chunk files, unless a checkpoint already has
+    const bool is_rewrite = !sinks_.empty();
     const std::string data_root =
       (fs::path(data_root_) / std::to_string(append_chunk_index_)).string();
 
-    {
-        FileCreator file_creator(thread_pool_);
-        if (!file_creator.create_chunk_sinks(
-              data_root, config_.dimensions, sinks_)) {
-            return false;
-        }
+    // each chunk's size is known exactly, compressed or not
+    if (!is_rewrite &&
+        !file_creator_->create_chunk_sinks(
+          data_root, config_.dimensions, sinks_, chunk_sizes_)) {
+        return false;
     }
 
-    CHECK(sinks_.size() == chunk_buffers_.size());
+    CHECK(sinks_.size() == chunk_sizes_.size());
 
-    std::latch latch(chunk_buffers_.size());
+    std::latch latch(chunk_sizes_.size());
     {
         std::scoped_lock lock(buffers_mutex_);
         for (auto i = 0; i < sinks_.size(); ++i) {
-            auto& chunk = chunk_buffers_.at(i);
             thread_pool_->push_to_job_queue(
               std::move([sink = sinks_.at(i),
-                         data = chunk.data(),
-                         size = chunk.size(),
+                         data = chunk_data_(i),
+                         size = chunk_sizes_.at(i),
+                         is_rewrite,
                          &latch](std::string& err) -> bool {
                   bool success = false;
                   try {
                       CHECK(sink->write(0, data, size));
+
+                      // a compressed chunk may be shorter than last time
+                      auto* file_sink = dynamic_cast<FileSink*>(sink);
+                      if (is_rewrite && file_sink) {
+                          CHECK(file_sink->truncate(size));
+                      }
                       success = true;
                   } catch (const std::exception& exc) {
                       char buf[128];
@@ -82,6 +88,8 @@ zarr::ZarrV2Writer::should_rollover_() const
 #define acquire_export
 #endif
 
+#include <zstd.h>
+
 namespace common = zarr::common;
 
 extern "C"
@@ -385,5 +393,1024 @@ extern "C"
         }
         return retval;
     }
+
+    acquire_export int unit_test__zarrv2_writer__write_with_filters()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        struct VideoFrame* frame = nullptr;
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+
+            ImageShape shape {
+                .dims = {
+                  .width = 16,
+                  .height = 16,
+                },
+                .type = SampleType_u16,
+            };
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x", DimensionType_Space, 16, 16, 0); // 1 chunk
+            dims.emplace_back("y", DimensionType_Space, 16, 16, 0); // 1 chunk
+            dims.emplace_back(
+              "t", DimensionType_Time, 0, 1, 0); // 1 timepoint / chunk
+
+            zarr::ArrayConfig array_spec = {
+                .image_shape = shape,
+                .dimensions = dims,
+                .data_root = base_dir.string(),
+                .compression_params = std::nullopt,
+                .filters = { zarr::FilterParams(zarr::FilterId::Delta) },
+            };
+
+            zarr::ZarrV2Writer writer(array_spec, thread_pool);
+
+            frame = (VideoFrame*)malloc(sizeof(VideoFrame) + 16 * 16 * 2);
+            frame->bytes_of_frame = sizeof(VideoFrame) + 16 * 16 * 2;
+            frame->shape = shape;
+            for (auto i = 0; i < 16 * 16; ++i) {
+                ((uint16_t*)frame->data)[i] = (uint16_t)(100 + i);
+            }
+
+            frame->frame_id = 0;
+            CHECK(writer.write(frame));
+            writer.finalize();
+
+            const auto chunk_file = base_dir / "0" / "0" / "0";
+            CHECK(fs::is_regular_file(chunk_file));
+            CHECK(fs::file_size(chunk_file) == 16 * 16 * 2);
+
+            std::vector<uint16_t> data(16 * 16);
+            std::ifstream ifs(chunk_file, std::ios::binary);
+            ifs.read((char*)data.data(), data.size() * sizeof(uint16_t));
+            CHECK(ifs.good());
+
+            // the first sample is stored as-is, the rest as differences
+            CHECK(data.at(0) == 100);
+            for (auto i = 1; i < data.size(); ++i) {
+                CHECK(data.at(i) == 1);
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        if (frame) {
+            free(frame);
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__zarrv2_writer__write_with_temporal_delta()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        struct VideoFrame* frame = nullptr;
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+
+            ImageShape shape {
+                .dims = {
+                  .width = 64,
+                  .height = 16,
+                },
+                .type = SampleType_u16,
+            };
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x", DimensionType_Space, 64, 32, 0); // 2 chunks
+            dims.emplace_back("y", DimensionType_Space, 16, 16, 0); // 1 chunk
+            dims.emplace_back(
+              "t", DimensionType_Time, 0, 3, 0); // 3 timepoints / chunk
+
+            zarr::ArrayConfig array_spec = {
+                .image_shape = shape,
+                .dimensions = dims,
+                .data_root = base_dir.string(),
+                .compression_params = std::nullopt,
+                .filters = { zarr::FilterParams(zarr::FilterId::TemporalDelta) },
+            };
+
+            zarr::ZarrV2Writer writer(array_spec, thread_pool);
+
+            frame = (VideoFrame*)malloc(sizeof(VideoFrame) + 64 * 16 * 2);
+            frame->bytes_of_frame = sizeof(VideoFrame) + 64 * 16 * 2;
+            frame->shape = shape;
+
+            // 3 frames fill the first chunk, 2 frames partially fill the next;
+            // samples vary along each row so that misaligned rows show up
+            const uint16_t values[] = { 10, 13, 20, 7, 5 };
+            const auto sample = [&values](int frame_id, int x) {
+                return (uint16_t)(values[frame_id] * (x % 7 + 1));
+            };
+            for (auto i = 0; i < 5; ++i) {
+                for (auto j = 0; j < 64 * 16; ++j) {
+                    ((uint16_t*)frame->data)[j] = sample(i, j % 64);
+                }
+                frame->frame_id = i;
+                CHECK(writer.write(frame));
+            }
+            writer.finalize();
+
+            // the first frame in each chunk is stored as-is, and each frame
+            // after it as its difference from the frame before it
+            for (auto t = 0; t < 2; ++t) {
+                for (auto x = 0; x < 2; ++x) {
+                    const auto chunk_file = base_dir / std::to_string(t) /
+                                            "0" / std::to_string(x);
+                    CHECK(fs::is_regular_file(chunk_file));
+                    CHECK(fs::file_size(chunk_file) == 32 * 16 * 3 * 2);
+
+                    std::vector<uint16_t> data(32 * 16 * 3);
+                    std::ifstream ifs(chunk_file, std::ios::binary);
+                    ifs.read((char*)data.data(),
+                             data.size() * sizeof(uint16_t));
+                    CHECK(ifs.good());
+
+                    for (auto i = 0; i < data.size(); ++i) {
+                        const auto plane = i / (32 * 16);
+                        const auto frame_id = 3 * t + plane;
+                        const auto col = 32 * x + i % 32;
+
+                        uint16_t expected = 0; // the unwritten last frame
+                        if (frame_id < 5) {
+                            expected = sample(frame_id, col);
+                            if (plane > 0) {
+                                expected -= sample(frame_id - 1, col);
+                            }
+                        }
+                        CHECK(data.at(i) == expected);
+                    }
+
+                    // decoding is a cumulative sum along the append dimension
+                    for (auto i = 32 * 16; i < data.size(); ++i) {
+                        data.at(i) += data.at(i - 32 * 16);
+                    }
+                    for (auto i = 0; i < 32 * 16 * (t == 0 ? 3 : 2); ++i) {
+                        CHECK(data.at(i) ==
+                              sample(3 * t + i / (32 * 16), 32 * x + i % 32));
+                    }
+                }
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        if (frame) {
+            free(frame);
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__zarrv2_writer__write_with_zstd_dictionary()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        struct VideoFrame* frame = nullptr;
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+
+            ImageShape shape {
+                .dims = {
+                  .width = 128,
+                  .height = 128,
+                },
+                .type = SampleType_u16,
+            };
+            const auto px_per_frame = 128 * 128;
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x", DimensionType_Space, 128, 16, 0); // 8 chunks
+            dims.emplace_back("y", DimensionType_Space, 128, 16, 0); // 8 chunks
+            dims.emplace_back(
+              "t", DimensionType_Time, 0, 2, 0); // 2 timepoints / chunk
+
+            zarr::ArrayConfig array_spec = {
+                .image_shape = shape,
+                .dimensions = dims,
+                .data_root = base_dir.string(),
+                .compression_params =
+                  zarr::BloscCompressionParams("zstd", 1, 1),
+                .zstd_dictionary_bytes = 4096,
+            };
+
+            zarr::ZarrV2Writer writer(array_spec, thread_pool);
+
+            frame = (VideoFrame*)malloc(sizeof(VideoFrame) + px_per_frame * 2);
+            frame->bytes_of_frame = sizeof(VideoFrame) + px_per_frame * 2;
+            frame->shape = shape;
+
+            uint32_t seed = 1;
+            for (auto t = 0; t < 4; ++t) {
+                for (auto i = 0; i < px_per_frame; ++i) {
+                    seed = seed * 1664525u + 1013904223u;
+                    ((uint16_t*)frame->data)[i] =
+                      (uint16_t)(1000 + 10 * (i % 64) + (seed >> 29));
+                }
+                frame->frame_id = t;
+                CHECK(writer.write(frame));
+            }
+            writer.finalize();
+
+            CHECK(writer.config().zstd_dictionary_bytes == 4096);
+
+            const auto dictionary_path = base_dir / "zstd.dict";
+            CHECK(fs::is_regular_file(dictionary_path));
+            std::vector<char> dictionary(fs::file_size(dictionary_path));
+            CHECK(!dictionary.empty() && dictionary.size() <= 4096);
+            {
+                std::ifstream ifs(dictionary_path, std::ios::binary);
+                ifs.read(dictionary.data(), dictionary.size());
+                CHECK(ifs.good());
+            }
+
+            // the last chunk of the second flush decompresses with the
+            // dictionary trained on the first
+            const auto chunk_file = base_dir / "1" / "7" / "7";
+            CHECK(fs::is_regular_file(chunk_file));
+            std::vector<char> compressed(fs::file_size(chunk_file));
+            {
+                std::ifstream ifs(chunk_file, std::ios::binary);
+                ifs.read(compressed.data(), compressed.size());
+                CHECK(ifs.good());
+            }
+
+            std::vector<uint16_t> data(16 * 16 * 2);
+            ZSTD_DCtx* dctx = ZSTD_createDCtx();
+            const size_t nb =
+              ZSTD_decompress_usingDict(dctx,
+                                        data.data(),
+                                        data.size() * sizeof(uint16_t),
+                                        compressed.data(),
+                                        compressed.size(),
+                                        dictionary.data(),
+                                        dictionary.size());
+            ZSTD_freeDCtx(dctx);
+            CHECK(nb == data.size() * sizeof(uint16_t));
+
+            // the last frame written is the second plane of this chunk
+            for (auto y = 0; y < 16; ++y) {
+                for (auto x = 0; x < 16; ++x) {
+                    const auto i = (112 + y) * 128 + 112 + x;
+                    CHECK(data.at(16 * 16 + y * 16 + x) ==
+                          ((uint16_t*)frame->data)[i]);
+                }
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        if (frame) {
+            free(frame);
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__zarrv2_writer__write_strided_frames()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        struct VideoFrame* frame = nullptr;
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+
+            ImageShape shape {
+                .dims = {
+                  .width = 40,
+                  .height = 8,
+                },
+                .type = SampleType_u16,
+            };
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x", DimensionType_Space, 40, 40, 0); // 1 chunk
+            dims.emplace_back("y", DimensionType_Space, 8, 8, 0);   // 1 chunk
+            dims.emplace_back(
+              "t", DimensionType_Time, 0, 1, 0); // 1 timepoint / chunk
+
+            zarr::ArrayConfig array_spec = {
+                .image_shape = shape,
+                .dimensions = dims,
+                .data_root = base_dir.string(),
+                .compression_params = std::nullopt,
+            };
+
+            zarr::ZarrV2Writer writer(array_spec, thread_pool);
+
+            // room for 8 rows of 96 samples
+            const size_t bytes_of_buf = 8 * 96 * sizeof(uint16_t);
+            frame = (VideoFrame*)malloc(sizeof(VideoFrame) + bytes_of_buf);
+            frame->bytes_of_frame = sizeof(VideoFrame) + bytes_of_buf;
+
+            // frame 0: rows padded to 48 samples
+            // frame 1: every other sample, rows padded to 96 samples
+            const int64_t strides[2][2] = { { 1, 48 }, { 2, 96 } };
+            for (auto t = 0; t < 2; ++t) {
+                frame->shape = shape;
+                frame->shape.strides.width = strides[t][0];
+                frame->shape.strides.height = strides[t][1];
+
+                auto* px = (uint16_t*)frame->data;
+                std::fill_n(px, bytes_of_buf / sizeof(uint16_t), 0xffff);
+                for (auto y = 0; y < 8; ++y) {
+                    for (auto x = 0; x < 40; ++x) {
+                        px[y * strides[t][1] + x * strides[t][0]] =
+                          (uint16_t)(1000 * t + 100 * y + x);
+                    }
+                }
+
+                frame->frame_id = t;
+                CHECK(writer.write(frame));
+            }
+            writer.finalize();
+
+            for (auto t = 0; t < 2; ++t) {
+                const auto chunk_file =
+                  base_dir / std::to_string(t) / "0" / "0";
+                CHECK(fs::is_regular_file(chunk_file));
+                CHECK(fs::file_size(chunk_file) == 40 * 8 * 2);
+
+                std::vector<uint16_t> data(40 * 8);
+                std::ifstream ifs(chunk_file, std::ios::binary);
+                ifs.read((char*)data.data(), data.size() * sizeof(uint16_t));
+                CHECK(ifs.good());
+
+                // no padding makes it into the chunk
+                for (auto y = 0; y < 8; ++y) {
+                    for (auto x = 0; x < 40; ++x) {
+                        CHECK(data.at(y * 40 + x) == 1000 * t + 100 * y + x);
+                    }
+                }
+            }
+
+            // a buffer too small for its strides is rejected
+            frame->shape.strides.height = 128;
+            bool threw = false;
+            try {
+                std::ignore = writer.write(frame);
+            } catch (const std::exception&) {
+                threw = true;
+            }
+            CHECK(threw);
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        if (frame) {
+            free(frame);
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__zarrv2_writer__write_interleaved_channels()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        struct VideoFrame* frame = nullptr;
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+
+            ImageShape shape {
+                .dims = {
+                  .channels = 3,
+                  .width = 40,
+                  .height = 8,
+                },
+                .type = SampleType_u16,
+            };
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x", DimensionType_Space, 40, 20, 0); // 2 chunks
+            dims.emplace_back("y", DimensionType_Space, 8, 8, 0);  // 1 chunk
+            dims.emplace_back(
+              "c", DimensionType_Channel, 3, 1, 0); // 3 chunks
+            dims.emplace_back(
+              "t", DimensionType_Time, 0, 1, 0); // 1 timepoint / chunk
+
+            zarr::ArrayConfig array_spec = {
+                .image_shape = shape,
+                .dimensions = dims,
+                .data_root = base_dir.string(),
+                .compression_params = std::nullopt,
+            };
+
+            zarr::ZarrV2Writer writer(array_spec, thread_pool);
+
+            const size_t bytes_of_buf = 3 * 40 * 8 * sizeof(uint16_t);
+            frame = (VideoFrame*)malloc(sizeof(VideoFrame) + bytes_of_buf);
+            frame->bytes_of_frame = sizeof(VideoFrame) + bytes_of_buf;
+
+            // frames 0 and 1: channels interleaved pixel by pixel, with the
+            // default strides
+            // frame 2: channels stored one plane after another
+            for (auto t = 0; t < 3; ++t) {
+                frame->shape = shape;
+                size_t channel_stride = 1, sample_stride = 3;
+                if (t == 2) {
+                    channel_stride = 40 * 8;
+                    sample_stride = 1;
+                    frame->shape.strides.channels = (int64_t)channel_stride;
+                    frame->shape.strides.width = (int64_t)sample_stride;
+                }
+
+                auto* px = (uint16_t*)frame->data;
+                for (auto c = 0; c < 3; ++c) {
+                    for (auto y = 0; y < 8; ++y) {
+                        for (auto x = 0; x < 40; ++x) {
+                            px[c * channel_stride +
+                               (y * 40 + x) * sample_stride] =
+                              (uint16_t)(10000 * t + 1000 * c + 40 * y + x);
+                        }
+                    }
+                }
+
+                frame->frame_id = t;
+                CHECK(writer.write(frame));
+            }
+            CHECK(writer.frames_written() == 9);
+            writer.finalize();
+
+            for (auto t = 0; t < 3; ++t) {
+                for (auto c = 0; c < 3; ++c) {
+                    for (auto i = 0; i < 2; ++i) {
+                        const auto chunk_file = base_dir / std::to_string(t) /
+                                                std::to_string(c) / "0" /
+                                                std::to_string(i);
+                        CHECK(fs::is_regular_file(chunk_file));
+                        CHECK(fs::file_size(chunk_file) == 20 * 8 * 2);
+
+                        std::vector<uint16_t> data(20 * 8);
+                        std::ifstream ifs(chunk_file, std::ios::binary);
+                        ifs.read((char*)data.data(),
+                                 data.size() * sizeof(uint16_t));
+                        CHECK(ifs.good());
+
+                        for (auto y = 0; y < 8; ++y) {
+                            for (auto x = 0; x < 20; ++x) {
+                                CHECK(data.at(y * 20 + x) ==
+                                      10000 * t + 1000 * c + 40 * y + 20 * i +
+                                        x);
+                            }
+                        }
+                    }
+                }
+            }
+
+            // a frame whose channels don't fill the channel dimension is
+            // rejected
+            frame->shape = shape;
+            frame->shape.dims.channels = 2;
+            bool threw = false;
+            try {
+                std::ignore = writer.write(frame);
+            } catch (const std::exception&) {
+                threw = true;
+            }
+            CHECK(threw);
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        if (frame) {
+            free(frame);
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__zarrv2_writer__write_region_of_interest()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+
+            // a 9 x 7 region at (3, 2) of a 16 x 12 frame
+            const uint32_t frame_width = 16, frame_height = 12;
+            const uint32_t roi_x = 3, roi_y = 2, roi_width = 9, roi_height = 7;
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back(
+              "x", DimensionType_Space, roi_width, 4, 0); // 3 chunks, ragged
+            dims.emplace_back(
+              "y", DimensionType_Space, roi_height, 4, 0); // 2 chunks, ragged
+            dims.emplace_back(
+              "t", DimensionType_Time, 0, 2, 0); // 2 timepoints / chunk
+
+            zarr::ArrayConfig array_spec = {
+                .image_shape = {
+                  .dims = { .width = roi_width, .height = roi_height },
+                  .type = SampleType_u16,
+                },
+                .dimensions = dims,
+                .data_root = base_dir.string(),
+                .compression_params = std::nullopt,
+            };
+
+            zarr::ZarrV2Writer writer(array_spec, thread_pool);
+
+            std::vector<uint16_t> frame(frame_width * frame_height);
+            const ImageShape shape = {
+                .dims = { .width = roi_width, .height = roi_height },
+                .strides = { .width = 1, .height = frame_width },
+                .type = SampleType_u16,
+            };
+            const size_t offset = roi_y * frame_width + roi_x;
+
+            for (auto t = 0; t < 2; ++t) {
+                for (auto y = 0; y < frame_height; ++y) {
+                    for (auto x = 0; x < frame_width; ++x) {
+                        frame.at(y * frame_width + x) =
+                          (uint16_t)(1000 * t + 100 * y + x);
+                    }
+                }
+
+                CHECK(writer.write(
+                  (const uint8_t*)(frame.data() + offset),
+                  (frame.size() - offset) * sizeof(uint16_t),
+                  shape));
+            }
+            writer.finalize();
+
+            for (auto i = 0; i < 2; ++i) {
+                for (auto j = 0; j < 3; ++j) {
+                    const auto chunk_file = base_dir / "0" /
+                                            std::to_string(i) /
+                                            std::to_string(j);
+                    CHECK(fs::is_regular_file(chunk_file));
+                    CHECK(fs::file_size(chunk_file) == 2 * 4 * 4 * 2);
+
+                    std::vector<uint16_t> data(2 * 4 * 4);
+                    std::ifstream ifs(chunk_file, std::ios::binary);
+                    ifs.read((char*)data.data(),
+                             data.size() * sizeof(uint16_t));
+                    CHECK(ifs.good());
+
+                    for (auto t = 0; t < 2; ++t) {
+                        for (auto y = 0; y < 4; ++y) {
+                            for (auto x = 0; x < 4; ++x) {
+                                const auto row = 4 * i + y, col = 4 * j + x;
+                                const auto expected =
+                                  row < roi_height && col < roi_width
+                                    ? 1000 * t + 100 * (roi_y + row) +
+                                        (roi_x + col)
+                                    : 0;
+                                CHECK(data.at(t * 16 + y * 4 + x) ==
+                                      expected);
+                            }
+                        }
+                    }
+                }
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__zarrv2_writer__write_chunk_statistics()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        struct VideoFrame* frame = nullptr;
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+
+            ImageShape shape {
+                .dims = {
+                  .width = 8,
+                  .height = 4,
+                },
+                .type = SampleType_u8,
+            };
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x", DimensionType_Space, 8, 4, 0); // 2 chunks
+            dims.emplace_back("y", DimensionType_Space, 4, 4, 0); // 1 chunk
+            dims.emplace_back(
+              "t", DimensionType_Time, 0, 2, 0); // 2 timepoints / chunk
+
+            zarr::ArrayConfig array_spec = {
+                .image_shape = shape,
+                .dimensions = dims,
+                .data_root = base_dir.string(),
+                .compression_params = std::nullopt,
+                .chunk_statistics = true,
+            };
+
+            zarr::ZarrV2Writer writer(array_spec, thread_pool);
+
+            const size_t bytes_of_frame = 8 * 4;
+            frame = (VideoFrame*)malloc(sizeof(VideoFrame) + bytes_of_frame);
+            frame->bytes_of_frame = sizeof(VideoFrame) + bytes_of_frame;
+            frame->shape = shape;
+
+            // left half of frame t is all t, right half is all 100 + t
+            for (auto t = 0; t < 4; ++t) {
+                for (auto y = 0; y < 4; ++y) {
+                    for (auto x = 0; x < 8; ++x) {
+                        frame->data[y * 8 + x] =
+                          (uint8_t)(x < 4 ? t : 100 + t);
+                    }
+                }
+                frame->frame_id = t;
+                CHECK(writer.write(frame));
+            }
+            writer.finalize();
+
+            const auto path = base_dir / zarr::ChunkStatistics::filename;
+            CHECK(fs::is_regular_file(path));
+
+            std::ifstream ifs(path);
+            std::vector<nlohmann::json> lines;
+            for (std::string line; std::getline(ifs, line);) {
+                lines.push_back(nlohmann::json::parse(line));
+            }
+            CHECK(lines.size() == 5); // header, then 2 chunks per flush
+
+            CHECK(lines.at(0)["histogram_bins"] ==
+                  zarr::ChunkStatistics::n_bins);
+
+            for (auto k = 1; k < 5; ++k) {
+                const auto& line = lines.at(k);
+                const size_t t = (k - 1) / 2, x = (k - 1) % 2;
+                CHECK(line["chunk"] == std::vector<size_t>({ t, 0, x }));
+                CHECK(line["count"] == 2 * 4 * 4);
+
+                const double lo = 2 * t + (x ? 100 : 0);
+                CHECK(line["min"] == lo);
+                CHECK(line["max"] == lo + 1);
+                CHECK(line["mean"] == lo + 0.5);
+
+                // u8 bins are 16 wide
+                CHECK(line["histogram"][(size_t)lo / 16] == 2 * 4 * 4);
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        if (frame) {
+            free(frame);
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__zarrv2_writer__write_f_order()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        struct VideoFrame* frame = nullptr;
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+
+            ImageShape shape {
+                .dims = {
+                  .width = 6,
+                  .height = 4,
+                },
+                .type = SampleType_u16,
+            };
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x", DimensionType_Space, 6, 3, 0); // 2 chunks
+            dims.emplace_back("y", DimensionType_Space, 4, 4, 0); // 1 chunk
+            dims.emplace_back(
+              "t", DimensionType_Time, 0, 5, 0); // 5 timepoints / chunk
+
+            zarr::ArrayConfig array_spec = {
+                .image_shape = shape,
+                .dimensions = dims,
+                .data_root = base_dir.string(),
+                .compression_params = std::nullopt,
+                .chunk_order = zarr::ChunkOrder::F,
+            };
+
+            zarr::ZarrV2Writer writer(array_spec, thread_pool);
+
+            const size_t bytes_of_frame = 6 * 4 * 2;
+            frame = (VideoFrame*)malloc(sizeof(VideoFrame) + bytes_of_frame);
+            frame->bytes_of_frame = sizeof(VideoFrame) + bytes_of_frame;
+            frame->shape = shape;
+
+            for (auto t = 0; t < 5; ++t) {
+                auto* px = (uint16_t*)frame->data;
+                for (auto i = 0; i < 6 * 4; ++i) {
+                    px[i] = (uint16_t)(100 * t + i);
+                }
+                frame->frame_id = t;
+                CHECK(writer.write(frame));
+            }
+            writer.finalize();
+
+            for (auto cx = 0; cx < 2; ++cx) {
+                const auto chunk_file =
+                  base_dir / "0" / "0" / std::to_string(cx);
+                CHECK(fs::is_regular_file(chunk_file));
+                CHECK(fs::file_size(chunk_file) == 5 * 4 * 3 * 2);
+
+                std::vector<uint16_t> data(5 * 4 * 3);
+                std::ifstream ifs(chunk_file, std::ios::binary);
+                ifs.read((char*)data.data(), data.size() * sizeof(uint16_t));
+                CHECK(ifs.good());
+
+                // each pixel's time series is contiguous
+                for (auto x = 0; x < 3; ++x) {
+                    for (auto y = 0; y < 4; ++y) {
+                        for (auto t = 0; t < 5; ++t) {
+                            const auto expected = 100 * t + 6 * y + 3 * cx + x;
+                            CHECK(data.at(t + 5 * (y + 4 * x)) == expected);
+                        }
+                    }
+                }
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        if (frame) {
+            free(frame);
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__zarrv2_writer__write_with_max_latency()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        struct VideoFrame* frame = nullptr;
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+
+            ImageShape shape {
+                .dims = {
+                  .width = 4,
+                  .height = 2,
+                },
+                .type = SampleType_u8,
+            };
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x", DimensionType_Space, 4, 4, 0); // 1 chunk
+            dims.emplace_back("y", DimensionType_Space, 2, 2, 0); // 1 chunk
+            dims.emplace_back(
+              "t", DimensionType_Time, 0, 4, 0); // 4 timepoints / chunk
+
+            zarr::ArrayConfig array_spec = {
+                .image_shape = shape,
+                .dimensions = dims,
+                .data_root = base_dir.string(),
+                .compression_params = std::nullopt,
+                .max_flush_latency_ms = 1,
+            };
+
+            zarr::ZarrV2Writer writer(array_spec, thread_pool);
+
+            const size_t bytes_of_frame = 4 * 2;
+            frame = (VideoFrame*)malloc(sizeof(VideoFrame) + bytes_of_frame);
+            frame->bytes_of_frame = sizeof(VideoFrame) + bytes_of_frame;
+            frame->shape = shape;
+
+            // every sample of frame t is t + 1, so unwritten frames read 0
+            auto read_chunk = [&](const fs::path& path) {
+                CHECK(fs::is_regular_file(path));
+                CHECK(fs::file_size(path) == 4 * bytes_of_frame);
+                std::vector<uint8_t> data(4 * bytes_of_frame);
+                std::ifstream ifs(path, std::ios::binary);
+                ifs.read((char*)data.data(), data.size());
+                CHECK(ifs.good());
+                return data;
+            };
+
+            const auto first_chunk = base_dir / "0" / "0" / "0";
+            for (auto t = 0; t < 5; ++t) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                memset(frame->data, t + 1, bytes_of_frame);
+                frame->frame_id = t;
+                CHECK(writer.write(frame));
+
+                // frames 0 through t are on disk, full chunk or not
+                const auto data = read_chunk(
+                  t < 4 ? first_chunk : base_dir / "1" / "0" / "0");
+                for (auto i = 0; i < data.size(); ++i) {
+                    const auto frame_idx = i / bytes_of_frame;
+                    const auto expected =
+                      frame_idx <= t % 4 ? 4 * (t / 4) + frame_idx + 1 : 0;
+                    CHECK(data.at(i) == expected);
+                }
+            }
+            writer.finalize();
+
+            const auto data = read_chunk(base_dir / "1" / "0" / "0");
+            CHECK(data.at(0) == 5);
+            CHECK(data.at(bytes_of_frame) == 0);
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        if (frame) {
+            free(frame);
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__zarrv2_writer__write_spilled()
+    {
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        const fs::path spill_dir = fs::temp_directory_path() / "acquire-spill";
+        struct VideoFrame* frame = nullptr;
+        int retval = 0;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+
+            ImageShape shape {
+                .dims = {
+                  .width = 64,
+                  .height = 48,
+                },
+                .type = SampleType_u16,
+            };
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x", DimensionType_Space, 64, 16, 0); // 4 chunks
+            dims.emplace_back("y", DimensionType_Space, 48, 16, 0); // 3 chunks
+            dims.emplace_back(
+              "t", DimensionType_Time, 0, 2, 0); // 2 timepoints / chunk
+
+            fs::create_directories(spill_dir);
+            zarr::ArrayConfig array_spec = {
+                .image_shape = shape,
+                .dimensions = dims,
+                .data_root = base_dir.string(),
+                .compression_params = std::nullopt,
+                .memory_budget_bytes = 1024, // far less than the chunks take
+                .spill_directory = spill_dir.string(),
+            };
+
+            zarr::ZarrV2Writer writer(array_spec, thread_pool);
+
+            const size_t bytes_of_frame = 64 * 48 * 2;
+            frame = (VideoFrame*)malloc(sizeof(VideoFrame) + bytes_of_frame);
+            frame->bytes_of_frame = sizeof(VideoFrame) + bytes_of_frame;
+            frame->shape = shape;
+
+            // 2 flushes, with the second filling only half of each chunk
+            for (auto t = 0; t < 3; ++t) {
+                auto* px = (uint16_t*)frame->data;
+                for (auto i = 0; i < 64 * 48; ++i) {
+                    px[i] = (uint16_t)(1000 * t + i % 64 + i / 64);
+                }
+                frame->frame_id = t;
+                CHECK(writer.write(frame));
+            }
+            writer.finalize();
+
+            const size_t chunk_px = 16 * 16;
+            for (auto t = 0; t < 2; ++t) {
+                for (auto cy = 0; cy < 3; ++cy) {
+                    for (auto cx = 0; cx < 4; ++cx) {
+                        const auto chunk_file = base_dir / std::to_string(t) /
+                                                std::to_string(cy) /
+                                                std::to_string(cx);
+                        CHECK(fs::is_regular_file(chunk_file));
+                        CHECK(fs::file_size(chunk_file) == 2 * chunk_px * 2);
+
+                        std::vector<uint16_t> data(2 * chunk_px);
+                        std::ifstream ifs(chunk_file, std::ios::binary);
+                        ifs.read((char*)data.data(), data.size() * 2);
+                        CHECK(ifs.good());
+
+                        for (auto i = 0; i < data.size(); ++i) {
+                            const auto frame_idx = 2 * t + i / chunk_px;
+                            const auto y = 16 * cy + i % chunk_px / 16;
+                            const auto x = 16 * cx + i % 16;
+                            const uint16_t expected =
+                              frame_idx < 3 ? 1000 * frame_idx + x + y : 0;
+                            CHECK(data.at(i) == expected);
+                        }
+                    }
+                }
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        if (fs::exists(spill_dir)) {
+            fs::remove_all(spill_dir);
+        }
+        if (frame) {
+            free(frame);
+        }
+        return retval;
+    }
 }
 #endif
@@ -1,12 +1,115 @@
 #include "zarrv3.writer.hh"
 #include "../zarr.hh"
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <latch>
 #include <stdexcept>
+#include <unordered_map>
 
 namespace zarr = acquire::sink::zarr;
 
 namespace {
+constexpr uint64_t prime64_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t prime64_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t prime64_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t prime64_5 = 0x27D4EB2F165667C5ULL;
+
+uint64_t
+rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+uint64_t
+read64(const uint8_t* p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t
+read32(const uint8_t* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint64_t
+xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * prime64_2;
+    return rotl64(acc, 31) * prime64_1;
+}
+
+uint64_t
+xxh64_merge_round(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh64_round(0, val);
+    return acc * prime64_1 + prime64_4;
+}
+
+/// @brief Hash a compressed chunk with XXH64 (seed 0).
+/// @details The four lanes are independent, so the main loop keeps the
+/// multipliers busy without waiting on one another.
+uint64_t
+hash_chunk(const uint8_t* data, size_t bytes_of_data)
+{
+    const uint8_t* p = data;
+    const uint8_t* const end = data + bytes_of_data;
+    uint64_t h;
+
+    if (bytes_of_data >= 32) {
+        uint64_t v1 = prime64_1 + prime64_2;
+        uint64_t v2 = prime64_2;
+        uint64_t v3 = 0;
+        uint64_t v4 = 0 - prime64_1;
+
+        for (const uint8_t* limit = end - 32; p <= limit; p += 32) {
+            v1 = xxh64_round(v1, read64(p));
+            v2 = xxh64_round(v2, read64(p + 8));
+            v3 = xxh64_round(v3, read64(p + 16));
+            v4 = xxh64_round(v4, read64(p + 24));
+        }
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh64_merge_round(h, v1);
+        h = xxh64_merge_round(h, v2);
+        h = xxh64_merge_round(h, v3);
+        h = xxh64_merge_round(h, v4);
+    } else {
+        h = prime64_5;
+    }
+
+    h += (uint64_t)bytes_of_data;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh64_round(0, read64(p));
+        h = rotl64(h, 27) * prime64_1 + prime64_4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32(p) * prime64_1;
+        h = rotl64(h, 23) * prime64_2 + prime64_3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= (uint64_t)(*p) * prime64_5;
+        h = rotl64(h, 11) * prime64_1;
+    }
+
+    h ^= h >> 33;
+    h *= prime64_2;
+    h ^= h >> 29;
+    h *= prime64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
 /// @brief Get the shard index for a given chunk index.
 size_t
 shard_index(size_t chunk_idx, const std::vector<zarr::Dimension>& dimensions)
@@ -104,6 +207,8 @@ zarr::ZarrV3Writer::ZarrV3Writer(
   : Writer(array_spec, thread_pool)
   , shard_file_offsets_(common::number_of_shards(array_spec.dimensions), 0)
   , shard_tables_{ common::number_of_shards(array_spec.dimensions) }
+  , checkpoint_slots_(common::number_of_shards(array_spec.dimensions))
+  , repeated_chunks_(common::number_of_shards(array_spec.dimensions))
 {
     const auto chunks_per_shard =
       common::chunks_per_shard(array_spec.dimensions);
@@ -123,12 +228,12 @@ zarr::ZarrV3Writer::flush_impl_()
       (fs::path(data_root_) / ("c" + std::to_string(append_chunk_index_)))
         .string();
 
-    {
-        FileCreator file_creator(thread_pool_);
-        if (sinks_.empty() && !file_creator.create_shard_sinks(
-                                data_root, config_.dimensions, sinks_)) {
-            return false;
-        }
+    if (sinks_.empty() &&
+        !file_creator_->create_shard_sinks(data_root,
+                                           config_.dimensions,
+                                           sinks_,
+                                           shard_bytes_to_preallocate_())) {
+        return false;
     }
 
     const auto n_shards = common::number_of_shards(config_.dimensions);
@@ -136,44 +241,85 @@ zarr::ZarrV3Writer::flush_impl_()
 
     // get shard indices for each chunk
     std::vector<std::vector<size_t>> chunk_in_shards(n_shards);
-    for (auto i = 0; i < chunk_buffers_.size(); ++i) {
+    for (auto i = 0; i < chunk_sizes_.size(); ++i) {
         const auto index = shard_index(i, config_.dimensions);
         chunk_in_shards.at(index).push_back(i);
     }
 
-    // write out chunks to shards
-    bool write_table = is_finalizing_ || should_rollover_();
+    // write out chunks to shards, with an index if the shards are complete;
+    // with a maximum flush latency, every write leaves the shards readable:
+    // each chunk goes back where a checkpoint put it if it still fits, or
+    // after the last chunk, over the index, and a new index follows
+    const bool shards_complete = is_finalizing_ || should_rollover_();
+    const bool write_table =
+      shards_complete || config_.max_flush_latency_ms > 0;
     std::latch latch(n_shards);
     for (auto i = 0; i < n_shards; ++i) {
         const auto& chunks = chunk_in_shards.at(i);
         auto& chunk_table = shard_tables_.at(i);
         size_t* file_offset = &shard_file_offsets_.at(i);
+        auto& slots = checkpoint_slots_.at(i);
+        auto& repeated = repeated_chunks_.at(i);
 
         thread_pool_->push_to_job_queue([sink = sinks_.at(i),
                                          &chunks,
                                          &chunk_table,
                                          file_offset,
+                                         &slots,
+                                         &repeated,
                                          write_table,
                                          &latch,
                                          this](std::string& err) mutable {
             bool success = false;
 
             try {
+                // chunks written to this shard in this flush, by hash
+                std::unordered_multimap<uint64_t, size_t> written;
+
                 for (const auto& chunk_idx : chunks) {
-                    auto& chunk = chunk_buffers_.at(chunk_idx);
+                    const auto* chunk = chunk_data_(chunk_idx);
+                    const auto bytes_of_chunk = chunk_sizes_.at(chunk_idx);
+                    const auto internal_idx = shard_internal_index_(chunk_idx);
+
+                    // a checkpoint's chunks are rewritten by later writes, so
+                    // nothing may point at them
+                    if (config_.deduplicate_chunks && !is_checkpointing_) {
+                        const auto hash = hash_chunk(chunk, bytes_of_chunk);
+                        const auto offset = find_duplicate_(
+                          chunk, bytes_of_chunk, hash, written, repeated);
+                        if (offset) {
+                            chunk_table.at(2 * internal_idx) = *offset;
+                            chunk_table.at(2 * internal_idx + 1) =
+                              bytes_of_chunk;
+                            success = true;
+                            continue;
+                        }
+                        written.emplace(hash, chunk_idx);
+                    }
 
-                    success =
-                      sink->write(*file_offset, chunk.data(), chunk.size());
+                    uint64_t offset = *file_offset;
+                    auto slot = slots.find(internal_idx);
+                    const bool in_place =
+                      slot != slots.end() &&
+                      bytes_of_chunk <= slot->second.capacity;
+                    if (in_place) {
+                        offset = slot->second.offset;
+                    }
+
+                    success = sink->write(offset, chunk, bytes_of_chunk);
                     if (!success) {
                         break;
                     }
 
-                    const auto internal_idx =
-                      shard_internal_index(chunk_idx, config_.dimensions);
-                    chunk_table.at(2 * internal_idx) = *file_offset;
-                    chunk_table.at(2 * internal_idx + 1) = chunk.size();
+                    chunk_table.at(2 * internal_idx) = offset;
+                    chunk_table.at(2 * internal_idx + 1) = bytes_of_chunk;
 
-                    *file_offset += chunk.size();
+                    if (!in_place) {
+                        *file_offset += bytes_of_chunk;
+                        if (is_checkpointing_) {
+                            slots[internal_idx] = { offset, bytes_of_chunk };
+                        }
+                    }
                 }
 
                 if (success && write_table) {
@@ -201,8 +347,15 @@ zarr::ZarrV3Writer::flush_impl_()
     // wait for all threads to finish
     latch.wait();
 
+    // the next flush's chunks start afresh
+    if (!is_checkpointing_) {
+        for (auto& slots : checkpoint_slots_) {
+            slots.clear();
+        }
+    }
+
     // reset shard tables and file offsets
-    if (write_table) {
+    if (shards_complete) {
         for (auto& table : shard_tables_) {
             std::fill_n(table.begin(),
                         table.size(),
@@ -210,11 +363,102 @@ zarr::ZarrV3Writer::flush_impl_()
         }
 
         std::fill_n(shard_file_offsets_.begin(), shard_file_offsets_.size(), 0);
+
+        for (auto& repeated : repeated_chunks_) {
+            repeated.clear();
+        }
     }
 
     return true;
 }
 
+std::vector<size_t>
+zarr::ZarrV3Writer::shard_bytes_to_preallocate_() const
+{
+    // Only raw shards have a size known up front, and only if every chunk is
+    // written once, after which the index is written once. Checkpoints write
+    // an index after the last chunk so far, which readers find at the end of
+    // the file only if the file ends there.
+    const auto& dims = config_.dimensions;
+    const auto bytes_per_chunk =
+      common::bytes_per_chunk(dims, config_.image_shape.type);
+    const bool is_raw =
+      std::all_of(chunk_sizes_.begin(),
+                  chunk_sizes_.end(),
+                  [bytes_per_chunk](size_t size) {
+                      return size == bytes_per_chunk;
+                  });
+    if (!is_raw || config_.deduplicate_chunks ||
+        config_.max_flush_latency_ms > 0) {
+        return {};
+    }
+
+    const auto chunks_per_shard = common::chunks_per_shard(dims);
+    const size_t bytes_of_shard =
+      chunks_per_shard * (bytes_per_chunk + 2 * sizeof(uint64_t));
+    return std::vector<size_t>(common::number_of_shards(dims),
+                               bytes_of_shard);
+}
+
+size_t
+zarr::ZarrV3Writer::shard_internal_index_(size_t chunk_idx) const
+{
+    const auto& dims = config_.dimensions;
+
+    // chunk indices restart with each flush, so place this flush's chunks
+    // after those of the earlier flushes to the same shards
+    const auto& append_dim = dims.back();
+    const size_t shard_size_chunks =
+      std::max(append_dim.shard_size_chunks, 1u);
+    const size_t append_idx = (frames_written_ - 1) / frames_before_flush_();
+    const size_t chunks_per_flush =
+      common::chunks_per_shard(dims) / shard_size_chunks;
+
+    return shard_internal_index(chunk_idx, dims) +
+           (append_idx % shard_size_chunks) * chunks_per_flush;
+}
+
+std::optional<uint64_t>
+zarr::ZarrV3Writer::find_duplicate_(
+  const uint8_t* chunk,
+  size_t bytes_of_chunk,
+  uint64_t hash,
+  const std::unordered_multimap<uint64_t, size_t>& written,
+  std::unordered_multimap<uint64_t, RepeatedChunk>& repeated) const
+{
+    // hashes only nominate candidates; the bytes must match
+    auto [it, end] = repeated.equal_range(hash);
+    for (; it != end; ++it) {
+        const auto& bytes = it->second.bytes;
+        if (bytes.size() == bytes_of_chunk &&
+            std::memcmp(bytes.data(), chunk, bytes_of_chunk) == 0) {
+            return it->second.offset;
+        }
+    }
+
+    const auto& dims = config_.dimensions;
+    auto [jt, jend] = written.equal_range(hash);
+    for (; jt != jend; ++jt) {
+        const auto other_idx = jt->second;
+        if (chunk_sizes_.at(other_idx) != bytes_of_chunk ||
+            std::memcmp(chunk_data_(other_idx), chunk, bytes_of_chunk) != 0) {
+            continue;
+        }
+
+        // Content that repeats once is likely to repeat in later flushes
+        // too, after this flush's buffers are gone, so keep a copy of it.
+        const auto internal_idx = shard_internal_index_(other_idx);
+        const auto& table = shard_tables_.at(shard_index(other_idx, dims));
+        const uint64_t offset = table.at(2 * internal_idx);
+        repeated.emplace(
+          hash,
+          RepeatedChunk{ offset, { chunk, chunk + bytes_of_chunk } });
+        return offset;
+    }
+
+    return std::nullopt;
+}
+
 bool
 zarr::ZarrV3Writer::should_rollover_() const
 {
@@ -862,5 +1106,271 @@ extern "C"
         }
         return retval;
     }
+
+    acquire_export int unit_test__zarrv3_writer__hash_chunk()
+    {
+        int retval = 0;
+
+        try {
+            // reference values for XXH64 with seed 0, from the xxHash library
+            const auto hash_string = [](const char* s) {
+                return hash_chunk((const uint8_t*)s, strlen(s));
+            };
+            CHECK(hash_chunk(nullptr, 0) == 0xEF46DB3751D8E999ULL);
+            CHECK(hash_string("a") == 0xD24EC4F1A98C6E5BULL);
+            CHECK(hash_string("abc") == 0x44BC2CF5AD770999ULL);
+            CHECK(hash_string("Nobody inspects the spammish repetition") ==
+                  0xFBCEA83C8A378BF1ULL);
+
+            // bytes 0, 1, 2, ..., one length for each path through the
+            // 32-byte stripes and the 8-, 4-, and 1-byte tails
+            const std::vector<std::pair<size_t, uint64_t>> expected = {
+                { 1, 0xE934A84ADB052768ULL },    { 4, 0xFFCED8604453CC1EULL },
+                { 8, 0x884A173614B81B8DULL },    { 13, 0x13D17C4C779723A8ULL },
+                { 31, 0xC346D2B59B4D8EE1ULL },   { 32, 0xCBF59C5116FF32B4ULL },
+                { 45, 0x10FDD84D6409ABDFULL },   { 64, 0xF7C67301DB6713F0ULL },
+                { 1027, 0xC2E84799BD1839C4ULL },
+            };
+
+            // one byte in, so that no read is aligned
+            std::vector<uint8_t> buf(1 + 1027);
+            for (auto i = 0; i < 1027; ++i) {
+                buf.at(1 + i) = (uint8_t)i;
+            }
+            for (const auto& [n, hash] : expected) {
+                EXPECT(hash_chunk(buf.data() + 1, n) == hash,
+                       "Expected XXH64 of %zu bytes to be %llx, got %llx.",
+                       n,
+                       (unsigned long long)hash,
+                       (unsigned long long)hash_chunk(buf.data() + 1, n));
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        return retval;
+    }
+
+    acquire_export int unit_test__zarrv3_writer__deduplicate_chunks()
+    {
+        int retval = 0;
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        struct VideoFrame* frame = nullptr;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x",
+                              DimensionType_Space,
+                              64,
+                              16, // 64 / 16 = 4 chunks
+                              4); // 4 / 4 = 1 shard
+            dims.emplace_back("y",
+                              DimensionType_Space,
+                              16,
+                              16, // 16 / 16 = 1 chunk
+                              1); // 1 / 1 = 1 shard
+            dims.emplace_back("t",
+                              DimensionType_Time,
+                              0,
+                              2,  // 2 timepoints / chunk
+                              2); // 2 chunks / shard
+
+            ImageShape shape {
+                .dims = {
+                  .width = 64,
+                  .height = 16,
+                },
+                .type = SampleType_u8,
+            };
+
+            zarr::ArrayConfig array_spec = {
+                .image_shape = shape,
+                .dimensions = dims,
+                .data_root = base_dir.string(),
+                .compression_params = std::nullopt,
+                .deduplicate_chunks = true,
+            };
+
+            zarr::ZarrV3Writer writer(array_spec, thread_pool);
+
+            frame = (VideoFrame*)malloc(sizeof(VideoFrame) + 64 * 16);
+            frame->bytes_of_frame = sizeof(VideoFrame) + 64 * 16;
+            frame->shape = shape;
+
+            // every chunk is blank except the first chunk along x in the
+            // second flush
+            for (auto t = 0; t < 4; ++t) {
+                memset(frame->data, 0, 64 * 16);
+                if (t >= 2) {
+                    for (auto y = 0; y < 16; ++y) {
+                        memset(frame->data + y * 64, 1, 16);
+                    }
+                }
+                frame->frame_id = t;
+                CHECK(writer.write(frame));
+            }
+            writer.finalize();
+
+            const size_t chunk_size = 16 * 16 * 2;
+            const size_t n_chunks = 4 * 2;
+            const size_t index_size = n_chunks * 2 * sizeof(uint64_t);
+
+            const auto path = base_dir / "c0" / "0" / "0";
+            CHECK(fs::is_regular_file(path));
+            CHECK(fs::file_size(path) == 2 * chunk_size + index_size);
+
+            std::vector<uint64_t> index(2 * n_chunks);
+            std::ifstream ifs(path, std::ios::binary);
+            ifs.seekg(2 * chunk_size);
+            ifs.read((char*)index.data(), index_size);
+            CHECK(ifs.good());
+
+            for (auto t = 0; t < 2; ++t) {
+                for (auto x = 0; x < 4; ++x) {
+                    const auto i = x + 4 * t;
+                    const uint64_t offset = (t == 1 && x == 0) ? chunk_size : 0;
+                    CHECK(index.at(2 * i) == offset);
+                    CHECK(index.at(2 * i + 1) == chunk_size);
+                }
+            }
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        if (frame) {
+            free(frame);
+        }
+        return retval;
+    }
+
+    acquire_export int unit_test__zarrv3_writer__write_with_max_latency()
+    {
+        int retval = 0;
+        const fs::path base_dir = fs::temp_directory_path() / "acquire";
+        struct VideoFrame* frame = nullptr;
+
+        try {
+            auto thread_pool = std::make_shared<common::ThreadPool>(
+              std::thread::hardware_concurrency(),
+              [](const std::string& err) { LOGE("Error: %s", err.c_str()); });
+
+            std::vector<zarr::Dimension> dims;
+            dims.emplace_back("x",
+                              DimensionType_Space,
+                              4,
+                              4,  // 4 / 4 = 1 chunk
+                              1); // 1 / 1 = 1 shard
+            dims.emplace_back("y",
+                              DimensionType_Space,
+                              2,
+                              2,  // 2 / 2 = 1 chunk
+                              1); // 1 / 1 = 1 shard
+            dims.emplace_back("t",
+                              DimensionType_Time,
+                              0,
+                              4,  // 4 timepoints / chunk
+                              2); // 2 chunks / shard
+
+            ImageShape shape {
+                .dims = {
+                  .width = 4,
+                  .height = 2,
+                },
+                .type = SampleType_u8,
+            };
+
+            zarr::ArrayConfig array_spec = {
+                .image_shape = shape,
+                .dimensions = dims,
+                .data_root = base_dir.string(),
+                .compression_params = std::nullopt,
+                .max_flush_latency_ms = 1,
+            };
+
+            zarr::ZarrV3Writer writer(array_spec, thread_pool);
+
+            const size_t bytes_of_frame = 4 * 2;
+            frame = (VideoFrame*)malloc(sizeof(VideoFrame) + bytes_of_frame);
+            frame->bytes_of_frame = sizeof(VideoFrame) + bytes_of_frame;
+            frame->shape = shape;
+
+            const size_t chunk_size = 4 * bytes_of_frame;
+            const size_t index_size = 2 * 2 * sizeof(uint64_t);
+            const auto path = base_dir / "c0" / "0" / "0";
+
+            // every sample of frame t is t + 1, so unwritten frames read 0;
+            // the index at the end of the shard always locates every frame
+            // written so far, and each chunk is rewritten where it was first
+            // written, so the shard never holds more than one copy of it
+            for (auto t = 0; t < 8; ++t) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                memset(frame->data, t + 1, bytes_of_frame);
+                frame->frame_id = t;
+                CHECK(writer.write(frame));
+
+                CHECK(fs::is_regular_file(path));
+                const auto file_size = fs::file_size(path);
+                CHECK(file_size == (t / 4 + 1) * chunk_size + index_size);
+
+                std::vector<uint8_t> shard(file_size);
+                std::ifstream ifs(path, std::ios::binary);
+                ifs.read((char*)shard.data(), file_size);
+                CHECK(ifs.good());
+
+                const auto* index =
+                  (const uint64_t*)(shard.data() + file_size - index_size);
+                for (auto c = 0; c <= t / 4; ++c) {
+                    const auto offset = index[2 * c];
+                    CHECK(index[2 * c + 1] == chunk_size);
+                    CHECK(offset == c * chunk_size);
+
+                    for (auto f = 0; f < 4; ++f) {
+                        const auto frame_idx = 4 * c + f;
+                        const uint8_t expected =
+                          frame_idx <= t ? frame_idx + 1 : 0;
+                        for (auto i = 0; i < bytes_of_frame; ++i) {
+                            CHECK(shard.at(offset + f * bytes_of_frame + i) ==
+                                  expected);
+                        }
+                    }
+                }
+            }
+            writer.finalize();
+
+            // 6 checkpoints and 2 flushes later
+            CHECK(fs::file_size(path) == 2 * chunk_size + index_size);
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+
+        // cleanup
+        if (fs::exists(base_dir)) {
+            fs::remove_all(base_dir);
+        }
+        if (frame) {
+            free(frame);
+        }
+        return retval;
+    }
 }
 #endif
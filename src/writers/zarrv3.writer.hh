@@ -12,6 +12,7 @@
 #include <optional>
 #include <queue>
 #include <thread>
+#include <unordered_map>
 
 namespace fs = std::filesystem;
 
@@ -26,11 +27,52 @@ struct ZarrV3Writer final : public Writer
     ~ZarrV3Writer() override = default;
 
   private:
+    /// A chunk whose content has already been written more than once to the
+    /// current shard, kept so that later flushes can point at it too.
+    struct RepeatedChunk
+    {
+        uint64_t offset;
+        std::vector<uint8_t> bytes;
+    };
+
+    /// Where a checkpoint wrote a chunk of the flush in progress, and how
+    /// many bytes it took there, so later writes of the chunk can reuse it.
+    struct ChunkSlot
+    {
+        uint64_t offset;
+        uint64_t capacity;
+    };
+
     std::vector<size_t> shard_file_offsets_;
     std::vector<std::vector<uint64_t>> shard_tables_;
 
+    /// Per shard, by index within the shard. Cleared after each flush.
+    std::vector<std::unordered_map<size_t, ChunkSlot>> checkpoint_slots_;
+
+    /// Per shard, by content hash. Only used when deduplicating chunks.
+    std::vector<std::unordered_multimap<uint64_t, RepeatedChunk>>
+      repeated_chunks_;
+
     [[nodiscard]] bool flush_impl_() override;
     bool should_rollover_() const override;
+
+    /// @brief Get the size of each new shard, if known, to reserve storage
+    /// for.
+    std::vector<size_t> shard_bytes_to_preallocate_() const;
+
+    /// @brief Get the index of a chunk of the current flush within its shard.
+    size_t shard_internal_index_(size_t chunk_idx) const;
+
+    /// @brief Find the offset, within the current shard, of a chunk already
+    /// written with the same bytes as @p chunk.
+    /// @param written Chunks written to the shard in this flush, by hash.
+    /// @param repeated Repeated chunks of the shard, by hash.
+    std::optional<uint64_t> find_duplicate_(
+      const uint8_t* chunk,
+      size_t bytes_of_chunk,
+      uint64_t hash,
+      const std::unordered_multimap<uint64_t, size_t>& written,
+      std::unordered_multimap<uint64_t, RepeatedChunk>& repeated) const;
 };
 } // namespace acquire::sink::zarr
 
@@ -0,0 +1,217 @@
+#include "zstd.dictionary.hh"
+#include "../common.hh"
+
+#include <zdict.h>
+#include <zstd.h>
+
+#include <memory>
+
+namespace zarr = acquire::sink::zarr;
+using json = nlohmann::json;
+
+namespace {
+// zstd's guidance is to train on roughly 100 times as many bytes as the
+// dictionary holds; much more than that only slows training down.
+constexpr size_t max_training_bytes_per_dictionary_byte = 128;
+
+struct CCtxDeleter
+{
+    void operator()(ZSTD_CCtx* cctx) const noexcept { ZSTD_freeCCtx(cctx); }
+};
+
+/// Each thread keeps its own compression context, so that compressing a chunk
+/// doesn't pay to allocate and initialize one.
+ZSTD_CCtx*
+thread_local_cctx()
+{
+    thread_local std::unique_ptr<ZSTD_CCtx, CCtxDeleter> cctx(
+      ZSTD_createCCtx());
+    CHECK(cctx);
+    return cctx.get();
+}
+} // namespace
+
+zarr::ZstdDictionary::ZstdDictionary(std::vector<uint8_t>&& dictionary,
+                                     int clevel)
+  : dictionary_{ std::move(dictionary) }
+  , clevel_{ clevel }
+  , cdict_{ nullptr }
+{
+    EXPECT(!dictionary_.empty(), "Dictionary must not be empty.");
+    cdict_ =
+      ZSTD_createCDict(dictionary_.data(), dictionary_.size(), clevel_);
+    EXPECT(cdict_, "Failed to create zstd dictionary.");
+}
+
+zarr::ZstdDictionary::~ZstdDictionary() noexcept
+{
+    ZSTD_freeCDict(cdict_);
+}
+
+size_t
+zarr::ZstdDictionary::compress(const uint8_t* src,
+                               size_t bytes_of_src,
+                               uint8_t* dst,
+                               size_t bytes_of_dst) const
+{
+    const size_t nb = ZSTD_compress_usingCDict(
+      thread_local_cctx(), dst, bytes_of_dst, src, bytes_of_src, cdict_);
+    EXPECT(!ZSTD_isError(nb),
+           "Failed to compress with dictionary: %s",
+           ZSTD_getErrorName(nb));
+
+    return nb;
+}
+
+size_t
+zarr::ZstdDictionary::compress_bound(size_t bytes_of_src) noexcept
+{
+    return ZSTD_compressBound(bytes_of_src);
+}
+
+const std::vector<uint8_t>&
+zarr::ZstdDictionary::data() const noexcept
+{
+    return dictionary_;
+}
+
+int
+zarr::ZstdDictionary::clevel() const noexcept
+{
+    return clevel_;
+}
+
+std::vector<uint8_t>
+zarr::train_zstd_dictionary(
+  const std::vector<std::span<const uint8_t>>& samples,
+  size_t capacity)
+{
+    CHECK(capacity > 0);
+
+    const size_t max_training_bytes =
+      capacity * max_training_bytes_per_dictionary_byte;
+
+    std::vector<uint8_t> training_buffer;
+    std::vector<size_t> sample_sizes;
+    for (const auto& sample : samples) {
+        if (training_buffer.size() + sample.size() > max_training_bytes) {
+            break;
+        }
+        training_buffer.insert(
+          training_buffer.end(), sample.begin(), sample.end());
+        sample_sizes.push_back(sample.size());
+    }
+
+    std::vector<uint8_t> dictionary(capacity);
+    const size_t nb = ZDICT_trainFromBuffer(dictionary.data(),
+                                            dictionary.size(),
+                                            training_buffer.data(),
+                                            sample_sizes.data(),
+                                            (unsigned)sample_sizes.size());
+    if (ZDICT_isError(nb)) {
+        LOGE("Failed to train zstd dictionary on %zu samples: %s",
+             sample_sizes.size(),
+             ZDICT_getErrorName(nb));
+        return {};
+    }
+
+    dictionary.resize(nb);
+    return dictionary;
+}
+
+json
+zarr::zstd_dictionary_to_json(int clevel, const std::string& dictionary_path)
+{
+    return {
+        { "id", ZstdDictionary::id },
+        { "level", clevel },
+        { "dictionary", dictionary_path },
+    };
+}
+
+#ifndef NO_UNIT_TESTS
+#ifdef _WIN32
+#define acquire_export __declspec(dllexport)
+#else
+#define acquire_export
+#endif
+
+namespace {
+/// Small chunks of a smooth u16 image with a little noise, similar to what a
+/// camera would give.
+std::vector<std::vector<uint8_t>>
+make_small_chunks(size_t n_chunks, size_t px_per_chunk, uint32_t seed)
+{
+    std::vector<std::vector<uint8_t>> chunks;
+    for (auto i = 0; i < n_chunks; ++i) {
+        std::vector<uint8_t> chunk(px_per_chunk * sizeof(uint16_t));
+        auto* px = (uint16_t*)chunk.data();
+        for (auto j = 0; j < px_per_chunk; ++j) {
+            seed = seed * 1664525u + 1013904223u;
+            px[j] = (uint16_t)(1000 + 10 * ((i + j) % 64) + (seed >> 29));
+        }
+        chunks.push_back(std::move(chunk));
+    }
+    return chunks;
+}
+} // namespace
+
+extern "C"
+{
+    acquire_export int unit_test__zstd_dictionary()
+    {
+        int retval = 0;
+        try {
+            const auto training = make_small_chunks(64, 1024, 1);
+            auto dictionary = zarr::train_zstd_dictionary(
+              { training.begin(), training.end() }, 4096);
+            CHECK(!dictionary.empty());
+            CHECK(dictionary.size() <= 4096);
+
+            const std::vector<uint8_t> raw_dictionary = dictionary;
+            const zarr::ZstdDictionary zdict(std::move(dictionary), 1);
+            CHECK(zdict.data() == raw_dictionary);
+
+            const auto chunk = make_small_chunks(1, 1024, 2).front();
+            std::vector<uint8_t> compressed(
+              zarr::ZstdDictionary::compress_bound(chunk.size()));
+            const size_t nb = zdict.compress(
+              chunk.data(), chunk.size(), compressed.data(), compressed.size());
+
+            // the dictionary should do at least as well as compressing cold
+            std::vector<uint8_t> cold(ZSTD_compressBound(chunk.size()));
+            const size_t nb_cold = ZSTD_compress(
+              cold.data(), cold.size(), chunk.data(), chunk.size(), 1);
+            CHECK(!ZSTD_isError(nb_cold));
+            CHECK(nb <= nb_cold);
+
+            // round trip
+            std::vector<uint8_t> decompressed(chunk.size());
+            ZSTD_DCtx* dctx = ZSTD_createDCtx();
+            const size_t nd = ZSTD_decompress_usingDict(dctx,
+                                                        decompressed.data(),
+                                                        decompressed.size(),
+                                                        compressed.data(),
+                                                        nb,
+                                                        raw_dictionary.data(),
+                                                        raw_dictionary.size());
+            ZSTD_freeDCtx(dctx);
+            CHECK(nd == chunk.size());
+            CHECK(decompressed == chunk);
+
+            // too few samples to train on
+            const auto too_few = make_small_chunks(1, 16, 3);
+            CHECK(zarr::train_zstd_dictionary(
+                    { too_few.begin(), too_few.end() }, 4096)
+                    .empty());
+
+            retval = 1;
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return retval;
+    }
+}
+#endif
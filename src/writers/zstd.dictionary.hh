@@ -0,0 +1,82 @@
+#ifndef H_ACQUIRE_ZARR_ZSTD_DICTIONARY_V0
+#define H_ACQUIRE_ZARR_ZSTD_DICTIONARY_V0
+
+#include "nlohmann/json.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct ZSTD_CDict_s;
+
+namespace acquire::sink::zarr {
+/// @brief A zstd dictionary, trained on the first chunks of an array, used to
+/// compress all chunks of that array.
+/// @details Small chunks give zstd too little history to find repeated
+/// content, so each one compresses cold. Priming the compressor with a
+/// dictionary trained on representative chunks recovers most of that ratio,
+/// and skips the per-chunk warmup.
+struct ZstdDictionary
+{
+  public:
+    static constexpr char id[] = "acquire_zstd_dictionary";
+
+    /// The name of the dictionary file, stored alongside the array's chunks.
+    static constexpr char filename[] = "zstd.dict";
+
+    /// The smallest dictionary zstd will train, i.e., ZDICT_DICTSIZE_MIN.
+    static constexpr size_t min_bytes = 256;
+
+    ZstdDictionary() = delete;
+    ZstdDictionary(std::vector<uint8_t>&& dictionary, int clevel);
+    ZstdDictionary(const ZstdDictionary&) = delete;
+    ZstdDictionary& operator=(const ZstdDictionary&) = delete;
+    ~ZstdDictionary() noexcept;
+
+    /// @brief Compress a buffer with this dictionary. Safe to call from
+    /// multiple threads at once.
+    /// @param src The buffer to compress.
+    /// @param bytes_of_src The size of @p src, in bytes.
+    /// @param dst The buffer to write compressed data to.
+    /// @param bytes_of_dst The capacity of @p dst, in bytes. At least
+    /// `compress_bound(bytes_of_src)` is always enough.
+    /// @return The number of bytes written to @p dst.
+    /// @throw std::runtime_error if compression fails.
+    size_t compress(const uint8_t* src,
+                    size_t bytes_of_src,
+                    uint8_t* dst,
+                    size_t bytes_of_dst) const;
+
+    /// @brief The largest size compressing @p bytes_of_src bytes can produce.
+    static size_t compress_bound(size_t bytes_of_src) noexcept;
+
+    const std::vector<uint8_t>& data() const noexcept;
+    int clevel() const noexcept;
+
+  private:
+    std::vector<uint8_t> dictionary_;
+    int clevel_;
+    ZSTD_CDict_s* cdict_;
+};
+
+/// @brief Train a zstd dictionary on a set of sample chunks.
+/// @param samples The chunks to train on.
+/// @param capacity The maximum size of the dictionary, in bytes.
+/// @return The trained dictionary, or an empty vector if the samples were not
+/// enough to train one.
+std::vector<uint8_t>
+train_zstd_dictionary(const std::vector<std::span<const uint8_t>>& samples,
+                      size_t capacity);
+
+/// @brief Get the compressor configuration for chunks compressed with a
+/// dictionary.
+/// @param clevel The zstd compression level.
+/// @param dictionary_path The path to the dictionary, relative to the array.
+/// @return A JSON object suitable for the `compressor` field of array
+/// metadata.
+nlohmann::json
+zstd_dictionary_to_json(int clevel, const std::string& dictionary_path);
+} // namespace acquire::sink::zarr
+
+#endif // H_ACQUIRE_ZARR_ZSTD_DICTIONARY_V0
@@ -3,6 +3,9 @@
 #include "writers/zarrv2.writer.hh"
 #include "nlohmann/json.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <fstream>
 #include <tuple> // std::ignore
 
 namespace zarr = acquire::sink::zarr;
@@ -27,6 +30,15 @@ as_path(const StorageProperties& props)
              props.uri.str + offset + props.uri.nbytes - (offset + 1) };
 }
 
+/// \brief Normalize a path so that its filename is its last component, even
+/// if it was given with a trailing separator.
+fs::path
+without_trailing_separator(const fs::path& path)
+{
+    fs::path normal = path.lexically_normal();
+    return normal.has_filename() ? normal : normal.parent_path();
+}
+
 /// \brief Check that the JSON string is valid. (Valid can mean empty.)
 /// \param str Putative JSON metadata string.
 /// \param nbytes Size of the JSON metadata char array
@@ -102,6 +114,250 @@ validate_dimension(const zarr::Dimension& dim, bool is_append)
     EXPECT(dim.chunk_size_px > 0, "Dimension chunk size must be positive.");
 }
 
+/// \brief Get the device options from the external metadata.
+/// \return The options object, or an empty object if there are none.
+json
+options_from_metadata(const std::string& metadata_json)
+{
+    if (metadata_json.empty()) {
+        return json::object();
+    }
+
+    const auto metadata = json::parse(metadata_json,
+                                      nullptr, // callback
+                                      true,    // allow exceptions
+                                      true     // ignore comments
+    );
+    if (!metadata.is_object() || !metadata.contains(zarr::Zarr::options_key)) {
+        return json::object();
+    }
+
+    const auto& options = metadata.at(zarr::Zarr::options_key);
+    EXPECT(options.is_object(),
+           "Expected \"%s\" to be an object.",
+           zarr::Zarr::options_key);
+    return options;
+}
+
+/// \brief Parse a filter option, e.g., `{"id": "bitround", "keepbits": 8}`.
+zarr::FilterParams
+parse_filter(const json& option)
+{
+    const auto id = option.at("id").get<std::string>();
+    if (id == "delta") {
+        return zarr::FilterParams(zarr::FilterId::Delta);
+    }
+    if (id == "bitround") {
+        const auto keepbits = option.at("keepbits").get<int>();
+        EXPECT(keepbits > 0 && keepbits <= UINT8_MAX,
+               "Invalid keepbits %d.",
+               keepbits);
+        return zarr::FilterParams(zarr::FilterId::BitRound, (uint8_t)keepbits);
+    }
+    if (id == "packbits") {
+        return zarr::FilterParams(zarr::FilterId::PackBits);
+    }
+    if (id == "temporal_delta") {
+        return zarr::FilterParams(zarr::FilterId::TemporalDelta);
+    }
+
+    throw std::runtime_error("Unknown filter \"" + id + "\".");
+}
+
+/// \brief Parse an ingest transform option, e.g.,
+/// `{"roi_x": 64, "roi_width": 512, "binning": 2, "binning_mode": "sum"}`.
+/// \details Fields left out take their defaults: the whole frame, unbinned.
+zarr::IngestTransform
+parse_ingest_transform(const json& option)
+{
+    EXPECT(option.is_object(), "Expected the ingest transform as an object.");
+
+    zarr::IngestTransform transform;
+    transform.roi_x = option.value("roi_x", transform.roi_x);
+    transform.roi_y = option.value("roi_y", transform.roi_y);
+    transform.roi_width = option.value("roi_width", transform.roi_width);
+    transform.roi_height = option.value("roi_height", transform.roi_height);
+    transform.binning = option.value("binning", transform.binning);
+
+    const auto mode = option.value("binning_mode", std::string("mean"));
+    if (mode == "sum") {
+        transform.binning_mode = zarr::BinningMode::Sum;
+    } else if (mode == "mean") {
+        transform.binning_mode = zarr::BinningMode::Mean;
+    } else {
+        throw std::runtime_error("Unknown binning mode \"" + mode + "\".");
+    }
+
+    return transform;
+}
+
+/// \brief Parse a compression option in the form of a Zarr V2 Blosc
+/// compressor, e.g., `{"cname": "zstd", "clevel": 1, "shuffle": 1}`.
+/// \return The compression parameters, or nothing for a null option, i.e.,
+/// raw.
+std::optional<zarr::BloscCompressionParams>
+parse_compression(const json& option)
+{
+    if (option.is_null()) {
+        return std::nullopt;
+    }
+
+    EXPECT(option.is_object(), "Expected compression as an object.");
+    const auto params = option.get<zarr::BloscCompressionParams>();
+    EXPECT(params.codec_id == "zstd" || params.codec_id == "lz4",
+           "Unsupported compressor \"%s\".",
+           params.codec_id.c_str());
+    EXPECT(params.clevel >= 0 && params.clevel <= 9,
+           "Invalid compression level %d.",
+           params.clevel);
+    EXPECT(params.shuffle >= BLOSC_NOSHUFFLE &&
+             params.shuffle <= BLOSC_BITSHUFFLE,
+           "Invalid shuffle %d.",
+           params.shuffle);
+
+    return params;
+}
+
+/// \brief Parse a region of interest option, e.g.,
+/// `{"name": "cell", "x": 0, "y": 0, "width": 64, "height": 64}`, with an
+/// optional `compression` in the form of a Zarr V2 Blosc compressor, e.g.,
+/// `{"cname": "zstd", "clevel": 1, "shuffle": 1}`. Regions are raw otherwise.
+zarr::RoiArrayConfig
+parse_roi_array(const json& option)
+{
+    EXPECT(option.is_object(), "Expected a region of interest as an object.");
+
+    zarr::RoiArrayConfig roi;
+    roi.name = option.at("name").get<std::string>();
+    roi.x = option.value("x", roi.x);
+    roi.y = option.value("y", roi.y);
+    roi.width = option.at("width").get<uint32_t>();
+    roi.height = option.at("height").get<uint32_t>();
+    roi.chunk_width = option.value("chunk_width", roi.chunk_width);
+    roi.chunk_height = option.value("chunk_height", roi.chunk_height);
+
+    if (option.contains("compression")) {
+        roi.compression_params = parse_compression(option.at("compression"));
+    }
+
+    return roi;
+}
+
+// The checks below are shared by the option setters and `set_options_`,
+// which runs all of them before applying any option.
+
+void
+validate_filters(const std::vector<zarr::FilterParams>& filters,
+                 const StoragePropertyMetadata& meta)
+{
+    // Zarr V3 readers ignore codecs they don't know, and would return the
+    // filtered samples as if they were the originals
+    EXPECT(filters.empty() || !meta.sharding_is_supported,
+           "Chunk filters are not supported in Zarr V3.");
+}
+
+void
+validate_zstd_dictionary_bytes(
+  size_t bytes,
+  const std::optional<zarr::BloscCompressionParams>& compression_params,
+  const StoragePropertyMetadata& meta)
+{
+    if (bytes == 0) {
+        return;
+    }
+
+    // Zarr V3 metadata has no way to declare the dictionary
+    EXPECT(!meta.sharding_is_supported,
+           "Zstd dictionaries are not supported in Zarr V3.");
+    EXPECT(compression_params.has_value() &&
+             compression_params->codec_id == "zstd",
+           "A zstd dictionary requires a device that compresses with zstd.");
+    EXPECT(bytes >= zarr::ZstdDictionary::min_bytes,
+           "Expected a zstd dictionary of at least %zu bytes. Got %zu.",
+           zarr::ZstdDictionary::min_bytes,
+           bytes);
+}
+
+void
+validate_roi_arrays(const std::vector<zarr::RoiArrayConfig>& roi_arrays)
+{
+    for (auto i = 0; i < roi_arrays.size(); ++i) {
+        const auto& name = roi_arrays.at(i).name;
+        EXPECT(!name.empty(), "Region of interest must have a name.");
+        EXPECT(!std::all_of(name.begin(),
+                            name.end(),
+                            [](unsigned char c) { return std::isdigit(c); }),
+               "Region of interest name \"%s\" collides with a multiscale "
+               "level.",
+               name.c_str());
+        EXPECT(name.find('/') == std::string::npos,
+               "Region of interest name \"%s\" must not contain '/'.",
+               name.c_str());
+        for (auto j = 0; j < i; ++j) {
+            EXPECT(roi_arrays.at(j).name != name,
+                   "Duplicate region of interest name \"%s\".",
+                   name.c_str());
+        }
+    }
+}
+
+void
+validate_deduplicate_chunks(bool enable, const StoragePropertyMetadata& meta)
+{
+    EXPECT(!enable || meta.sharding_is_supported,
+           "Chunk deduplication requires sharding, i.e., Zarr V3.");
+}
+
+void
+validate_spill_directory(const std::string& spill_directory)
+{
+    EXPECT(spill_directory.empty() || fs::is_directory(spill_directory),
+           "Spill directory %s does not exist.",
+           spill_directory.c_str());
+}
+
+void
+validate_stripe_roots(const std::vector<std::string>& stripe_roots)
+{
+    for (const auto& root : stripe_roots) {
+        EXPECT(fs::is_directory(root),
+               "Stripe root %s does not exist.",
+               root.c_str());
+    }
+}
+
+void
+validate_migration(const std::string& destination_root,
+                   double max_bytes_per_second)
+{
+    EXPECT(destination_root.empty() || fs::is_directory(destination_root),
+           "Migration destination %s does not exist.",
+           destination_root.c_str());
+    EXPECT(max_bytes_per_second >= 0,
+           "Migration rate must not be negative.");
+}
+
+void
+validate_io_limits(double max_bytes_per_second,
+                   double max_writes_per_second,
+                   double burst_seconds)
+{
+    EXPECT(max_bytes_per_second >= 0 && max_writes_per_second >= 0,
+           "I/O limits must not be negative.");
+    EXPECT(burst_seconds >= 0, "I/O burst must not be negative.");
+}
+
+void
+validate_preview_path(const std::string& path)
+{
+    if (!path.empty()) {
+        const auto parent_path = fs::absolute(path).parent_path();
+        EXPECT(fs::is_directory(parent_path),
+               "Expected \"%s\" to be a directory.",
+               parent_path.string().c_str());
+    }
+}
+
 [[nodiscard]] bool
 is_multiscale_supported(const std::vector<zarr::Dimension>& dims)
 {
@@ -141,12 +397,17 @@ scale_image(const VideoFrame* src)
     const auto height = src->shape.dims.height;
     const auto h_pad = height + (height % downscale);
 
+    // read the source in place, following its strides
+    const auto sample_stride = common::sample_stride(src->shape);
+    const auto row_stride = common::row_stride(src->shape);
+
     auto* dst = (VideoFrame*)malloc(sizeof(VideoFrame) +
                                     w_pad * h_pad * factor * sizeof(T));
     memcpy(dst, src, sizeof(VideoFrame));
 
     dst->shape.dims.width = w_pad / downscale;
     dst->shape.dims.height = h_pad / downscale;
+    dst->shape.strides.width = 1;
     dst->shape.strides.height =
       dst->shape.strides.width * dst->shape.dims.width;
     dst->shape.strides.planes =
@@ -167,14 +428,13 @@ scale_image(const VideoFrame* src)
         for (auto col = 0; col < width; col += downscale) {
             const bool pad_width = (col == width - 1 && width != w_pad);
 
-            size_t idx = row * width + col;
+            const size_t idx = row * row_stride + col * sample_stride;
+            const size_t dx = pad_width ? 0 : sample_stride;
+            const size_t dy = pad_height ? 0 : row_stride;
             dst_img[dst_idx++] =
-              (T)(factor *
-                  ((float)src_img[idx] +
-                   (float)src_img[idx + (1 - (int)pad_width)] +
-                   (float)src_img[idx + width * (1 - (int)pad_height)] +
-                   (float)src_img[idx + width * (1 - (int)pad_height) +
-                                  (1 - (int)pad_width)]));
+              (T)(factor * ((float)src_img[idx] + (float)src_img[idx + dx] +
+                            (float)src_img[idx + dy] +
+                            (float)src_img[idx + dy + dx]));
         }
     }
 
@@ -348,9 +608,13 @@ zarr::Zarr::set(const StorageProperties* props)
     //  dataset_root_ should be a string
     dataset_root_ = as_path(*props);
 
+    // keep the last metadata if the options in the new metadata are invalid
+    std::string external_metadata_json = external_metadata_json_;
     if (props->external_metadata_json.str) {
-        external_metadata_json_ = props->external_metadata_json.str;
+        external_metadata_json = props->external_metadata_json.str;
     }
+    set_options_(options_from_metadata(external_metadata_json));
+    external_metadata_json_ = std::move(external_metadata_json);
 
     pixel_scale_um_ = props->pixel_scale_um;
 
@@ -435,6 +699,41 @@ zarr::Zarr::start()
     }
     fs::create_directories(dataset_root_);
 
+    // chunks a previous run striped out
+    for (const auto& stripe_root : stripe_roots_) {
+        const auto stripe = dataset_root_under_(stripe_root);
+        if (fs::exists(stripe)) {
+            std::error_code ec;
+            EXPECT(fs::remove_all(stripe, ec),
+                   R"(Failed to remove folder for "%s": %s)",
+                   stripe.c_str(),
+                   ec.message().c_str());
+        }
+    }
+
+    if (!migration_root_.empty()) {
+        EXPECT(stripe_roots_.empty(),
+               "Cannot migrate striped chunks to bulk storage.");
+
+        const auto destination = dataset_root_under_(migration_root_);
+        if (fs::exists(destination)) {
+            std::error_code ec;
+            EXPECT(fs::remove_all(destination, ec),
+                   R"(Failed to remove folder for "%s": %s)",
+                   destination.c_str(),
+                   ec.message().c_str());
+        }
+        migrator_ = std::make_shared<FileMigrator>(dataset_root_.string(),
+                                                   destination.string(),
+                                                   migration_bytes_per_second_);
+    }
+
+    rate_limiter_ = nullptr;
+    if (io_bytes_per_second_ > 0 || io_writes_per_second_ > 0) {
+        rate_limiter_ = std::make_shared<RateLimiter>(
+          io_bytes_per_second_, io_writes_per_second_, io_burst_seconds_);
+    }
+
     thread_pool_ = std::make_shared<common::ThreadPool>(
       std::thread::hardware_concurrency(),
       [this](const std::string& err) { this->set_error(err); });
@@ -446,6 +745,7 @@ zarr::Zarr::start()
     }
 
     write_fixed_metadata_();
+    last_metadata_write_ = std::chrono::steady_clock::now();
 
     state = DeviceState_Running;
     error_ = false;
@@ -461,7 +761,16 @@ zarr::Zarr::stop() noexcept
         is_ok = 0;
 
         try {
-            // must precede close of chunk file
+            for (auto& writer : writers_) {
+                writer->finalize();
+            }
+            for (auto& writer : roi_writers_) {
+                writer->finalize();
+            }
+
+            // finalizing may change how an array is stored, e.g., a writer
+            // that can't train a zstd dictionary falls back to Blosc, so the
+            // metadata must follow it
             write_mutable_metadata_();
             for (Sink* sink_ : metadata_sinks_) {
                 if (auto* sink = dynamic_cast<FileSink*>(sink_)) {
@@ -470,17 +779,42 @@ zarr::Zarr::stop() noexcept
             }
             metadata_sinks_.clear();
 
-            for (auto& writer : writers_) {
-                writer->finalize();
-            }
-
             // call await_stop() before destroying to give jobs a chance to
             // finish
             thread_pool_->await_stop();
             thread_pool_ = nullptr;
 
+            if (!preview_path_.empty()) {
+                write_preview_file_();
+            }
+
+            if (rate_limiter_ && rate_limiter_->writes_throttled() > 0) {
+                const double seconds_throttled =
+                  std::chrono::duration<double>(
+                    rate_limiter_->time_throttled())
+                    .count();
+                LOG("Throttled %llu chunk writes for %.3f s in all.",
+                    (unsigned long long)rate_limiter_->writes_throttled(),
+                    seconds_throttled);
+            }
+
             // don't clear before all working threads have shut down
             writers_.clear();
+            roi_writers_.clear();
+
+            // every file is closed, so move what's left, metadata last
+            if (migrator_) {
+                std::vector<std::string> metadata_paths;
+                for (const auto& key : metadata_keys_) {
+                    metadata_paths.push_back((dataset_root_ / key).string());
+                }
+                const bool migrated = migrator_->finish(metadata_paths);
+                migrator_ = nullptr;
+                EXPECT(migrated,
+                       "Failed to migrate %s to %s.",
+                       dataset_root_.string().c_str(),
+                       migration_root_.string().c_str());
+            }
 
             // should be empty, but just in case
             for (auto& [_, frame] : scaled_frames_) {
@@ -521,14 +855,55 @@ zarr::Zarr::append(const VideoFrame* frames, size_t nbytes)
         return (const VideoFrame*)p;
     };
 
+    bool preview_published = false;
     for (cur = frames; cur < end; cur = next()) {
-        EXPECT(writers_.at(0)->write(cur), "%s", error_msg_.c_str());
+        const VideoFrame* frame = ingest_ ? ingest_->apply(cur) : cur;
+        EXPECT(writers_.at(0)->write(frame), "%s", error_msg_.c_str());
 
         // multiscale
         if (writers_.size() > 1) {
-            write_multiscale_frames_(cur);
+            write_multiscale_frames_(frame);
         }
+
+        if (!roi_writers_.empty()) {
+            write_roi_frames_(frame);
+        }
+
+        if (preview_ && preview_->offer(frame)) {
+            preview_published = true;
+        }
+    }
+
+    // write the file off this thread, one write at a time; previews published
+    // while a write is in flight wait for the next one, and stop() writes the
+    // last
+    if (preview_published && !preview_path_.empty() &&
+        !preview_write_pending_.exchange(true)) {
+        thread_pool_->push_to_job_queue([this](std::string& err) -> bool {
+            bool success = false;
+            try {
+                write_preview_file_();
+                success = true;
+            } catch (const std::exception& exc) {
+                err = "Failed to write preview: " + std::string(exc.what());
+            } catch (...) {
+                err = "Failed to write preview (unknown)";
+            }
+            preview_write_pending_ = false;
+            return success;
+        });
     }
+
+    // keep the metadata in step with partially filled chunks on storage
+    if (max_flush_latency_ms_ > 0 && !metadata_sinks_.empty()) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now - last_metadata_write_ >=
+            std::chrono::milliseconds(max_flush_latency_ms_)) {
+            write_mutable_metadata_();
+            last_metadata_write_ = now;
+        }
+    }
+
     return nbytes;
 }
 
@@ -542,13 +917,220 @@ zarr::Zarr::reserve_image_shape(const ImageShape* shape)
     // let's check anyway
     CHECK(shape);
 
+    // the writers see frames after the ingest transform, if any
+    ingest_.reset();
+    ImageShape image_shape = *shape;
+    if (ingest_transform_) {
+        ingest_ = std::make_unique<Ingest>(*ingest_transform_, *shape);
+        image_shape = ingest_->shape();
+    }
+
     // image shape should be compatible with first two acquisition dimensions
-    EXPECT(shape->dims.width == acquisition_dimensions_.at(0).array_size_px,
+    EXPECT(image_shape.dims.width ==
+             acquisition_dimensions_.at(0).array_size_px,
            "Image width must match first acquisition dimension.");
-    EXPECT(shape->dims.height == acquisition_dimensions_.at(1).array_size_px,
+    EXPECT(image_shape.dims.height ==
+             acquisition_dimensions_.at(1).array_size_px,
            "Image height must match second acquisition dimension.");
 
-    image_shape_ = *shape;
+    // frames with several channels are split along the channel dimension
+    const auto n_channels = common::channels(image_shape);
+    if (n_channels > 1) {
+        EXPECT(acquisition_dimensions_.size() > 3 &&
+                 acquisition_dimensions_.at(2).kind == DimensionType_Channel &&
+                 acquisition_dimensions_.at(2).array_size_px == n_channels,
+               "Image with %zu channels requires a channel dimension of the "
+               "same size as the third acquisition dimension.",
+               n_channels);
+        EXPECT(!enable_multiscale_,
+               "Multiscale is not supported for images with multiple "
+               "channels.");
+    }
+
+    // fail now, rather than when the writers are made on start
+    for (const auto& filter : filters_) {
+        validate_filter(filter, image_shape.type);
+    }
+
+    for (const auto& roi : roi_arrays_) {
+        EXPECT(roi.width > 0 && roi.height > 0 &&
+                 roi.x + roi.width <= image_shape.dims.width &&
+                 roi.y + roi.height <= image_shape.dims.height,
+               "Region of interest \"%s\" must be a nonempty region of the "
+               "%u x %u frame.",
+               roi.name.c_str(),
+               image_shape.dims.width,
+               image_shape.dims.height);
+    }
+
+    image_shape_ = image_shape;
+}
+
+void
+zarr::Zarr::set_filters(std::vector<FilterParams>&& filters)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot change filters while running.");
+
+    StoragePropertyMetadata meta{};
+    get_meta(&meta);
+    validate_filters(filters, meta);
+    filters_ = std::move(filters);
+}
+
+void
+zarr::Zarr::set_level_compression(
+  std::vector<std::optional<BloscCompressionParams>>&& level_compression_params)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot change compression while running.");
+
+    level_compression_params_ = std::move(level_compression_params);
+}
+
+void
+zarr::Zarr::set_zstd_dictionary_bytes(size_t bytes)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot change the zstd dictionary while running.");
+
+    StoragePropertyMetadata meta{};
+    get_meta(&meta);
+    validate_zstd_dictionary_bytes(bytes, compression_params_(0), meta);
+    zstd_dictionary_bytes_ = bytes;
+}
+
+void
+zarr::Zarr::set_ingest_transform(const IngestTransform& transform)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot set ingest transform while running.");
+    ingest_transform_ = transform;
+}
+
+void
+zarr::Zarr::set_roi_arrays(std::vector<RoiArrayConfig>&& roi_arrays)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot set regions of interest while running.");
+    validate_roi_arrays(roi_arrays);
+    roi_arrays_ = std::move(roi_arrays);
+}
+
+void
+zarr::Zarr::set_chunk_statistics(bool enable)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot toggle chunk statistics while running.");
+    chunk_statistics_ = enable;
+}
+
+void
+zarr::Zarr::set_deduplicate_chunks(bool enable)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot toggle chunk deduplication while running.");
+
+    StoragePropertyMetadata meta{};
+    get_meta(&meta);
+    validate_deduplicate_chunks(enable, meta);
+    deduplicate_chunks_ = enable;
+}
+
+void
+zarr::Zarr::set_chunk_order(ChunkOrder order)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot change chunk order while running.");
+    chunk_order_ = order;
+}
+
+void
+zarr::Zarr::set_max_flush_latency(uint32_t latency_ms)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot change flush latency while running.");
+    max_flush_latency_ms_ = latency_ms;
+}
+
+void
+zarr::Zarr::set_memory_budget(size_t budget_bytes,
+                              const std::string& spill_directory)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot change memory budget while running.");
+    validate_spill_directory(spill_directory);
+    memory_budget_bytes_ = budget_bytes;
+    spill_directory_ = spill_directory;
+}
+
+void
+zarr::Zarr::set_stripe_roots(const std::vector<std::string>& stripe_roots)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot change stripe roots while running.");
+    validate_stripe_roots(stripe_roots);
+
+    std::vector<fs::path> roots;
+    for (const auto& root : stripe_roots) {
+        roots.push_back(fs::absolute(root));
+    }
+    stripe_roots_ = std::move(roots);
+}
+
+void
+zarr::Zarr::set_migration(const std::string& destination_root,
+                          double max_bytes_per_second)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot change migration while running.");
+    validate_migration(destination_root, max_bytes_per_second);
+    migration_root_ =
+      destination_root.empty() ? fs::path() : fs::absolute(destination_root);
+    migration_bytes_per_second_ = max_bytes_per_second;
+}
+
+void
+zarr::Zarr::set_io_limits(double max_bytes_per_second,
+                          double max_writes_per_second,
+                          double burst_seconds)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot change I/O limits while running.");
+    validate_io_limits(
+      max_bytes_per_second, max_writes_per_second, burst_seconds);
+    io_bytes_per_second_ = max_bytes_per_second;
+    io_writes_per_second_ = max_writes_per_second;
+    io_burst_seconds_ = burst_seconds;
+}
+
+void
+zarr::Zarr::set_durability(Durability durability)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot change durability while running.");
+    durability_ = durability;
+}
+
+void
+zarr::Zarr::set_preview(uint32_t max_width,
+                        uint32_t max_height,
+                        double max_rate_hz,
+                        const std::string& path)
+{
+    EXPECT(state != DeviceState_Running,
+           "Cannot configure preview while running.");
+    validate_preview_path(path);
+
+    preview_ = std::make_unique<Preview>(max_width, max_height, max_rate_hz);
+    preview_path_ = path;
+}
+
+bool
+zarr::Zarr::latest_preview(std::vector<uint8_t>& frame,
+                           uint64_t& sequence) const
+{
+    return preview_ && preview_->latest(frame, sequence);
 }
 
 /// Zarr
@@ -565,9 +1147,23 @@ zarr::Zarr::Zarr()
       .destroy = ::zarr_destroy,
       .reserve_image_shape = ::zarr_reserve_image_shape,
   }
-  , thread_pool_{ nullptr }
+  , default_zstd_dictionary_bytes_{ 0 }
+  , zstd_dictionary_bytes_{ 0 }
+  , chunk_statistics_{ false }
+  , deduplicate_chunks_{ false }
+  , chunk_order_{ ChunkOrder::C }
+  , max_flush_latency_ms_{ 0 }
+  , memory_budget_bytes_{ 0 }
+  , migration_bytes_per_second_{ 0 }
+  , io_bytes_per_second_{ 0 }
+  , io_writes_per_second_{ 0 }
+  , io_burst_seconds_{ 0 }
+  , durability_{ Durability::None }
   , pixel_scale_um_{ 1, 1 }
   , enable_multiscale_{ false }
+  , preview_sequence_{ 0 }
+  , preview_write_pending_{ false }
+  , thread_pool_{ nullptr }
   , error_{ false }
 {
 }
@@ -578,6 +1174,17 @@ zarr::Zarr::Zarr(BloscCompressionParams&& compression_params)
     blosc_compression_params_ = std::move(compression_params);
 }
 
+zarr::Zarr::Zarr(
+  std::vector<std::optional<BloscCompressionParams>>&& level_compression_params)
+  : Zarr()
+{
+    EXPECT(!level_compression_params.empty(),
+           "Expected compression parameters for at least one level.");
+    level_compression_params_ = std::move(level_compression_params);
+    blosc_compression_params_ = level_compression_params_.front();
+    default_level_compression_params_ = level_compression_params_;
+}
+
 void
 zarr::Zarr::set_dimensions_(const StorageProperties* props)
 {
@@ -595,6 +1202,163 @@ zarr::Zarr::set_dimensions_(const StorageProperties* props)
     }
 }
 
+void
+zarr::Zarr::set_options_(const nlohmann::json& options)
+{
+    // options left out take their defaults
+    std::vector<FilterParams> filters;
+    auto level_compression = default_level_compression_params_;
+    size_t zstd_dictionary_bytes = default_zstd_dictionary_bytes_;
+    std::optional<IngestTransform> ingest_transform;
+    std::vector<RoiArrayConfig> roi_arrays;
+    bool chunk_statistics = false;
+    bool deduplicate_chunks = false;
+    ChunkOrder chunk_order = ChunkOrder::C;
+    uint32_t max_flush_latency_ms = 0;
+    size_t memory_budget_bytes = 0;
+    std::string spill_directory;
+    std::vector<std::string> stripe_roots;
+    std::string migration_root;
+    double migration_bytes_per_second = 0;
+    double io_bytes_per_second = 0;
+    double io_writes_per_second = 0;
+    double io_burst_seconds = 0;
+    Durability durability = Durability::None;
+    std::unique_ptr<Preview> preview;
+    std::string preview_path;
+
+    for (const auto& [key, value] : options.items()) {
+        if (key == "filters") {
+            EXPECT(value.is_array(), "Expected a list of filters.");
+            for (const auto& filter : value) {
+                filters.push_back(parse_filter(filter));
+            }
+        } else if (key == "level_compression") {
+            EXPECT(value.is_array() && !value.empty(),
+                   "Expected compression parameters for at least one level.");
+            level_compression.clear();
+            for (const auto& params : value) {
+                level_compression.push_back(parse_compression(params));
+            }
+        } else if (key == "zstd_dictionary_bytes") {
+            zstd_dictionary_bytes = value.get<size_t>();
+        } else if (key == "ingest_transform") {
+            ingest_transform = parse_ingest_transform(value);
+        } else if (key == "roi_arrays") {
+            EXPECT(value.is_array(), "Expected a list of regions of interest.");
+            for (const auto& roi : value) {
+                roi_arrays.push_back(parse_roi_array(roi));
+            }
+        } else if (key == "chunk_statistics") {
+            chunk_statistics = value.get<bool>();
+        } else if (key == "deduplicate_chunks") {
+            deduplicate_chunks = value.get<bool>();
+        } else if (key == "chunk_order") {
+            const auto order = value.get<std::string>();
+            if (order == "C") {
+                chunk_order = ChunkOrder::C;
+            } else if (order == "F") {
+                chunk_order = ChunkOrder::F;
+            } else {
+                throw std::runtime_error("Unknown chunk order \"" + order +
+                                         "\".");
+            }
+        } else if (key == "max_flush_latency_ms") {
+            max_flush_latency_ms = value.get<uint32_t>();
+        } else if (key == "memory_budget") {
+            EXPECT(value.is_object(),
+                   "Expected the memory budget as an object.");
+            memory_budget_bytes = value.at("bytes").get<size_t>();
+            spill_directory = value.value("spill_directory", spill_directory);
+        } else if (key == "stripe_roots") {
+            stripe_roots = value.get<std::vector<std::string>>();
+        } else if (key == "migration") {
+            EXPECT(value.is_object(), "Expected the migration as an object.");
+            migration_root = value.at("destination").get<std::string>();
+            migration_bytes_per_second =
+              value.value("max_bytes_per_second", migration_bytes_per_second);
+        } else if (key == "io_limits") {
+            EXPECT(value.is_object(), "Expected the I/O limits as an object.");
+            io_bytes_per_second =
+              value.value("max_bytes_per_second", io_bytes_per_second);
+            io_writes_per_second =
+              value.value("max_writes_per_second", io_writes_per_second);
+            io_burst_seconds = value.value("burst_seconds", io_burst_seconds);
+        } else if (key == "durability") {
+            const auto policy = value.get<std::string>();
+            if (policy == "none") {
+                durability = Durability::None;
+            } else if (policy == "per_rollover") {
+                durability = Durability::PerRollover;
+            } else if (policy == "per_flush") {
+                durability = Durability::PerFlush;
+            } else {
+                throw std::runtime_error("Unknown durability \"" + policy +
+                                         "\".");
+            }
+        } else if (key == "preview") {
+            EXPECT(value.is_object(), "Expected the preview as an object.");
+            preview = std::make_unique<Preview>(
+              value.at("max_width").get<uint32_t>(),
+              value.at("max_height").get<uint32_t>(),
+              value.value("max_rate_hz", Preview::default_max_rate_hz));
+            preview_path = value.value("path", preview_path);
+        } else {
+            throw std::runtime_error("Unknown option \"" + key + "\".");
+        }
+    }
+
+    // check every option before applying any, so that a bad one leaves the
+    // device as it was
+    EXPECT(state != DeviceState_Running,
+           "Cannot change options while running.");
+
+    StoragePropertyMetadata meta{};
+    get_meta(&meta);
+    validate_filters(filters, meta);
+    validate_zstd_dictionary_bytes(zstd_dictionary_bytes,
+                                   level_compression.empty()
+                                     ? blosc_compression_params_
+                                     : level_compression.front(),
+                                   meta);
+    validate_roi_arrays(roi_arrays);
+    validate_deduplicate_chunks(deduplicate_chunks, meta);
+    validate_spill_directory(spill_directory);
+    validate_stripe_roots(stripe_roots);
+    validate_migration(migration_root, migration_bytes_per_second);
+    validate_io_limits(
+      io_bytes_per_second, io_writes_per_second, io_burst_seconds);
+    validate_preview_path(preview_path);
+
+    set_filters(std::move(filters));
+    set_level_compression(std::move(level_compression));
+    set_zstd_dictionary_bytes(zstd_dictionary_bytes);
+    ingest_transform_ = ingest_transform;
+    set_roi_arrays(std::move(roi_arrays));
+    set_chunk_statistics(chunk_statistics);
+    set_deduplicate_chunks(deduplicate_chunks);
+    set_chunk_order(chunk_order);
+    set_max_flush_latency(max_flush_latency_ms);
+    set_memory_budget(memory_budget_bytes, spill_directory);
+    set_stripe_roots(stripe_roots);
+    set_migration(migration_root, migration_bytes_per_second);
+    set_io_limits(io_bytes_per_second, io_writes_per_second, io_burst_seconds);
+    set_durability(durability);
+    preview_ = std::move(preview);
+    preview_path_ = preview_path;
+}
+
+std::optional<zarr::BloscCompressionParams>
+zarr::Zarr::compression_params_(size_t level) const
+{
+    if (level_compression_params_.empty()) {
+        return blosc_compression_params_;
+    }
+
+    return level_compression_params_.at(
+      std::min(level, level_compression_params_.size() - 1));
+}
+
 void
 zarr::Zarr::set_error(const std::string& msg) noexcept
 {
@@ -607,6 +1371,133 @@ zarr::Zarr::set_error(const std::string& msg) noexcept
     }
 }
 
+zarr::ArrayConfig
+zarr::Zarr::make_roi_array_config_(const RoiArrayConfig& roi,
+                                   const std::string& data_root) const
+{
+    std::vector<Dimension> dimensions;
+    for (auto i = 0; i < acquisition_dimensions_.size(); ++i) {
+        const auto& dim = acquisition_dimensions_.at(i);
+        if (i > 1) {
+            dimensions.push_back(dim);
+            continue;
+        }
+
+        const uint32_t array_size_px = i == 0 ? roi.width : roi.height;
+        uint32_t chunk_size_px = i == 0 ? roi.chunk_width : roi.chunk_height;
+        if (chunk_size_px == 0) {
+            chunk_size_px = std::min(dim.chunk_size_px, array_size_px);
+        }
+        CHECK(chunk_size_px);
+
+        const uint32_t n_chunks =
+          (array_size_px + chunk_size_px - 1) / chunk_size_px;
+        const uint32_t shard_size_chunks =
+          dim.shard_size_chunks == 0
+            ? 0
+            : std::min(n_chunks, dim.shard_size_chunks);
+
+        dimensions.emplace_back(
+          dim.name, dim.kind, array_size_px, chunk_size_px, shard_size_chunks);
+    }
+
+    ImageShape image_shape = image_shape_;
+    image_shape.dims.width = roi.width;
+    image_shape.dims.height = roi.height;
+
+    return {
+        .image_shape = image_shape,
+        .dimensions = dimensions,
+        .data_root = data_root,
+        .compression_params = roi.compression_params,
+        .filters = filters_,
+        .chunk_statistics = chunk_statistics_,
+        .deduplicate_chunks = deduplicate_chunks_,
+        .chunk_order = chunk_order_,
+        .max_flush_latency_ms = max_flush_latency_ms_,
+        .memory_budget_bytes = memory_budget_bytes_,
+        .spill_directory = spill_directory_,
+        .stripe_roots = array_stripe_roots_(data_root),
+        .migrator = migrator_,
+        .rate_limiter = rate_limiter_,
+        .durability = durability_,
+    };
+}
+
+fs::path
+zarr::Zarr::dataset_root_under_(const fs::path& root) const
+{
+    return root /
+           without_trailing_separator(dataset_root_).filename();
+}
+
+std::vector<std::string>
+zarr::Zarr::array_stripe_roots_(const fs::path& data_root) const
+{
+    const auto relative_path =
+      data_root.lexically_normal().lexically_relative(
+        without_trailing_separator(dataset_root_));
+
+    std::vector<std::string> roots;
+    for (const auto& stripe_root : stripe_roots_) {
+        const auto root = dataset_root_under_(stripe_root) / relative_path;
+        roots.push_back(root.string());
+    }
+    return roots;
+}
+
+size_t
+zarr::Zarr::n_arrays_() const noexcept
+{
+    return writers_.size() + roi_writers_.size();
+}
+
+const zarr::Writer&
+zarr::Zarr::array_writer_(size_t array_idx) const
+{
+    CHECK(array_idx < n_arrays_());
+    if (array_idx < writers_.size()) {
+        return *writers_.at(array_idx);
+    }
+
+    return *roi_writers_.at(array_idx - writers_.size());
+}
+
+json
+zarr::Zarr::make_roi_arrays_metadata_() const
+{
+    json metadata = json::array();
+    for (const auto& roi : roi_arrays_) {
+        metadata.push_back({
+          { "path", roi.name },
+          { "x", roi.x },
+          { "y", roi.y },
+          { "width", roi.width },
+          { "height", roi.height },
+        });
+    }
+
+    return metadata;
+}
+
+nlohmann::json
+zarr::Zarr::external_metadata_() const
+{
+    if (external_metadata_json_.empty()) {
+        return nullptr;
+    }
+
+    auto metadata = json::parse(external_metadata_json_,
+                                nullptr, // callback
+                                true,    // allow exceptions
+                                true     // ignore comments
+    );
+    if (metadata.is_object()) {
+        metadata.erase(options_key);
+    }
+    return metadata;
+}
+
 void
 zarr::Zarr::write_fixed_metadata_() const
 {
@@ -618,9 +1509,38 @@ void
 zarr::Zarr::write_mutable_metadata_() const
 {
     write_group_metadata_();
-    for (auto i = 0; i < writers_.size(); ++i) {
+    for (auto i = 0; i < n_arrays_(); ++i) {
         write_array_metadata_(i);
     }
+    write_consolidated_metadata_();
+}
+
+void
+zarr::Zarr::write_metadata_(size_t sink_idx,
+                            const nlohmann::json& metadata) const
+{
+    const std::string metadata_str = metadata.dump(4);
+    const auto* metadata_bytes = (const uint8_t*)metadata_str.c_str();
+    Sink* sink = metadata_sinks_.at(sink_idx);
+    CHECK(sink->write(0, metadata_bytes, metadata_str.size()));
+
+    consolidated_metadata_[metadata_keys_.at(sink_idx)] = metadata;
+}
+
+void
+zarr::Zarr::write_consolidated_metadata_() const
+{
+    CHECK(!metadata_sinks_.empty());
+
+    const nlohmann::json metadata = {
+        { "zarr_consolidated_format", 1 },
+        { "metadata", consolidated_metadata_ },
+    };
+
+    const std::string metadata_str = metadata.dump(4);
+    const auto* metadata_bytes = (const uint8_t*)metadata_str.c_str();
+    Sink* sink = metadata_sinks_.back();
+    CHECK(sink->write(0, metadata_bytes, metadata_str.size()));
 }
 
 void
@@ -689,6 +1609,63 @@ zarr::Zarr::write_multiscale_frames_(const VideoFrame* frame)
     }
 }
 
+void
+zarr::Zarr::write_roi_frames_(const VideoFrame* frame)
+{
+    CHECK(roi_writers_.size() == roi_arrays_.size());
+
+    // each region is tiled straight out of the frame, following its strides
+    const auto bytes_per_px = bytes_of_type(frame->shape.type);
+    const auto sample_stride = common::sample_stride(frame->shape);
+    const auto row_stride = common::row_stride(frame->shape);
+    const auto bytes_of_data = frame->bytes_of_frame - sizeof(*frame);
+
+    for (auto i = 0; i < roi_arrays_.size(); ++i) {
+        const auto& roi = roi_arrays_.at(i);
+
+        ImageShape shape = frame->shape;
+        shape.dims.width = roi.width;
+        shape.dims.height = roi.height;
+        shape.strides.channels = (int64_t)common::channel_stride(frame->shape);
+        shape.strides.width = (int64_t)sample_stride;
+        shape.strides.height = (int64_t)row_stride;
+
+        const size_t offset =
+          bytes_per_px * (roi.y * row_stride + roi.x * sample_stride);
+        CHECK(offset < bytes_of_data);
+
+        EXPECT(roi_writers_.at(i)->write(
+                 frame->data + offset, bytes_of_data - offset, shape),
+               "%s",
+               error_msg_.c_str());
+    }
+}
+
+void
+zarr::Zarr::write_preview_file_()
+{
+    CHECK(preview_);
+    if (!preview_->latest(preview_frame_, preview_sequence_)) {
+        return;
+    }
+
+    // readers only ever see a whole preview: write it aside, then swap it in
+    auto tmp_path = preview_path_;
+    tmp_path += ".tmp";
+    {
+        std::ofstream f(tmp_path, std::ios::binary | std::ios::trunc);
+        EXPECT(f.is_open(),
+               "Failed to open preview file \"%s\".",
+               tmp_path.string().c_str());
+        f.write((const char*)preview_frame_.data(),
+                (std::streamsize)preview_frame_.size());
+        EXPECT(f.good(),
+               "Failed to write preview file \"%s\".",
+               tmp_path.string().c_str());
+    }
+    fs::rename(tmp_path, preview_path_);
+}
+
 #ifndef NO_UNIT_TESTS
 #ifdef _WIN32
 #define acquire_export __declspec(dllexport)
@@ -733,6 +1710,45 @@ test_average_frame_inner(const SampleType& stype)
     free(dst);
 }
 
+///< Test that a frame with padded rows is read in place.
+template<typename T>
+void
+test_average_padded_frame_inner(const SampleType& stype)
+{
+    // 3x3 samples in rows of 5
+    auto* src = (VideoFrame*)malloc(sizeof(VideoFrame) + 15 * sizeof(T));
+    src->bytes_of_frame = sizeof(*src) + 15 * sizeof(T);
+    src->shape = {
+        .dims = {
+          .channels = 1,
+          .width = 3,
+          .height = 3,
+          .planes = 1,
+        },
+        .strides = {
+          .channels = 1,
+          .width = 1,
+          .height = 5,
+          .planes = 15
+        },
+        .type = stype
+    };
+
+    for (auto i = 0; i < 15; ++i) {
+        ((T*)src->data)[i] = (T)(i % 5 < 3 ? 3 * (i / 5) + i % 5 + 1 : 100);
+    }
+
+    auto dst = scale_image<T>(src);
+    CHECK(dst->shape.strides.height == 2);
+    CHECK(((T*)dst->data)[0] == (T)3);
+    CHECK(((T*)dst->data)[1] == (T)4.5);
+    CHECK(((T*)dst->data)[2] == (T)7.5);
+    CHECK(((T*)dst->data)[3] == (T)9);
+
+    free(src);
+    free(dst);
+}
+
 extern "C" acquire_export int
 unit_test__average_frame()
 {
@@ -742,6 +1758,9 @@ unit_test__average_frame()
         test_average_frame_inner<uint16_t>(SampleType_u16);
         test_average_frame_inner<int16_t>(SampleType_i16);
         test_average_frame_inner<float>(SampleType_f32);
+        test_average_padded_frame_inner<uint8_t>(SampleType_u8);
+        test_average_padded_frame_inner<uint16_t>(SampleType_u16);
+        test_average_padded_frame_inner<float>(SampleType_f32);
     } catch (const std::exception& exc) {
         LOGE("Exception: %s\n", exc.what());
         return 0;
@@ -40,6 +40,10 @@ compressed_zarr_v2_zstd_init();
 struct Storage*
 compressed_zarr_v2_lz4_init();
 struct Storage*
+compressed_zarr_v2_zstd_dictionary_init();
+struct Storage*
+downsampled_compressed_zarr_v2_zstd_init();
+struct Storage*
 zarr_v3_init();
 struct Storage*
 compressed_zarr_v3_zstd_init();
@@ -58,6 +62,8 @@ enum StorageKind
     Storage_ZarrV3,
     Storage_ZarrV3Blosc1ZstdByteShuffle,
     Storage_ZarrV3Blosc1Lz4ByteShuffle,
+    Storage_ZarrZstdDictionary,
+    Storage_ZarrDownsampledBlosc1Zstd9ByteShuffle,
     Storage_Number_Of_Kinds
 };
 
@@ -83,6 +89,8 @@ storage_kind_to_string(const enum StorageKind kind)
         CASE(Storage_ZarrV3);
         CASE(Storage_ZarrV3Blosc1ZstdByteShuffle);
         CASE(Storage_ZarrV3Blosc1Lz4ByteShuffle);
+        CASE(Storage_ZarrZstdDictionary);
+        CASE(Storage_ZarrDownsampledBlosc1Zstd9ByteShuffle);
 #undef CASE
         default:
             return "(unknown)";
@@ -114,6 +122,8 @@ zarr_describe(const struct Driver* driver,
         XXX(ZarrV3),
         XXX(ZarrV3Blosc1ZstdByteShuffle),
         XXX(ZarrV3Blosc1Lz4ByteShuffle),
+        XXX(ZarrZstdDictionary),
+        XXX(ZarrDownsampledBlosc1Zstd9ByteShuffle),
     };
     // clang-format on
 #undef XXX
@@ -179,6 +189,10 @@ acquire_driver_init_v0(acquire_reporter_t reporter)
             [Storage_ZarrV3Blosc1ZstdByteShuffle] =
               compressed_zarr_v3_zstd_init,
             [Storage_ZarrV3Blosc1Lz4ByteShuffle] = compressed_zarr_v3_lz4_init,
+            [Storage_ZarrZstdDictionary] =
+              compressed_zarr_v2_zstd_dictionary_init,
+            [Storage_ZarrDownsampledBlosc1Zstd9ByteShuffle] =
+              downsampled_compressed_zarr_v2_zstd_init,
         };
         memcpy(
           globals.constructors, impls, nbytes); // cppcheck-suppress uninitvar
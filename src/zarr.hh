@@ -4,13 +4,19 @@
 #include "device/kit/storage.h"
 
 #include "common.hh"
+#include "ingest.transform.hh"
+#include "preview.hh"
 #include "writers/writer.hh"
 #include "writers/blosc.compressor.hh"
 
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <map>
+#include <memory>
 #include <optional>
 #include <stdexcept>
+#include <string>
 #include <utility> // std::pair
 #include <vector>
 
@@ -18,11 +24,36 @@ namespace fs = std::filesystem;
 
 namespace acquire::sink::zarr {
 
+/// @brief A rectangular region of each frame, written to its own array in the
+/// same group as the full frame.
+struct RoiArrayConfig
+{
+    /// The path of the array, relative to the group. Must not be a number,
+    /// which would collide with a multiscale level.
+    std::string name;
+
+    /// The region, in pixels of the frames as written, i.e., after any ingest
+    /// transform.
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    /// Chunk sizes along x and y. 0 takes the chunk size of the full-frame
+    /// array, capped at the size of the region.
+    uint32_t chunk_width = 0;
+    uint32_t chunk_height = 0;
+
+    std::optional<BloscCompressionParams> compression_params;
+};
+
 struct Zarr : public Storage
 {
   public:
     Zarr();
     explicit Zarr(BloscCompressionParams&& compression_params);
+    explicit Zarr(std::vector<std::optional<BloscCompressionParams>>&&
+                    level_compression_params);
     virtual ~Zarr() noexcept = default;
 
     /// Storage interface
@@ -34,12 +65,140 @@ struct Zarr : public Storage
     size_t append(const VideoFrame* frames, size_t nbytes);
     void reserve_image_shape(const ImageShape* shape);
 
+    /// @brief The key of the object in the external metadata that holds
+    /// device options. `set()` applies the options, with any left out taking
+    /// their defaults, and the object is left out of the metadata written to
+    /// the dataset.
+    static constexpr char options_key[] = "acquire_zarr_options";
+
+    /// @brief Apply @p filters, in order, to the chunks of every array.
+    void set_filters(std::vector<FilterParams>&& filters);
+
+    /// @brief Compress the array at each multiscale level with the parameters
+    /// at that index, or with the last for every level after it. Null leaves a
+    /// level raw. Empty compresses every level like the full-resolution array
+    /// of the device. Zarr V2 and V3.
+    void set_level_compression(
+      std::vector<std::optional<BloscCompressionParams>>&&
+        level_compression_params);
+
+    /// @brief Compress chunks with zstd, primed with a dictionary of at most
+    /// @p bytes trained on each array's first flush, instead of with Blosc.
+    /// Zarr V2 devices that compress with zstd only. 0 compresses with Blosc.
+    void set_zstd_dictionary_bytes(size_t bytes);
+
+    /// @brief Crop and bin each frame before it is written. Must be set
+    /// before the image shape is reserved, which validates it against the
+    /// incoming frames. The acquisition dimensions describe the transformed
+    /// frames.
+    void set_ingest_transform(const IngestTransform& transform);
+
+    /// @brief Write rectangular regions of each frame to their own arrays,
+    /// each with its own chunking and compression, in addition to the full
+    /// frame. Regions are validated when the image shape is reserved.
+    void set_roi_arrays(std::vector<RoiArrayConfig>&& roi_arrays);
+
+    /// @brief Compute per-chunk statistics while tiling and store them
+    /// alongside each array's chunks.
+    void set_chunk_statistics(bool enable);
+
+    /// @brief Write repeated chunks, e.g., of dark frames, only once per
+    /// shard. Zarr V3 only.
+    void set_deduplicate_chunks(bool enable);
+
+    /// @brief Store the samples of each chunk in @p order. Column-major order
+    /// makes each pixel's time series contiguous within a chunk.
+    void set_chunk_order(ChunkOrder order);
+
+    /// @brief Write partially filled chunks, and the metadata describing
+    /// them, when a frame arrives more than @p latency_ms milliseconds after
+    /// the last write. Only frames trigger writes, so the frames before a
+    /// pause wait for the next frame or stop(). 0 writes chunks only when they
+    /// are full.
+    void set_max_flush_latency(uint32_t latency_ms);
+
+    /// @brief If the chunks each array holds between flushes would take more
+    /// than @p budget_bytes, back the excess of the uncompressed chunks with
+    /// scratch files in @p spill_directory (the system temporary directory if
+    /// empty) instead of allocating it. 0 always allocates.
+    void set_memory_budget(size_t budget_bytes,
+                           const std::string& spill_directory);
+
+    /// @brief Stripe the chunk or shard files of every array across
+    /// @p stripe_roots, e.g., one directory on each of several drives, to
+    /// multiply write bandwidth. Files are spread round-robin in chunk order
+    /// under a directory named after the dataset in each root, and linked
+    /// into the dataset with symbolic links. Empty writes files in place.
+    void set_stripe_roots(const std::vector<std::string>& stripe_roots);
+
+    /// @brief Move chunk or shard files to @p destination_root, e.g., on
+    /// bulk network storage, in the background as they are closed, copying at
+    /// most @p max_bytes_per_second (0 for no limit) while acquiring. The
+    /// dataset lands in a directory named after it, with the metadata moved
+    /// last, before `stop()` returns. Empty disables migration.
+    void set_migration(const std::string& destination_root,
+                       double max_bytes_per_second);
+
+    /// @brief Cap the bandwidth and write rate of chunk or shard files across
+    /// every array, so that flushes don't starve other writers of the disk.
+    /// Up to @p burst_seconds worth of each cap is written at once after a
+    /// pause. 0 lifts a cap.
+    void set_io_limits(double max_bytes_per_second,
+                       double max_writes_per_second,
+                       double burst_seconds);
+
+    /// @brief Force chunk or shard files out to storage at rollover or after
+    /// every flush, rather than whenever the OS gets to them, bounding how
+    /// much of an acquisition is lost if the machine goes down.
+    void set_durability(Durability durability);
+
+    /// @brief Keep a decimated copy of the latest frame, at most
+    /// @p max_width x @p max_height and refreshed at most @p max_rate_hz times
+    /// a second, for live display. If @p path isn't empty, new previews are
+    /// also written there by the thread pool, as packed VideoFrames, for GUIs
+    /// in other processes to poll. The file is replaced atomically.
+    void set_preview(uint32_t max_width,
+                     uint32_t max_height,
+                     double max_rate_hz,
+                     const std::string& path);
+
+    /// @brief Copy out the latest preview frame if it is newer than
+    /// @p sequence. Safe to call from any thread; never blocks the writer.
+    /// @return False if previews are disabled or there is nothing newer.
+    bool latest_preview(std::vector<uint8_t>& frame, uint64_t& sequence) const;
+
     /// Error state
     void set_error(const std::string& msg) noexcept;
 
   protected:
     /// static - set on construction
     std::optional<BloscCompressionParams> blosc_compression_params_;
+    // if set, overrides blosc_compression_params_ for each multiscale level,
+    // with the last entry applying to all coarser levels
+    std::vector<std::optional<BloscCompressionParams>>
+      level_compression_params_;
+    // the per-level compression used when the device options leave it out
+    std::vector<std::optional<BloscCompressionParams>>
+      default_level_compression_params_;
+    std::vector<FilterParams> filters_;
+    // the dictionary size used when the device options leave it out
+    size_t default_zstd_dictionary_bytes_;
+    size_t zstd_dictionary_bytes_;
+    bool chunk_statistics_;
+    bool deduplicate_chunks_;
+    ChunkOrder chunk_order_;
+    uint32_t max_flush_latency_ms_;
+    size_t memory_budget_bytes_;
+    std::string spill_directory_;
+    std::vector<fs::path> stripe_roots_;
+    fs::path migration_root_;
+    double migration_bytes_per_second_;
+    double io_bytes_per_second_;
+    double io_writes_per_second_;
+    double io_burst_seconds_;
+    Durability durability_;
+    std::unique_ptr<Preview> preview_;
+    fs::path preview_path_;
 
     /// changes on set
     fs::path dataset_root_;
@@ -51,13 +210,33 @@ struct Zarr : public Storage
     struct ImageShape image_shape_;
     std::vector<Dimension> acquisition_dimensions_;
     std::vector<std::shared_ptr<Writer>> writers_;
+    std::optional<IngestTransform> ingest_transform_;
+    std::unique_ptr<Ingest> ingest_;
+    std::vector<RoiArrayConfig> roi_arrays_;
+    // one per region in roi_arrays_, after the multiscale writers
+    std::vector<std::shared_ptr<Writer>> roi_writers_;
+
+    /// changes on start
+    std::shared_ptr<FileMigrator> migrator_;
+    std::shared_ptr<RateLimiter> rate_limiter_;
 
     /// changes on append
     // scaled frames, keyed by level-of-detail
     std::unordered_map<int, std::optional<VideoFrame*>> scaled_frames_;
+    // the last preview written to preview_path_
+    std::vector<uint8_t> preview_frame_;
+    uint64_t preview_sequence_;
+    // set while a thread pool job writes previews to preview_path_
+    std::atomic<bool> preview_write_pending_;
 
     // changes on flush
     std::vector<Sink*> metadata_sinks_;
+    // the path of each metadata sink, relative to the dataset root
+    std::vector<std::string> metadata_keys_;
+    // every metadata document written since start, keyed by path, so that
+    // the consolidated metadata is built from the same JSON
+    mutable nlohmann::json consolidated_metadata_;
+    std::chrono::steady_clock::time_point last_metadata_write_;
 
     /// Multithreading
     std::shared_ptr<common::ThreadPool> thread_pool_;
@@ -69,9 +248,23 @@ struct Zarr : public Storage
 
     /// Setup
     void set_dimensions_(const StorageProperties* props);
+    void set_options_(const nlohmann::json& options);
+    std::optional<BloscCompressionParams> compression_params_(
+      size_t level) const;
     virtual void allocate_writers_() = 0;
+    ArrayConfig make_roi_array_config_(const RoiArrayConfig& roi,
+                                       const std::string& data_root) const;
+    // where this dataset's files go within another root, e.g., a stripe
+    fs::path dataset_root_under_(const fs::path& root) const;
+    std::vector<std::string> array_stripe_roots_(
+      const fs::path& data_root) const;
+
+    /// Arrays, indexed by multiscale level, then by region of interest
+    size_t n_arrays_() const noexcept;
+    const Writer& array_writer_(size_t array_idx) const;
 
     /// Metadata
+    // the consolidated metadata path must come last
     virtual std::vector<std::string> make_metadata_sink_paths_() = 0;
 
     template<SinkCreator SinkCreatorT>
@@ -81,20 +274,44 @@ struct Zarr : public Storage
         SinkCreatorT creator(thread_pool_);
         CHECK(
           creator.create_metadata_sinks(metadata_sink_paths, metadata_sinks_));
+
+        metadata_keys_.clear();
+        for (const auto& path : metadata_sink_paths) {
+            const auto key = fs::path(path).lexically_relative(dataset_root_);
+            metadata_keys_.push_back(key.generic_string());
+        }
+        consolidated_metadata_ = nlohmann::json::object();
     }
 
+    /// @brief Write a metadata document to the sink at @p sink_idx, and
+    /// record it for the consolidated metadata.
+    void write_metadata_(size_t sink_idx,
+                         const nlohmann::json& metadata) const;
+
+    // the external metadata, without the device options, or null if there
+    // is none
+    nlohmann::json external_metadata_() const;
+
     // fixed metadata
     void write_fixed_metadata_() const;
+    nlohmann::json make_roi_arrays_metadata_() const;
     virtual void write_base_metadata_() const = 0;
     virtual void write_external_metadata_() const = 0;
 
     // mutable metadata, changes on flush
     void write_mutable_metadata_() const;
     virtual void write_group_metadata_() const = 0;
-    virtual void write_array_metadata_(size_t level) const = 0;
+    virtual void write_array_metadata_(size_t array_idx) const = 0;
+    void write_consolidated_metadata_() const;
 
     /// Multiscale
     void write_multiscale_frames_(const VideoFrame* frame);
+
+    /// Regions of interest
+    void write_roi_frames_(const VideoFrame* frame);
+
+    /// Preview
+    void write_preview_file_();
 };
 
 } // namespace acquire::sink::zarr
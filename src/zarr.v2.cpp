@@ -21,6 +21,9 @@ compressed_zarr_v2_init()
     }
     return nullptr;
 }
+
+// zstd's default dictionary size
+constexpr size_t default_zstd_dictionary_bytes = 112640;
 } // end ::{anonymous} namespace
 
 /// ZarrV2
@@ -29,6 +32,20 @@ zarr::ZarrV2::ZarrV2(BloscCompressionParams&& compression_params)
 {
 }
 
+zarr::ZarrV2::ZarrV2(BloscCompressionParams&& compression_params,
+                     size_t zstd_dictionary_bytes)
+  : Zarr(std::move(compression_params))
+{
+    default_zstd_dictionary_bytes_ = zstd_dictionary_bytes;
+    zstd_dictionary_bytes_ = zstd_dictionary_bytes;
+}
+
+zarr::ZarrV2::ZarrV2(
+  std::vector<std::optional<BloscCompressionParams>>&& level_compression_params)
+  : Zarr(std::move(level_compression_params))
+{
+}
+
 void
 zarr::ZarrV2::get_meta(StoragePropertyMetadata* meta) const
 {
@@ -42,11 +59,23 @@ zarr::ZarrV2::allocate_writers_()
 {
     writers_.clear();
 
+    const auto data_root = dataset_root_ / "0";
     ArrayConfig config = {
         .image_shape = image_shape_,
         .dimensions = acquisition_dimensions_,
-        .data_root = (dataset_root_ / "0").string(),
-        .compression_params = blosc_compression_params_,
+        .data_root = data_root.string(),
+        .compression_params = compression_params_(0),
+        .filters = filters_,
+        .zstd_dictionary_bytes = zstd_dictionary_bytes_,
+        .chunk_statistics = chunk_statistics_,
+        .chunk_order = chunk_order_,
+        .max_flush_latency_ms = max_flush_latency_ms_,
+        .memory_budget_bytes = memory_budget_bytes_,
+        .spill_directory = spill_directory_,
+        .stripe_roots = array_stripe_roots_(data_root),
+        .migrator = migrator_,
+        .rate_limiter = rate_limiter_,
+        .durability = durability_,
     };
     writers_.push_back(std::make_shared<ZarrV2Writer>(config, thread_pool_));
 
@@ -57,6 +86,7 @@ zarr::ZarrV2::allocate_writers_()
         int level = 1;
         while (do_downsample) {
             do_downsample = downsample(config, downsampled_config);
+            downsampled_config.compression_params = compression_params_(level);
             writers_.push_back(
               std::make_shared<ZarrV2Writer>(downsampled_config, thread_pool_));
             scaled_frames_.emplace(level++, std::nullopt);
@@ -65,6 +95,14 @@ zarr::ZarrV2::allocate_writers_()
             downsampled_config = {};
         }
     }
+
+    roi_writers_.clear();
+    for (const auto& roi : roi_arrays_) {
+        const auto roi_config =
+          make_roi_array_config_(roi, (dataset_root_ / roi.name).string());
+        roi_writers_.push_back(
+          std::make_shared<ZarrV2Writer>(roi_config, thread_pool_));
+    }
 }
 
 std::vector<std::string>
@@ -80,6 +118,11 @@ zarr::ZarrV2::make_metadata_sink_paths_()
         metadata_sink_paths.push_back(
           (dataset_root_ / std::to_string(i) / ".zarray").string());
     }
+    for (const auto& roi : roi_arrays_) {
+        metadata_sink_paths.push_back(
+          (dataset_root_ / roi.name / ".zarray").string());
+    }
+    metadata_sink_paths.push_back((dataset_root_ / ".zmetadata").string());
 
     return metadata_sink_paths;
 }
@@ -91,10 +134,7 @@ zarr::ZarrV2::write_base_metadata_() const
     using json = nlohmann::json;
 
     const json metadata = { { "zarr_format", 2 } };
-    const std::string metadata_str = metadata.dump(4);
-    const auto* metadata_bytes = (const uint8_t*)metadata_str.c_str();
-    Sink* sink = metadata_sinks_.at(0);
-    CHECK(sink->write(0, metadata_bytes, metadata_str.size()));
+    write_metadata_(0, metadata);
 }
 
 void
@@ -103,18 +143,8 @@ zarr::ZarrV2::write_external_metadata_() const
     namespace fs = std::filesystem;
     using json = nlohmann::json;
 
-    std::string zattrs_path = (dataset_root_ / "0" / ".zattrs").string();
-    std::string metadata_str = external_metadata_json_.empty()
-                                 ? "{}"
-                                 : json::parse(external_metadata_json_,
-                                               nullptr, // callback
-                                               true,    // allow exceptions
-                                               true     // ignore comments
-                                               )
-                                     .dump(4);
-    const auto* metadata_bytes = (const uint8_t*)metadata_str.c_str();
-    Sink* sink = metadata_sinks_.at(1);
-    CHECK(sink->write(0, metadata_bytes, metadata_str.size()));
+    const json metadata = external_metadata_();
+    write_metadata_(1, metadata.is_null() ? json::object() : metadata);
 }
 
 void
@@ -215,26 +245,26 @@ zarr::ZarrV2::write_group_metadata_() const
         };
     }
 
-    const std::string metadata_str = metadata.dump(4);
-    const auto* metadata_bytes = (const uint8_t*)metadata_str.c_str();
-    Sink* sink = metadata_sinks_.at(2);
-    CHECK(sink->write(0, metadata_bytes, metadata_str.size()));
+    if (!roi_arrays_.empty()) {
+        metadata["roi_arrays"] = make_roi_arrays_metadata_();
+    }
+
+    write_metadata_(2, metadata);
 }
 
 void
-zarr::ZarrV2::write_array_metadata_(size_t level) const
+zarr::ZarrV2::write_array_metadata_(size_t array_idx) const
 {
     namespace fs = std::filesystem;
     using json = nlohmann::json;
 
-    CHECK(level < writers_.size());
-    const auto& writer = writers_.at(level);
+    const auto& writer = array_writer_(array_idx);
 
-    const ArrayConfig& config = writer->config();
+    const ArrayConfig& config = writer.config();
     const auto& image_shape = config.image_shape;
 
     std::vector<size_t> array_shape;
-    array_shape.push_back(writer->frames_written());
+    array_shape.push_back(writer.frames_written());
     for (auto dim = config.dimensions.rbegin() + 1;
          dim != config.dimensions.rend();
          ++dim) {
@@ -253,20 +283,28 @@ zarr::ZarrV2::write_array_metadata_(size_t level) const
     metadata["chunks"] = chunk_shape;
     metadata["dtype"] = common::sample_type_to_dtype(image_shape.type);
     metadata["fill_value"] = 0;
-    metadata["order"] = "C";
-    metadata["filters"] = nullptr;
+    metadata["order"] = chunk_order_to_string(config.chunk_order);
+    if (config.filters.empty()) {
+        metadata["filters"] = nullptr;
+    } else {
+        metadata["filters"] = json::array();
+        for (const auto& filter : config.filters) {
+            metadata["filters"].push_back(
+              filter_to_json(filter, image_shape.type));
+        }
+    }
     metadata["dimension_separator"] = "/";
 
-    if (config.compression_params.has_value()) {
+    if (config.zstd_dictionary_bytes > 0) {
+        metadata["compressor"] = zstd_dictionary_to_json(
+          config.compression_params->clevel, ZstdDictionary::filename);
+    } else if (config.compression_params.has_value()) {
         metadata["compressor"] = config.compression_params.value();
     } else {
         metadata["compressor"] = nullptr;
     }
 
-    const std::string metadata_str = metadata.dump(4);
-    const auto* metadata_bytes = (const uint8_t*)metadata_str.c_str();
-    Sink* sink = metadata_sinks_.at(3 + level);
-    CHECK(sink->write(0, metadata_bytes, metadata_str.size()));
+    write_metadata_(3 + array_idx, metadata);
 }
 
 extern "C"
@@ -291,4 +329,41 @@ extern "C"
     {
         return compressed_zarr_v2_init<zarr::BloscCodecId::Lz4>();
     }
+
+    struct Storage* downsampled_compressed_zarr_v2_zstd_init()
+    {
+        try {
+            // leave full resolution raw for throughput; the coarser levels
+            // are small enough to compress hard
+            std::vector<std::optional<zarr::BloscCompressionParams>> params;
+            params.emplace_back(std::nullopt);
+            params.emplace_back(zarr::BloscCompressionParams(
+              zarr::compression_codec_as_string<zarr::BloscCodecId::Zstd>(),
+              9,
+              1));
+            return new zarr::ZarrV2(std::move(params));
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return nullptr;
+    }
+
+    struct Storage* compressed_zarr_v2_zstd_dictionary_init()
+    {
+        try {
+            zarr::BloscCompressionParams params(
+              zarr::compression_codec_as_string<zarr::BloscCodecId::Zstd>(),
+              1,
+              1);
+            return new zarr::ZarrV2(std::move(params),
+                                    default_zstd_dictionary_bytes);
+        } catch (const std::exception& exc) {
+            LOGE("Exception: %s\n", exc.what());
+        } catch (...) {
+            LOGE("Exception: (unknown)");
+        }
+        return nullptr;
+    }
 }
@@ -9,6 +9,10 @@ struct ZarrV2 final : public Zarr
   public:
     ZarrV2() = default;
     ZarrV2(BloscCompressionParams&& compression_params);
+    ZarrV2(BloscCompressionParams&& compression_params,
+           size_t zstd_dictionary_bytes);
+    explicit ZarrV2(std::vector<std::optional<BloscCompressionParams>>&&
+                      level_compression_params);
     ~ZarrV2() override = default;
 
     /// StorageInterface
@@ -27,7 +31,7 @@ struct ZarrV2 final : public Zarr
 
     // mutable metadata, changes on flush
     void write_group_metadata_() const override;
-    void write_array_metadata_(size_t level) const override;
+    void write_array_metadata_(size_t array_idx) const override;
 };
 } // namespace acquire::sink::zarr
 
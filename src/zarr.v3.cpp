@@ -35,11 +35,23 @@ zarr::ZarrV3::allocate_writers_()
 {
     writers_.clear();
 
+    const auto data_root = dataset_root_ / "data" / "root" / "0";
     ArrayConfig config = {
         .image_shape = image_shape_,
         .dimensions = acquisition_dimensions_,
-        .data_root = (dataset_root_ / "data" / "root" / "0").string(),
-        .compression_params = blosc_compression_params_,
+        .data_root = data_root.string(),
+        .compression_params = compression_params_(0),
+        .filters = filters_,
+        .chunk_statistics = chunk_statistics_,
+        .deduplicate_chunks = deduplicate_chunks_,
+        .chunk_order = chunk_order_,
+        .max_flush_latency_ms = max_flush_latency_ms_,
+        .memory_budget_bytes = memory_budget_bytes_,
+        .spill_directory = spill_directory_,
+        .stripe_roots = array_stripe_roots_(data_root),
+        .migrator = migrator_,
+        .rate_limiter = rate_limiter_,
+        .durability = durability_,
     };
     writers_.push_back(std::make_shared<ZarrV3Writer>(config, thread_pool_));
 
@@ -50,6 +62,7 @@ zarr::ZarrV3::allocate_writers_()
         int level = 1;
         while (do_downsample) {
             do_downsample = downsample(config, downsampled_config);
+            downsampled_config.compression_params = compression_params_(level);
             writers_.push_back(
               std::make_shared<ZarrV3Writer>(downsampled_config, thread_pool_));
             scaled_frames_.emplace(level++, std::nullopt);
@@ -58,6 +71,14 @@ zarr::ZarrV3::allocate_writers_()
             downsampled_config = {};
         }
     }
+
+    roi_writers_.clear();
+    for (const auto& roi : roi_arrays_) {
+        const auto roi_config = make_roi_array_config_(
+          roi, (dataset_root_ / "data" / "root" / roi.name).string());
+        roi_writers_.push_back(
+          std::make_shared<ZarrV3Writer>(roi_config, thread_pool_));
+    }
 }
 
 void
@@ -80,6 +101,13 @@ zarr::ZarrV3::make_metadata_sink_paths_()
                                        (std::to_string(i) + ".array.json"))
                                         .string());
     }
+    for (const auto& roi : roi_arrays_) {
+        metadata_sink_paths.push_back(
+          (dataset_root_ / "meta" / "root" / (roi.name + ".array.json"))
+            .string());
+    }
+    metadata_sink_paths.push_back(
+      (dataset_root_ / "meta" / "root.consolidated.json").string());
 
     return metadata_sink_paths;
 }
@@ -98,10 +126,7 @@ zarr::ZarrV3::write_base_metadata_() const
     metadata["metadata_key_suffix"] = ".json";
     metadata["zarr_format"] = "https://purl.org/zarr/spec/protocol/core/3.0";
 
-    const std::string metadata_str = metadata.dump(4);
-    const auto* metadata_bytes = (const uint8_t*)metadata_str.c_str();
-    Sink* sink = metadata_sinks_.at(0);
-    CHECK(sink->write(0, metadata_bytes, metadata_str.size()));
+    write_metadata_(0, metadata);
 }
 
 /// @brief Write the external metadata.
@@ -122,38 +147,35 @@ zarr::ZarrV3::write_group_metadata_() const
     namespace fs = std::filesystem;
     using json = nlohmann::json;
 
+    const json external_metadata = external_metadata_();
+
     json metadata;
     metadata["attributes"]["acquire"] =
-      external_metadata_json_.empty() ? ""
-                                      : json::parse(external_metadata_json_,
-                                                    nullptr, // callback
-                                                    true,    // allow exceptions
-                                                    true     // ignore comments
-                                        );
-
-    const std::string metadata_str = metadata.dump(4);
-    const auto* metadata_bytes = (const uint8_t*)metadata_str.c_str();
-    Sink* sink = metadata_sinks_.at(1);
-    CHECK(sink->write(0, metadata_bytes, metadata_str.size()));
+      external_metadata.is_null() ? "" : external_metadata;
+
+    if (!roi_arrays_.empty()) {
+        metadata["attributes"]["roi_arrays"] = make_roi_arrays_metadata_();
+    }
+
+    write_metadata_(1, metadata);
 }
 
 void
-zarr::ZarrV3::write_array_metadata_(size_t level) const
+zarr::ZarrV3::write_array_metadata_(size_t array_idx) const
 {
     namespace fs = std::filesystem;
     using json = nlohmann::json;
 
-    CHECK(level < writers_.size());
-    const auto& writer = writers_.at(level);
+    const auto& writer = array_writer_(array_idx);
 
-    const ArrayConfig& config = writer->config();
+    const ArrayConfig& config = writer.config();
     const auto& image_shape = config.image_shape;
 
     json metadata;
     metadata["attributes"] = json::object();
 
     std::vector<size_t> array_shape;
-    array_shape.push_back(writer->frames_written());
+    array_shape.push_back(writer.frames_written());
     for (auto dim = config.dimensions.rbegin() + 1;
          dim != config.dimensions.rend();
          ++dim) {
@@ -178,7 +200,8 @@ zarr::ZarrV3::write_array_metadata_(size_t level) const
       { "type", "regular" },
     });
 
-    metadata["chunk_memory_layout"] = "C";
+    metadata["chunk_memory_layout"] =
+      chunk_order_to_string(config.chunk_order);
     metadata["data_type"] = common::sample_type_to_dtype(image_shape.type);
     metadata["extensions"] = json::array();
     metadata["fill_value"] = 0;
@@ -212,10 +235,7 @@ zarr::ZarrV3::write_array_metadata_(size_t level) const
         }) },
     });
 
-    const std::string metadata_str = metadata.dump(4);
-    const auto* metadata_bytes = (const uint8_t*)metadata_str.c_str();
-    Sink* sink = metadata_sinks_.at(2 + level);
-    CHECK(sink->write(0, metadata_bytes, metadata_str.size()));
+    write_metadata_(2 + array_idx, metadata);
 }
 
 extern "C"
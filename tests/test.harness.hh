@@ -0,0 +1,222 @@
+/// @file test.harness.hh
+/// @brief Scaffolding shared by the integration tests: logging, assertions,
+/// and configuring a simulated camera to stream into a Zarr storage device.
+
+#ifndef H_ACQUIRE_ZARR_TEST_HARNESS_V0
+#define H_ACQUIRE_ZARR_TEST_HARNESS_V0
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "device/hal/device.manager.h"
+#include "acquire.h"
+#include "logger.h"
+
+#include "nlohmann/json.hpp"
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+inline void
+reporter(int is_error,
+         const char* file,
+         int line,
+         const char* function,
+         const char* msg)
+{
+    fprintf(is_error ? stderr : stdout,
+            "%s%s(%d) - %s: %s\n",
+            is_error ? "ERROR " : "",
+            file,
+            line,
+            function,
+            msg);
+}
+
+/// Helper for passing size static strings as function args.
+/// For a function: `f(char*,size_t)` use `f(SIZED("hello"))`.
+/// Expands to `f("hello",5)`.
+#define SIZED(str) str, sizeof(str) - 1
+
+#define L (aq_logger)
+#define LOG(...) L(0, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define ERR(...) L(1, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+#define EXPECT(e, ...)                                                         \
+    do {                                                                       \
+        if (!(e)) {                                                            \
+            char buf[1 << 8] = { 0 };                                          \
+            ERR(__VA_ARGS__);                                                  \
+            snprintf(buf, sizeof(buf) - 1, __VA_ARGS__);                       \
+            throw std::runtime_error(buf);                                     \
+        }                                                                      \
+    } while (0)
+#define CHECK(e) EXPECT(e, "Expression evaluated as false: %s", #e)
+#define DEVOK(e) CHECK(Device_Ok == (e))
+#define OK(e) CHECK(AcquireStatus_Ok == (e))
+
+/// Check that a==b
+/// example: `ASSERT_EQ(int,"%d",42,meaning_of_life())`
+#define ASSERT_EQ(T, fmt, a, b)                                                \
+    do {                                                                       \
+        T a_ = (T)(a);                                                         \
+        T b_ = (T)(b);                                                         \
+        EXPECT(a_ == b_, "Expected %s==%s but " fmt "!=" fmt, #a, #b, a_, b_); \
+    } while (0)
+
+/// Check that a>b
+/// example: `ASSERT_GT(int,"%d",43,meaning_of_life())`
+#define ASSERT_GT(T, fmt, a, b)                                                \
+    do {                                                                       \
+        T a_ = (T)(a);                                                         \
+        T b_ = (T)(b);                                                         \
+        EXPECT(                                                                \
+          a_ > b_, "Expected (%s) > (%s) but " fmt "<=" fmt, #a, #b, a_, b_);  \
+    } while (0)
+
+/// Check that strings a == b
+/// example: `ASSERT_STREQ("foo",container_of_foo)`
+#define ASSERT_STREQ(a, b)                                                     \
+    do {                                                                       \
+        std::string a_ = (a);                                                  \
+        std::string b_ = (b);                                                  \
+        EXPECT(a_ == b_,                                                       \
+               "Expected '%s'=='%s' but '%s'!= '%s'",                          \
+               #a,                                                             \
+               #b,                                                             \
+               a_.c_str(),                                                     \
+               b_.c_str());                                                    \
+    } while (0)
+
+/// @brief An acquisition of single-channel frames into an array with x, y, c,
+/// and t dimensions, chunked along x, y, and t.
+struct AcquisitionShape
+{
+    uint32_t frame_width;
+    uint32_t frame_height;
+    uint32_t chunk_width;
+    uint32_t chunk_height;
+    uint32_t chunk_planes;
+    uint64_t max_frames;
+
+    SampleType type = SampleType_u8;
+
+    /// Chunks per shard along x and y. Ignored by Zarr V2.
+    uint32_t shard_width = 1;
+    uint32_t shard_height = 1;
+
+    /// The array's width and height, if not the frame's, e.g., after an
+    /// ingest transform. 0 for the frame's.
+    uint32_t array_width = 0;
+    uint32_t array_height = 0;
+};
+
+/// @brief Stream the simulated camera matching @p camera into the storage
+/// device named @p storage_kind, writing to @p filename.
+/// @note Doesn't call `acquire_configure`, so that callers can adjust
+/// @p props first. Callers own the storage properties and must destroy them.
+inline void
+configure_acquisition(AcquireRuntime* runtime,
+                      AcquireProperties& props,
+                      const char* camera,
+                      const char* storage_kind,
+                      const char* filename,
+                      const std::string& external_metadata,
+                      const AcquisitionShape& shape)
+{
+    CHECK(runtime);
+    auto dm = acquire_device_manager(runtime);
+    CHECK(dm);
+
+    OK(acquire_get_configuration(runtime, &props));
+
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Camera,
+                                camera,
+                                strlen(camera),
+                                &props.video[0].camera.identifier));
+    DEVOK(device_manager_select(dm,
+                                DeviceKind_Storage,
+                                storage_kind,
+                                strlen(storage_kind),
+                                &props.video[0].storage.identifier));
+
+    const struct PixelScale sample_spacing_um = { 1, 1 };
+
+    CHECK(storage_properties_init(
+      &props.video[0].storage.settings,
+      0,
+      (char*)filename,
+      strlen(filename) + 1,
+      external_metadata.empty() ? nullptr : (char*)external_metadata.c_str(),
+      external_metadata.empty() ? 0 : external_metadata.size() + 1,
+      sample_spacing_um,
+      4));
+
+    const uint32_t array_width =
+      shape.array_width ? shape.array_width : shape.frame_width;
+    const uint32_t array_height =
+      shape.array_height ? shape.array_height : shape.frame_height;
+
+    CHECK(storage_properties_set_dimension(&props.video[0].storage.settings,
+                                           0,
+                                           SIZED("x") + 1,
+                                           DimensionType_Space,
+                                           array_width,
+                                           shape.chunk_width,
+                                           shape.shard_width));
+    CHECK(storage_properties_set_dimension(&props.video[0].storage.settings,
+                                           1,
+                                           SIZED("y") + 1,
+                                           DimensionType_Space,
+                                           array_height,
+                                           shape.chunk_height,
+                                           shape.shard_height));
+    CHECK(storage_properties_set_dimension(&props.video[0].storage.settings,
+                                           2,
+                                           SIZED("c") + 1,
+                                           DimensionType_Channel,
+                                           1,
+                                           1,
+                                           1));
+    CHECK(storage_properties_set_dimension(&props.video[0].storage.settings,
+                                           3,
+                                           SIZED("t") + 1,
+                                           DimensionType_Time,
+                                           0,
+                                           shape.chunk_planes,
+                                           1));
+
+    props.video[0].camera.settings.binning = 1;
+    props.video[0].camera.settings.pixel_type = shape.type;
+    props.video[0].camera.settings.shape = { .x = shape.frame_width,
+                                             .y = shape.frame_height };
+    props.video[0].max_frame_count = shape.max_frames;
+}
+
+/// @brief Configure, start, and stop an acquisition set up by
+/// `configure_acquisition`, then release its storage properties.
+inline void
+acquire_and_stop(AcquireRuntime* runtime, AcquireProperties& props)
+{
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+/// @brief Parse the JSON document at @p path.
+inline json
+read_json(const fs::path& path)
+{
+    EXPECT(fs::is_regular_file(path),
+           "Expected a file at %s",
+           path.string().c_str());
+    std::ifstream f(path);
+    return json::parse(f);
+}
+
+#endif // H_ACQUIRE_ZARR_TEST_HARNESS_V0
@@ -83,21 +83,52 @@ main()
     const std::vector<testcase> tests{
 #define CASE(e) { .name = #e, .test = (int (*)())lib_load(&lib, #e) }
         CASE(unit_test__average_frame),
+        CASE(unit_test__ingest_transform),
+        CASE(unit_test__preview),
         CASE(unit_test__file_creator__create_chunk_sinks),
         CASE(unit_test__file_creator__create_shard_sinks),
+        CASE(unit_test__file_creator__create_nested_chunk_sinks),
+        CASE(unit_test__file_creator__create_trees_under_data_root),
+        CASE(unit_test__file_creator__stripe_chunk_sinks),
+        CASE(unit_test__file_sink__sync),
+        CASE(unit_test__file_migrator),
+        CASE(unit_test__rate_limiter),
         CASE(unit_test__chunk_lattice_index),
         CASE(unit_test__tile_group_offset),
         CASE(unit_test__chunk_internal_offset),
+        CASE(unit_test__compression_threads_per_chunk),
+        CASE(unit_test__thread_pool__borrow_idle_threads),
+        CASE(unit_test__chunk_slab),
+        CASE(unit_test__chunk_statistics),
+        CASE(unit_test__chunk_transpose),
+        CASE(unit_test__is_incompressible),
+        CASE(unit_test__delta_filter),
+        CASE(unit_test__bitround_filter),
+        CASE(unit_test__packbits_filter),
+        CASE(unit_test__zstd_dictionary),
         CASE(unit_test__writer__write_frame_to_chunks),
         CASE(unit_test__downsample_writer_config),
         CASE(unit_test__zarrv2_writer__write_even),
         CASE(unit_test__zarrv2_writer__write_ragged_append_dim),
         CASE(unit_test__shard_index),
         CASE(unit_test__zarrv2_writer__write_ragged_internal_dim),
+        CASE(unit_test__zarrv2_writer__write_with_filters),
+        CASE(unit_test__zarrv2_writer__write_with_temporal_delta),
+        CASE(unit_test__zarrv2_writer__write_with_zstd_dictionary),
+        CASE(unit_test__zarrv2_writer__write_strided_frames),
+        CASE(unit_test__zarrv2_writer__write_interleaved_channels),
+        CASE(unit_test__zarrv2_writer__write_region_of_interest),
+        CASE(unit_test__zarrv2_writer__write_chunk_statistics),
+        CASE(unit_test__zarrv2_writer__write_f_order),
+        CASE(unit_test__zarrv2_writer__write_with_max_latency),
+        CASE(unit_test__zarrv2_writer__write_spilled),
         CASE(unit_test__shard_internal_index),
         CASE(unit_test__zarrv3_writer__write_even),
         CASE(unit_test__zarrv3_writer__write_ragged_append_dim),
         CASE(unit_test__zarrv3_writer__write_ragged_internal_dim),
+        CASE(unit_test__zarrv3_writer__hash_chunk),
+        CASE(unit_test__zarrv3_writer__deduplicate_chunks),
+        CASE(unit_test__zarrv3_writer__write_with_max_latency),
 #undef CASE
     };
 
@@ -0,0 +1,139 @@
+/// @brief Test that Zarr V2 and Zarr V3 acquisitions write consolidated
+/// metadata holding every other metadata document in the dataset, exactly as
+/// it was written to its own file.
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 240;
+const static uint32_t frame_height = 135;
+
+const static uint32_t chunk_width = frame_width / 3;
+const static uint32_t chunk_height = frame_height / 3;
+const static uint32_t chunk_planes = 32;
+
+const static uint64_t max_frames = 48;
+
+void
+acquire(AcquireRuntime* runtime,
+        const char* storage_kind,
+        const char* filename,
+        bool enable_multiscale)
+{
+    AcquireProperties props = {};
+
+    const char external_metadata[] = R"({"hello":"world"})";
+
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          storage_kind,
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+/// Check that @p consolidated holds the document at @p key, as written.
+void
+verify_document(const fs::path& root, const json& consolidated, const char* key)
+{
+    const auto path = root / key;
+    CHECK(fs::is_regular_file(path));
+
+    std::ifstream f(path);
+    EXPECT(consolidated.contains(key), "Expected %s to be consolidated", key);
+    EXPECT(consolidated[key] == json::parse(f),
+           "Expected consolidated %s to match the file",
+           key);
+}
+
+void
+validate_v2()
+{
+    const fs::path root(TEST "-v2.zarr");
+    CHECK(fs::is_directory(root));
+
+    const auto zmetadata_path = root / ".zmetadata";
+    CHECK(fs::is_regular_file(zmetadata_path));
+
+    std::ifstream f(zmetadata_path);
+    const json zmetadata = json::parse(f);
+    ASSERT_EQ(int, "%d", 1, zmetadata["zarr_consolidated_format"]);
+
+    const auto& consolidated = zmetadata["metadata"];
+    verify_document(root, consolidated, ".zattrs");
+    verify_document(root, consolidated, "0/.zattrs");
+
+    // 240x135 -> 120x68 -> 60x34, which fits in a single chunk
+    verify_document(root, consolidated, "0/.zarray");
+    verify_document(root, consolidated, "1/.zarray");
+    verify_document(root, consolidated, "2/.zarray");
+    CHECK(!fs::exists(root / "3"));
+    CHECK(!consolidated.contains("3/.zarray"));
+
+    // the consolidated metadata doesn't list itself
+    CHECK(!consolidated.contains(".zmetadata"));
+
+    // and it reflects the final shape of each array
+    ASSERT_EQ(int, "%d", max_frames, consolidated["0/.zarray"]["shape"][0]);
+}
+
+void
+validate_v3()
+{
+    const fs::path root(TEST "-v3.zarr");
+    CHECK(fs::is_directory(root));
+
+    const auto consolidated_path = root / "meta" / "root.consolidated.json";
+    CHECK(fs::is_regular_file(consolidated_path));
+
+    std::ifstream f(consolidated_path);
+    const json metadata = json::parse(f);
+    ASSERT_EQ(int, "%d", 1, metadata["zarr_consolidated_format"]);
+
+    const auto& consolidated = metadata["metadata"];
+    verify_document(root, consolidated, "zarr.json");
+    verify_document(root, consolidated, "meta/root.group.json");
+    verify_document(root, consolidated, "meta/root/0.array.json");
+    CHECK(!consolidated.contains("meta/root.consolidated.json"));
+
+    ASSERT_EQ(int,
+              "%d",
+              max_frames,
+              consolidated["meta/root/0.array.json"]["shape"][0]);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime, "Zarr", TEST "-v2.zarr", true);
+        validate_v2();
+
+        acquire(runtime, "ZarrV3", TEST "-v3.zarr", false);
+        validate_v3();
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
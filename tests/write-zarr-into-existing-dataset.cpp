@@ -0,0 +1,167 @@
+/// @brief Test that acquiring again into the path of an earlier acquisition
+/// leaves each chunk or shard file at exactly the size of what was written
+/// to it, when the earlier files were larger, for Zarr V2 and Zarr V3.
+
+#include "test.harness.hh"
+
+#include <algorithm>
+#include <vector>
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+const static uint32_t chunks_in_x = 2;
+const static uint32_t chunks_in_y = 2;
+
+// one shard holds all 2 x 2 chunks of a frame
+const static uint32_t shard_width = 2;
+const static uint32_t shard_height = 2;
+const static uint32_t chunks_per_shard = shard_width * shard_height;
+
+const static auto max_frames = 16;
+
+// Blosc header layout: version, versionlz, flags, typesize, then nbytes,
+// blocksize, and cbytes as little-endian 32-bit integers
+const static size_t blosc_header_bytes = 16;
+
+void
+acquire(AcquireRuntime* runtime,
+        const char* camera,
+        const char* storage_kind,
+        const char* filename)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          camera,
+                          storage_kind,
+                          filename,
+                          "",
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames,
+                            .shard_width = shard_width,
+                            .shard_height = shard_height });
+    acquire_and_stop(runtime, props);
+}
+
+uint32_t
+read_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+/// @return The total size of every chunk file of the dataset at @p root,
+/// after checking that each ends where its Blosc frame does.
+size_t
+validate_v2(const fs::path& root)
+{
+    CHECK(fs::is_directory(root));
+
+    size_t bytes_of_chunks = 0;
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        for (auto y = 0; y < chunks_in_y; ++y) {
+            for (auto x = 0; x < chunks_in_x; ++x) {
+                const auto chunk_path = root / "0" / std::to_string(t) / "0" /
+                                        std::to_string(y) / std::to_string(x);
+                CHECK(fs::is_regular_file(chunk_path));
+                const auto file_size = fs::file_size(chunk_path);
+
+                uint8_t header[blosc_header_bytes];
+                std::ifstream f(chunk_path, std::ios::binary);
+                f.read((char*)header, sizeof(header));
+                CHECK(f.good());
+
+                ASSERT_EQ(int, "%d", read_u32(header + 12), file_size);
+                bytes_of_chunks += file_size;
+            }
+        }
+    }
+
+    return bytes_of_chunks;
+}
+
+/// @return The total size of every shard file of the dataset at @p root,
+/// after checking that each ends with its index, right after its last chunk.
+size_t
+validate_v3(const fs::path& root)
+{
+    CHECK(fs::is_directory(root));
+
+    // an offset and a size for each chunk in the shard
+    const auto index_bytes = 2 * sizeof(uint64_t) * chunks_per_shard;
+
+    size_t bytes_of_shards = 0;
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        const auto shard_path = root / "data" / "root" / "0" /
+                                ("c" + std::to_string(t)) / "0" / "0" / "0";
+        CHECK(fs::is_regular_file(shard_path));
+        const auto file_size = fs::file_size(shard_path);
+
+        std::vector<uint64_t> index(2 * chunks_per_shard);
+        std::ifstream f(shard_path, std::ios::binary);
+        f.seekg(-(std::streamoff)index_bytes, std::ios::end);
+        f.read((char*)index.data(), index_bytes);
+        CHECK(f.good());
+
+        uint64_t end_of_chunks = 0;
+        for (auto i = 0; i < chunks_per_shard; ++i) {
+            end_of_chunks =
+              std::max(end_of_chunks, index.at(2 * i) + index.at(2 * i + 1));
+        }
+        ASSERT_EQ(int, "%d", end_of_chunks + index_bytes, file_size);
+        bytes_of_shards += file_size;
+    }
+
+    return bytes_of_shards;
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        // noise doesn't compress, and empty frames compress well, so the
+        // second acquisition writes less than the first
+        acquire(runtime,
+                "simulated.*random.*",
+                "ZarrBlosc1ZstdByteShuffle",
+                TEST "-v2.zarr");
+        const auto v2_bytes_first = validate_v2(TEST "-v2.zarr");
+        acquire(runtime,
+                "simulated.*empty.*",
+                "ZarrBlosc1ZstdByteShuffle",
+                TEST "-v2.zarr");
+        ASSERT_GT(int, "%d", v2_bytes_first, validate_v2(TEST "-v2.zarr"));
+
+        acquire(runtime,
+                "simulated.*random.*",
+                "ZarrV3Blosc1ZstdByteShuffle",
+                TEST "-v3.zarr");
+        const auto v3_bytes_first = validate_v3(TEST "-v3.zarr");
+        acquire(runtime,
+                "simulated.*empty.*",
+                "ZarrV3Blosc1ZstdByteShuffle",
+                TEST "-v3.zarr");
+        ASSERT_GT(int, "%d", v3_bytes_first, validate_v3(TEST "-v3.zarr"));
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,209 @@
+/// @brief Test that an acquisition to Zarr with per-level compression writes
+/// the full-resolution layer raw and the downsampled layers compressed with
+/// zstd at level 9, and that each layer's metadata declares its compressor.
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 1920;
+const static uint32_t frame_height = 1080;
+
+const static uint32_t chunk_width = frame_width / 3;
+const static uint32_t chunk_height = frame_height / 3;
+const static uint32_t chunk_planes = 72;
+
+const static auto max_frames = 74;
+
+void
+acquire(AcquireRuntime* runtime, const char* filename)
+{
+    AcquireProperties props = {};
+
+    const char external_metadata[] = R"({"hello":"world"})";
+
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "ZarrDownsampledBlosc1Zstd9ByteShuffle",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+struct LayerTestCase
+{
+    int layer;
+    int frame_width;
+    int frame_height;
+    int tile_width;
+    int tile_height;
+    int frames_per_layer;
+    int frames_per_chunk;
+};
+
+void
+verify_layer(const LayerTestCase& test_case)
+{
+    const auto layer = test_case.layer;
+    const auto layer_tile_width = test_case.tile_width;
+    const auto layer_frame_width = test_case.frame_width;
+    const auto layer_tile_height = test_case.tile_height;
+    const auto layer_frame_height = test_case.frame_height;
+    const auto frames_per_layer = test_case.frames_per_layer;
+    const auto frames_per_chunk = test_case.frames_per_chunk;
+
+    const auto zarray_path =
+      fs::path(TEST ".zarr") / std::to_string(layer) / ".zarray";
+    CHECK(fs::is_regular_file(zarray_path));
+    CHECK(fs::file_size(zarray_path) > 0);
+
+    // check metadata
+    std::ifstream f(zarray_path);
+    json zarray = json::parse(f);
+
+    const auto shape = zarray["shape"];
+    ASSERT_EQ(int, "%d", frames_per_layer, shape[0]);
+    ASSERT_EQ(int, "%d", 1, shape[1]);
+    ASSERT_EQ(int, "%d", layer_frame_height, shape[2]);
+    ASSERT_EQ(int, "%d", layer_frame_width, shape[3]);
+
+    const auto chunks = zarray["chunks"];
+    ASSERT_EQ(int, "%d", frames_per_chunk, chunks[0].get<int>());
+    ASSERT_EQ(int, "%d", 1, chunks[1].get<int>());
+    ASSERT_EQ(int, "%d", layer_tile_height, chunks[2].get<int>());
+    ASSERT_EQ(int, "%d", layer_tile_width, chunks[3].get<int>());
+
+    const auto compressor = zarray["compressor"];
+    if (layer == 0) {
+        CHECK(compressor.is_null());
+    } else {
+        ASSERT_STREQ("blosc", compressor["id"]);
+        ASSERT_STREQ("zstd", compressor["cname"]);
+        ASSERT_EQ(int, "%d", 9, compressor["clevel"].get<int>());
+        ASSERT_EQ(int, "%d", 1, compressor["shuffle"].get<int>());
+    }
+
+    // check chunked data
+    auto chunk_size = chunks[0].get<int>() * chunks[1].get<int>() *
+                      chunks[2].get<int>() * chunks[3].get<int>();
+
+    const auto tiles_in_x =
+      (uint32_t)std::ceil((float)layer_frame_width / (float)layer_tile_width);
+    const auto tiles_in_y =
+      (uint32_t)std::ceil((float)layer_frame_height / (float)layer_tile_height);
+
+    for (auto i = 0; i < tiles_in_y; ++i) {
+        for (auto j = 0; j < tiles_in_x; ++j) {
+            const auto chunk_file_path = fs::path(TEST ".zarr/") /
+                                         std::to_string(layer) / "0" / "0" /
+                                         std::to_string(i) / std::to_string(j);
+            CHECK(fs::is_regular_file(chunk_file_path));
+            if (layer == 0) {
+                ASSERT_EQ(
+                  int, "%d", chunk_size, fs::file_size(chunk_file_path));
+            } else {
+                ASSERT_GT(int, "%d", fs::file_size(chunk_file_path), 0);
+                ASSERT_GT(
+                  int, "%d", chunk_size, fs::file_size(chunk_file_path));
+            }
+        }
+    }
+
+    // check there's not a second chunk in t
+    auto missing_path = fs::path(TEST ".zarr/") / std::to_string(layer) / "1";
+    CHECK(!fs::is_regular_file(missing_path));
+
+    // check there's not a second chunk in z
+    missing_path = fs::path(TEST ".zarr/") / std::to_string(layer) / "0" / "1";
+    CHECK(!fs::is_regular_file(missing_path));
+
+    // check there's no add'l chunks in y
+    missing_path = fs::path(TEST ".zarr/") / std::to_string(layer) / "0" / "0" /
+                   std::to_string(tiles_in_y);
+    CHECK(!fs::is_regular_file(missing_path));
+
+    // check there's no add'l chunks in y
+    missing_path = fs::path(TEST ".zarr/") / std::to_string(layer) / "0" / "0" /
+                   "0" / std::to_string(tiles_in_x);
+    CHECK(!fs::is_regular_file(missing_path));
+}
+
+void
+validate()
+{
+    CHECK(fs::is_directory(TEST ".zarr"));
+
+    const auto external_metadata_path =
+      fs::path(TEST ".zarr") / "0" / ".zattrs";
+    CHECK(fs::is_regular_file(external_metadata_path));
+    CHECK(fs::file_size(external_metadata_path) > 0);
+
+    const auto group_zattrs_path = fs::path(TEST ".zarr") / ".zattrs";
+    CHECK(fs::is_regular_file(group_zattrs_path));
+    CHECK(fs::file_size(group_zattrs_path) > 0);
+
+    // check metadata
+    std::ifstream f(group_zattrs_path);
+    json group_zattrs = json::parse(f);
+
+    const auto multiscales = group_zattrs["multiscales"][0];
+    const auto& datasets = multiscales["datasets"];
+    ASSERT_EQ(int, "%d", 3, datasets.size());
+    for (auto i = 0; i < 3; ++i) {
+        const auto& dataset = datasets.at(i);
+        ASSERT_STREQ(std::to_string(i), dataset["path"]);
+
+        const auto& coord_trans = dataset["coordinateTransformations"][0];
+        ASSERT_STREQ("scale", coord_trans["type"]);
+
+        const auto& scale = coord_trans["scale"];
+        ASSERT_EQ(float, "%f", std::pow(2.f, i), scale[0].get<float>());
+        ASSERT_EQ(float, "%f", 1.f, scale[1].get<float>());
+        ASSERT_EQ(float, "%f", std::pow(2.f, i), scale[2].get<float>());
+        ASSERT_EQ(float, "%f", std::pow(2.f, i), scale[3].get<float>());
+    }
+
+    ASSERT_STREQ(multiscales["type"], "local_mean");
+
+    // verify each layer
+    verify_layer({ 0, 1920, 1080, 640, 360, 74, 72 });
+    verify_layer({ 1, 960, 540, 640, 360, 37, 72 });
+    // rollover doesn't happen here since tile size is less than the specified
+    // tile size
+    verify_layer({ 2, 480, 270, 480, 270, 18, 72 });
+
+    auto missing_path = fs::path(TEST ".zarr/3");
+    CHECK(!fs::exists(missing_path));
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime, TEST ".zarr");
+        validate();
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,117 @@
+/// @brief Test that acquisitions with each durability policy set in the device
+/// options write a complete dataset, and that an unknown policy is rejected.
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+// several rollovers, so files are synced both at flushes and at rollovers
+const static auto max_frames = 32;
+
+void
+configure(AcquireRuntime* runtime,
+          AcquireProperties& props,
+          const char* filename,
+          const std::string& external_metadata)
+{
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "Zarr",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+}
+
+void
+acquire(AcquireRuntime* runtime, const char* filename, const char* durability)
+{
+    const json external_metadata = {
+        { "acquire_zarr_options", { { "durability", durability } } },
+    };
+
+    AcquireProperties props = {};
+    configure(runtime, props, filename, external_metadata.dump());
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+void
+validate(const fs::path& root)
+{
+    CHECK(fs::is_directory(root));
+
+    std::ifstream f(root / "0" / ".zarray");
+    const json zarray = json::parse(f);
+    ASSERT_EQ(int, "%d", max_frames, zarray["shape"][0]);
+
+    // the options aren't written to the dataset
+    f = std::ifstream(root / "0" / ".zattrs");
+    CHECK(json::parse(f) == json::object());
+
+    const auto chunk_bytes = chunk_width * chunk_height * chunk_planes;
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        for (auto y = 0; y < 2; ++y) {
+            for (auto x = 0; x < 2; ++x) {
+                const auto chunk_path = root / "0" / std::to_string(t) / "0" /
+                                        std::to_string(y) / std::to_string(x);
+                CHECK(fs::is_regular_file(chunk_path));
+                ASSERT_EQ(
+                  int, "%d", chunk_bytes, fs::file_size(chunk_path));
+            }
+        }
+    }
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        for (const auto* durability : { "none", "per_rollover", "per_flush" }) {
+            const auto filename =
+              std::string(TEST "-") + durability + ".zarr";
+            acquire(runtime, filename.c_str(), durability);
+            validate(filename);
+        }
+
+        // an unknown policy fails to configure
+        {
+            const json external_metadata = {
+                { "acquire_zarr_options", { { "durability", "always" } } },
+            };
+
+            AcquireProperties props = {};
+            configure(
+              runtime, props, TEST "-always.zarr", external_metadata.dump());
+            CHECK(AcquireStatus_Ok != acquire_configure(runtime, &props));
+            storage_properties_destroy(&props.video[0].storage.settings);
+        }
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,111 @@
+/// @brief Test that chunks of noise are stored raw in Blosc memcpy mode, and
+/// that chunks that compress well are still compressed, by reading the flags
+/// in the Blosc header of each chunk written by a zstd device.
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 256;
+const static uint32_t frame_height = 256;
+
+// chunks must be larger than the 64 KiB block sampled before compressing
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+const static auto max_frames = 16;
+
+// Blosc header layout: version, versionlz, flags, typesize, then nbytes,
+// blocksize, and cbytes as little-endian 32-bit integers
+const static size_t blosc_header_bytes = 16;
+const static uint8_t blosc_memcpyed = 0x2;
+
+void
+acquire(AcquireRuntime* runtime, const char* camera, const char* filename)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          camera,
+                          "ZarrBlosc1ZstdByteShuffle",
+                          filename,
+                          "",
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+    acquire_and_stop(runtime, props);
+}
+
+uint32_t
+read_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+void
+validate(const fs::path& root, bool expect_raw)
+{
+    CHECK(fs::is_directory(root));
+
+    const size_t bytes_of_chunk = chunk_width * chunk_height * chunk_planes;
+
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        for (auto y = 0; y < 2; ++y) {
+            for (auto x = 0; x < 2; ++x) {
+                const auto chunk_path = root / "0" / std::to_string(t) / "0" /
+                                        std::to_string(y) / std::to_string(x);
+                CHECK(fs::is_regular_file(chunk_path));
+                const auto file_size = fs::file_size(chunk_path);
+
+                uint8_t header[blosc_header_bytes];
+                std::ifstream f(chunk_path, std::ios::binary);
+                f.read((char*)header, sizeof(header));
+                CHECK(f.good());
+
+                const auto flags = header[2];
+                const auto nbytes = read_u32(header + 4);
+                const auto cbytes = read_u32(header + 12);
+
+                ASSERT_EQ(int, "%d", bytes_of_chunk, nbytes);
+                ASSERT_EQ(int, "%d", file_size, cbytes);
+
+                if (expect_raw) {
+                    CHECK(flags & blosc_memcpyed);
+                    ASSERT_EQ(
+                      int, "%d", bytes_of_chunk + blosc_header_bytes, cbytes);
+                } else {
+                    CHECK(!(flags & blosc_memcpyed));
+                    ASSERT_GT(int, "%d", bytes_of_chunk, cbytes);
+                }
+            }
+        }
+    }
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime, "simulated.*random.*", TEST "-random.zarr");
+        validate(TEST "-random.zarr", true);
+
+        acquire(runtime, "simulated.*empty.*", TEST "-empty.zarr");
+        validate(TEST "-empty.zarr", false);
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
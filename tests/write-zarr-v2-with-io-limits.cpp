@@ -0,0 +1,111 @@
+/// @brief Test that the I/O limits device option caps the bandwidth of chunk
+/// writes for the device it's given to.
+
+#include <chrono>
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+const static auto max_frames = 32;
+
+const static uint32_t chunk_bytes = chunk_width * chunk_height * chunk_planes;
+const static uint32_t total_bytes =
+  chunk_bytes * 2 * 2 * (max_frames / chunk_planes);
+
+// half the data a second, with no burst: about 2 s of writing
+const static double max_bytes_per_second = total_bytes / 2.;
+
+/// @return The time from starting the acquisition to its stopping, in seconds.
+double
+acquire(AcquireRuntime* runtime,
+        const char* filename,
+        const std::string& external_metadata)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "Zarr",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+
+    const auto start = std::chrono::steady_clock::now();
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+    return std::chrono::duration<double>(elapsed).count();
+}
+
+void
+validate()
+{
+    const fs::path root(TEST ".zarr");
+    CHECK(fs::is_directory(root));
+
+    std::ifstream f(root / "0" / ".zarray");
+    const json zarray = json::parse(f);
+    ASSERT_EQ(int, "%d", max_frames, zarray["shape"][0]);
+
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        for (auto y = 0; y < 2; ++y) {
+            for (auto x = 0; x < 2; ++x) {
+                const auto chunk_path = root / "0" / std::to_string(t) / "0" /
+                                        std::to_string(y) / std::to_string(x);
+                CHECK(fs::is_regular_file(chunk_path));
+                ASSERT_EQ(
+                  int, "%d", chunk_bytes, fs::file_size(chunk_path));
+            }
+        }
+    }
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        const json external_metadata = {
+            { "acquire_zarr_options",
+              { { "io_limits",
+                  { { "max_bytes_per_second", max_bytes_per_second },
+                    { "burst_seconds", 0 } } } } },
+        };
+        const auto elapsed_s =
+          acquire(runtime, TEST ".zarr", external_metadata.dump());
+        LOG("Acquired in %f s", elapsed_s);
+        validate();
+
+        // the writes alone take 2 s; leave room for timer slack
+        EXPECT(elapsed_s >= 1.8,
+               "Expected throttled writes to take at least 1.8 s, took %f s",
+               elapsed_s);
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,146 @@
+/// @brief Test that the max flush latency device option writes partially
+/// filled chunks, and the array metadata describing them, while a slow
+/// acquisition is still running.
+
+#include "test.harness.hh"
+#include "platform.h" // clock
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+
+// far more planes than frames: without a latency bound, nothing is written
+// until the acquisition stops
+const static uint32_t chunk_planes = 64;
+
+const static auto max_frames = 20;
+
+/// Check whether the first chunk and the array metadata describing at least
+/// one frame have reached storage.
+bool
+is_flushed(const fs::path& root)
+{
+    const auto chunk_path = root / "0" / "0" / "0" / "0" / "0";
+    if (!fs::exists(chunk_path) || fs::file_size(chunk_path) == 0) {
+        return false;
+    }
+
+    // the metadata may be caught mid-write
+    std::ifstream f(root / "0" / ".zarray");
+    const json zarray = json::parse(f, nullptr, false);
+    return !zarray.is_discarded() && zarray["shape"][0].get<int>() > 0;
+}
+
+void
+acquire(AcquireRuntime* runtime, const char* filename)
+{
+    AcquireProperties props = {};
+
+    const char external_metadata[] =
+      R"({"acquire_zarr_options": {"max_flush_latency_ms": 50}})";
+
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "Zarr",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+
+    const auto next = [](VideoFrame* cur) -> VideoFrame* {
+        return (VideoFrame*)(((uint8_t*)cur) + cur->bytes_of_frame);
+    };
+
+    const auto consumed_bytes = [](const VideoFrame* const cur,
+                                   const VideoFrame* const end) -> size_t {
+        return (uint8_t*)end - (uint8_t*)cur;
+    };
+
+    struct clock clock;
+    static double time_limit_ms = 20000.0;
+    clock_init(&clock);
+    clock_shift_ms(&clock, time_limit_ms);
+    OK(acquire_start(runtime));
+    {
+        uint64_t nframes = 0;
+        bool flushed_while_running = false;
+        VideoFrame *beg, *end, *cur;
+        do {
+            struct clock throttle;
+            clock_init(&throttle);
+            EXPECT(clock_cmp_now(&clock) < 0,
+                   "Timeout at %f ms",
+                   clock_toc_ms(&clock) + time_limit_ms);
+            OK(acquire_map_read(runtime, 0, &beg, &end));
+            for (cur = beg; cur < end; cur = next(cur)) {
+                ++nframes;
+            }
+            OK(acquire_unmap_read(runtime, 0, consumed_bytes(beg, end)));
+
+            if (nframes < max_frames && is_flushed(filename)) {
+                LOG("Flushed after %d frames", nframes);
+                flushed_while_running = true;
+            }
+            clock_sleep_ms(&throttle, 20.0f);
+        } while (DeviceState_Running == acquire_get_state(runtime) &&
+                 nframes < max_frames && !flushed_while_running);
+
+        CHECK(flushed_while_running);
+    }
+
+    OK(acquire_stop(runtime));
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+void
+validate()
+{
+    const fs::path root(TEST ".zarr");
+    CHECK(fs::is_directory(root));
+
+    std::ifstream f(root / "0" / ".zarray");
+    const json zarray = json::parse(f);
+    ASSERT_EQ(int, "%d", max_frames, zarray["shape"][0]);
+
+    // the last write of each chunk holds every frame
+    const auto chunk_bytes = chunk_width * chunk_height * chunk_planes;
+    for (auto y = 0; y < 2; ++y) {
+        for (auto x = 0; x < 2; ++x) {
+            const auto chunk_path =
+              root / "0" / "0" / "0" / std::to_string(y) / std::to_string(x);
+            CHECK(fs::is_regular_file(chunk_path));
+            ASSERT_EQ(int, "%d", chunk_bytes, fs::file_size(chunk_path));
+        }
+    }
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime, TEST ".zarr");
+        validate();
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,112 @@
+/// @brief Test that the memory budget device option backs chunk buffers with
+/// scratch files in the spill directory, that the chunks written from them are
+/// intact, and that no scratch files are left behind.
+
+#include <algorithm>
+#include <vector>
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+// several flushes, so that the scratch-backed buffers are reused
+const static auto max_frames = 32;
+
+void
+acquire(AcquireRuntime* runtime,
+        const char* filename,
+        const std::string& external_metadata)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "Zarr",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+void
+validate(const fs::path& spill_directory)
+{
+    const fs::path root(TEST ".zarr");
+    CHECK(fs::is_directory(root));
+
+    std::ifstream f(root / "0" / ".zarray");
+    const json zarray = json::parse(f);
+    ASSERT_EQ(int, "%d", max_frames, zarray["shape"][0]);
+
+    const auto chunk_bytes = chunk_width * chunk_height * chunk_planes;
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        for (auto y = 0; y < 2; ++y) {
+            for (auto x = 0; x < 2; ++x) {
+                const auto chunk_path = root / "0" / std::to_string(t) / "0" /
+                                        std::to_string(y) / std::to_string(x);
+                CHECK(fs::is_regular_file(chunk_path));
+                ASSERT_EQ(
+                  int, "%d", chunk_bytes, fs::file_size(chunk_path));
+
+                // frames are empty, and buffers are cleared between flushes
+                std::ifstream chunk(chunk_path, std::ios::binary);
+                std::vector<char> data(chunk_bytes);
+                chunk.read(data.data(), chunk_bytes);
+                CHECK(chunk.good());
+                CHECK(std::all_of(
+                  data.begin(), data.end(), [](char c) { return c == 0; }));
+            }
+        }
+    }
+
+    // scratch files don't outlive the acquisition
+    CHECK(fs::is_empty(spill_directory));
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        const auto spill_directory = fs::absolute(TEST "-spill");
+        fs::remove_all(spill_directory);
+        fs::create_directories(spill_directory);
+
+        // any budget smaller than a flush's worth of chunks spills
+        const json external_metadata = {
+            { "acquire_zarr_options",
+              { { "memory_budget",
+                  { { "bytes", 1 },
+                    { "spill_directory", spill_directory.string() } } } } },
+        };
+        acquire(runtime, TEST ".zarr", external_metadata.dump());
+        validate(spill_directory);
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,109 @@
+/// @brief Test that the migration device option moves the dataset, chunks and
+/// metadata, to a directory named after it under the destination root by the
+/// time the acquisition stops.
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+const static auto max_frames = 32;
+
+void
+acquire(AcquireRuntime* runtime,
+        const char* filename,
+        const std::string& external_metadata)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "Zarr",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+void
+validate(const fs::path& destination_root)
+{
+    // nothing is left behind
+    CHECK(!fs::exists(TEST ".zarr"));
+
+    const auto root = destination_root / TEST ".zarr";
+    CHECK(fs::is_directory(root));
+
+    std::ifstream f(root / "0" / ".zattrs");
+    CHECK(json::parse(f) == json({ { "hello", "world" } }));
+
+    f = std::ifstream(root / "0" / ".zarray");
+    const json zarray = json::parse(f);
+    ASSERT_EQ(int, "%d", max_frames, zarray["shape"][0]);
+
+    // the consolidated metadata moved with the rest
+    f = std::ifstream(root / ".zmetadata");
+    const json zmetadata = json::parse(f);
+    CHECK(zmetadata["metadata"]["0/.zarray"] == zarray);
+
+    const auto chunk_bytes = chunk_width * chunk_height * chunk_planes;
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        for (auto y = 0; y < 2; ++y) {
+            for (auto x = 0; x < 2; ++x) {
+                const auto chunk_path = root / "0" / std::to_string(t) / "0" /
+                                        std::to_string(y) / std::to_string(x);
+                CHECK(fs::is_regular_file(chunk_path));
+                ASSERT_EQ(
+                  int, "%d", chunk_bytes, fs::file_size(chunk_path));
+            }
+        }
+    }
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        const auto destination_root = fs::absolute(TEST "-destination");
+        fs::remove_all(destination_root);
+        fs::create_directories(destination_root);
+
+        // slow enough to still be copying when the acquisition stops
+        const json external_metadata = {
+            { "hello", "world" },
+            { "acquire_zarr_options",
+              { { "migration",
+                  { { "destination", destination_root.string() },
+                    { "max_bytes_per_second", 1e5 } } } } },
+        };
+        acquire(runtime, TEST ".zarr", external_metadata.dump());
+        validate(destination_root);
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,121 @@
+/// @brief Test that the stripe roots device option spreads chunk files across
+/// several directories, each linked into the dataset at its usual path.
+
+#include <set>
+#include <vector>
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+const static auto max_frames = 16;
+
+void
+acquire(AcquireRuntime* runtime,
+        const char* filename,
+        const std::string& external_metadata)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "Zarr",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+void
+validate(const std::vector<fs::path>& stripe_roots)
+{
+    const fs::path root(TEST ".zarr");
+    CHECK(fs::is_directory(root));
+
+    // metadata stays in the dataset
+    CHECK(fs::is_regular_file(root / "0" / ".zarray"));
+    CHECK(!fs::is_symlink(root / "0" / ".zarray"));
+
+    std::set<fs::path> roots_used;
+    const auto chunk_bytes = chunk_width * chunk_height * chunk_planes;
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        for (auto y = 0; y < 2; ++y) {
+            for (auto x = 0; x < 2; ++x) {
+                const auto key = fs::path("0") / std::to_string(t) / "0" /
+                                 std::to_string(y) / std::to_string(x);
+                const auto chunk_path = root / key;
+                CHECK(fs::is_symlink(chunk_path));
+
+                // the link points at the same key under one of the roots
+                const auto target = fs::read_symlink(chunk_path);
+                CHECK(fs::is_regular_file(target));
+                ASSERT_EQ(int, "%d", chunk_bytes, fs::file_size(target));
+
+                bool found = false;
+                for (const auto& stripe_root : stripe_roots) {
+                    if (target == stripe_root / root.filename() / key) {
+                        roots_used.insert(stripe_root);
+                        found = true;
+                    }
+                }
+                EXPECT(found,
+                       "Unexpected link target %s",
+                       target.string().c_str());
+            }
+        }
+    }
+
+    // chunks are spread over every root
+    ASSERT_EQ(int, "%d", stripe_roots.size(), roots_used.size());
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        const std::vector<fs::path> stripe_roots = {
+            fs::absolute(TEST "-stripe-0"),
+            fs::absolute(TEST "-stripe-1"),
+        };
+        json roots = json::array();
+        for (const auto& stripe_root : stripe_roots) {
+            fs::remove_all(stripe_root);
+            fs::create_directories(stripe_root);
+            roots.push_back(stripe_root.string());
+        }
+
+        const json external_metadata = {
+            { "acquire_zarr_options", { { "stripe_roots", roots } } },
+        };
+        acquire(runtime, TEST ".zarr", external_metadata.dump());
+        validate(stripe_roots);
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,129 @@
+/// @brief Test that the temporal delta filter stores the first frame in each
+/// chunk as-is and each frame after it as its difference from the frame before
+/// it, by decoding each chunk with a cumulative sum along time and comparing it
+/// with the statistics computed from the frames as they were tiled.
+
+#include "test.harness.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+const static auto max_frames = 16;
+
+void
+acquire(AcquireRuntime* runtime, const char* filename)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*random.*",
+                          "Zarr",
+                          filename,
+                          R"({"acquire_zarr_options": {
+                                "filters": [{"id": "temporal_delta"}],
+                                "chunk_statistics": true
+                              }})",
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+    acquire_and_stop(runtime, props);
+}
+
+void
+validate()
+{
+    const fs::path root(TEST ".zarr");
+    CHECK(fs::is_directory(root));
+
+    const json zarray = read_json(root / "0" / ".zarray");
+    const json expected_filters = json::array({
+      { { "id", "acquire_temporal_delta" }, { "dtype", "u1" }, { "axis", 0 } },
+    });
+    CHECK(zarray["filters"] == expected_filters);
+
+    std::ifstream f(root / "0" / "chunk_statistics.jsonl");
+    std::string line;
+    CHECK(std::getline(f, line)); // header
+
+    const size_t bytes_of_plane = chunk_width * chunk_height;
+    const size_t bytes_of_chunk = bytes_of_plane * chunk_planes;
+
+    auto n_chunks = 0;
+    bool any_encoded = false;
+    while (std::getline(f, line)) {
+        const json stats = json::parse(line);
+        const auto& key = stats["chunk"];
+        const auto chunk_path = root / "0" / std::to_string(key[0].get<int>()) /
+                                std::to_string(key[1].get<int>()) /
+                                std::to_string(key[2].get<int>()) /
+                                std::to_string(key[3].get<int>());
+        CHECK(fs::is_regular_file(chunk_path));
+        ASSERT_EQ(int, "%d", bytes_of_chunk, fs::file_size(chunk_path));
+
+        std::vector<uint8_t> chunk(bytes_of_chunk);
+        std::ifstream chunk_file(chunk_path, std::ios::binary);
+        chunk_file.read((char*)chunk.data(), chunk.size());
+        CHECK(chunk_file.good());
+
+        // decode with a cumulative sum along time
+        auto decoded = chunk;
+        for (auto i = bytes_of_plane; i < decoded.size(); ++i) {
+            decoded.at(i) += decoded.at(i - bytes_of_plane);
+        }
+        any_encoded = any_encoded || decoded != chunk;
+
+        const auto [min, max] =
+          std::minmax_element(decoded.begin(), decoded.end());
+        ASSERT_EQ(int, "%d", stats["min"].get<int>(), *min);
+        ASSERT_EQ(int, "%d", stats["max"].get<int>(), *max);
+
+        double sum = 0;
+        for (const auto sample : decoded) {
+            sum += sample;
+        }
+        EXPECT(std::abs(sum / decoded.size() - stats["mean"].get<double>()) <
+                 1e-6,
+               "Expected a mean of %g, got %g",
+               stats["mean"].get<double>(),
+               sum / decoded.size());
+
+        ++n_chunks;
+    }
+    ASSERT_EQ(int, "%d", 2 * 2 * (max_frames / chunk_planes), n_chunks);
+
+    // random frames don't repeat, so the stored chunks aren't the frames
+    CHECK(any_encoded);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime, TEST ".zarr");
+        validate();
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,105 @@
+/// @brief Test that an acquisition too short to train a zstd dictionary falls
+/// back to Blosc, and that the array metadata declares Blosc, not the
+/// dictionary codec the device was configured with.
+
+#include "test.harness.hh"
+
+// 4 chunks of 8 frames of 32 x 24 u8 samples: 24 kiB of training samples, far
+// short of what the default 110 kiB dictionary needs
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+const static auto max_frames = 8;
+
+void
+acquire(AcquireRuntime* runtime, const char* filename)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "ZarrZstdDictionary",
+                          filename,
+                          "",
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+void
+validate()
+{
+    const fs::path root(TEST ".zarr");
+    CHECK(fs::is_directory(root));
+
+    // no dictionary was trained
+    CHECK(!fs::exists(root / "0" / "zstd.dict"));
+
+    const auto zarray_path = root / "0" / ".zarray";
+    CHECK(fs::is_regular_file(zarray_path));
+
+    std::ifstream f(zarray_path);
+    const json zarray = json::parse(f);
+    ASSERT_EQ(int, "%d", max_frames, zarray["shape"][0]);
+
+    // the array is declared as it was written
+    const auto& compressor = zarray["compressor"];
+    ASSERT_STREQ("blosc", compressor["id"]);
+    ASSERT_STREQ("zstd", compressor["cname"]);
+    ASSERT_EQ(int, "%d", 1, compressor["clevel"].get<int>());
+    ASSERT_EQ(int, "%d", 1, compressor["shuffle"].get<int>());
+
+    // and so is the consolidated metadata
+    f = std::ifstream(root / ".zmetadata");
+    const json zmetadata = json::parse(f);
+    CHECK(zmetadata["metadata"]["0/.zarray"] == zarray);
+
+    const auto chunk_bytes = chunk_width * chunk_height * chunk_planes;
+    for (auto y = 0; y < 2; ++y) {
+        for (auto x = 0; x < 2; ++x) {
+            const auto chunk_path = root / "0" / "0" / "0" /
+                                    std::to_string(y) / std::to_string(x);
+            CHECK(fs::is_regular_file(chunk_path));
+
+            // empty frames compress well with Blosc
+            const auto file_size = fs::file_size(chunk_path);
+            ASSERT_GT(int, "%d", file_size, 0);
+            ASSERT_GT(int, "%d", chunk_bytes, file_size);
+        }
+    }
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime, TEST ".zarr");
+        validate();
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
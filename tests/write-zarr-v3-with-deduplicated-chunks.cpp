@@ -0,0 +1,95 @@
+/// @brief Test that the chunk deduplication device option writes repeated
+/// chunks, here those of empty frames, once per Zarr V3 shard.
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+// one shard holds all 2 x 2 chunks of a frame
+const static uint32_t shard_width = 2;
+const static uint32_t shard_height = 2;
+const static uint32_t chunks_per_shard = shard_width * shard_height;
+
+const static auto max_frames = 16;
+
+void
+acquire(AcquireRuntime* runtime,
+        const char* filename,
+        const std::string& external_metadata)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "ZarrV3",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames,
+                            .shard_width = shard_width,
+                            .shard_height = shard_height });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+/// Check that every shard of the dataset at @p root holds @p n_chunks_stored
+/// chunks' worth of samples, followed by the shard index.
+void
+validate(const fs::path& root, uint32_t n_chunks_stored)
+{
+    CHECK(fs::is_directory(root));
+
+    const auto chunk_bytes = chunk_width * chunk_height * chunk_planes;
+    // an offset and a size for each chunk in the shard
+    const auto index_bytes = 2 * sizeof(uint64_t) * chunks_per_shard;
+    const auto expected_shard_bytes =
+      n_chunks_stored * chunk_bytes + index_bytes;
+
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        const auto shard_path = root / "data" / "root" / "0" /
+                                ("c" + std::to_string(t)) / "0" / "0" / "0";
+        CHECK(fs::is_regular_file(shard_path));
+        ASSERT_EQ(int, "%d", expected_shard_bytes, fs::file_size(shard_path));
+    }
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime,
+                TEST ".zarr",
+                R"({"acquire_zarr_options": {"deduplicate_chunks": true}})");
+        validate(TEST ".zarr", 1);
+
+        // without the option, every chunk is written
+        acquire(runtime, TEST "-full.zarr", R"({"hello": "world"})");
+        validate(TEST "-full.zarr", chunks_per_shard);
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,104 @@
+/// @brief Test that the chunk statistics device option writes per-chunk
+/// statistics alongside each array's chunks, and that leaving the option out
+/// turns them off again.
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+const static auto max_frames = 16;
+
+void
+acquire(AcquireRuntime* runtime,
+        const char* filename,
+        const std::string& external_metadata)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "Zarr",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+void
+validate()
+{
+    const fs::path root(TEST ".zarr");
+    CHECK(fs::is_directory(root));
+
+    const auto statistics_path = root / "0" / "chunk_statistics.jsonl";
+    CHECK(fs::is_regular_file(statistics_path));
+
+    std::ifstream f(statistics_path);
+    std::string line;
+    CHECK(std::getline(f, line));
+
+    const json header = json::parse(line);
+    ASSERT_STREQ("u1", header["dtype"]);
+    CHECK(header["histogram_range"] == json({ 0, 256 }));
+    const auto n_bins = header["histogram_bins"].get<int>();
+
+    // one line per chunk, each of empty frames
+    const auto chunk_samples = chunk_width * chunk_height * chunk_planes;
+    auto n_lines = 0;
+    while (std::getline(f, line)) {
+        const json stats = json::parse(line);
+        ASSERT_EQ(int, "%d", 4, stats["chunk"].size());
+        ASSERT_EQ(int, "%d", chunk_samples, stats["count"]);
+        ASSERT_EQ(double, "%g", 0, stats["min"]);
+        ASSERT_EQ(double, "%g", 0, stats["max"]);
+        ASSERT_EQ(int, "%d", n_bins, stats["histogram"].size());
+        ASSERT_EQ(int, "%d", chunk_samples, stats["histogram"][0]);
+        ++n_lines;
+    }
+    ASSERT_EQ(int, "%d", 2 * 2 * (max_frames / chunk_planes), n_lines);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime,
+                TEST ".zarr",
+                R"({"acquire_zarr_options": {"chunk_statistics": true}})");
+        validate();
+
+        // statistics are off by default
+        acquire(runtime, TEST "-off.zarr", R"({"hello": "world"})");
+        CHECK(fs::is_directory(TEST "-off.zarr"));
+        CHECK(!fs::exists(fs::path(TEST "-off.zarr") / "0" /
+                          "chunk_statistics.jsonl"));
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
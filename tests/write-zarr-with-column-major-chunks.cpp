@@ -0,0 +1,104 @@
+/// @brief Test that the chunk order device option stores chunks in
+/// column-major order, declared as `order` in Zarr V2 and as
+/// `chunk_memory_layout` in Zarr V3.
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+const static auto max_frames = 16;
+
+const static char external_metadata[] =
+  R"({"acquire_zarr_options": {"chunk_order": "F"}})";
+
+void
+acquire(AcquireRuntime* runtime, const char* storage_kind, const char* filename)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*random.*",
+                          storage_kind,
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+void
+validate_v2()
+{
+    const fs::path root(TEST "-v2.zarr");
+    CHECK(fs::is_directory(root));
+
+    std::ifstream f(root / "0" / ".zarray");
+    const json zarray = json::parse(f);
+    ASSERT_STREQ("F", zarray["order"]);
+    ASSERT_EQ(int, "%d", max_frames, zarray["shape"][0]);
+
+    // reordering doesn't change the size of raw chunks
+    const auto chunk_bytes = chunk_width * chunk_height * chunk_planes;
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        for (auto y = 0; y < 2; ++y) {
+            for (auto x = 0; x < 2; ++x) {
+                const auto chunk_path = root / "0" / std::to_string(t) / "0" /
+                                        std::to_string(y) / std::to_string(x);
+                CHECK(fs::is_regular_file(chunk_path));
+                ASSERT_EQ(
+                  int, "%d", chunk_bytes, fs::file_size(chunk_path));
+            }
+        }
+    }
+}
+
+void
+validate_v3()
+{
+    const fs::path root(TEST "-v3.zarr");
+    CHECK(fs::is_directory(root));
+
+    std::ifstream f(root / "meta" / "root" / "0.array.json");
+    const json metadata = json::parse(f);
+    ASSERT_STREQ("F", metadata["chunk_memory_layout"]);
+    ASSERT_EQ(int, "%d", max_frames, metadata["shape"][0]);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime, "Zarr", TEST "-v2.zarr");
+        validate_v2();
+
+        acquire(runtime, "ZarrV3", TEST "-v3.zarr");
+        validate_v3();
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,138 @@
+/// @brief Test that chunk filters given in the device options are applied and
+/// declared in the Zarr V2 array metadata, that the options are left out of the
+/// external metadata written to the dataset, and that Zarr V3 devices reject
+/// filters, which their readers would ignore.
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+const static auto max_frames = 16;
+
+void
+acquire(AcquireRuntime* runtime,
+        const char* storage_kind,
+        const char* filename,
+        const std::string& external_metadata)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          storage_kind,
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+
+    // the options survive a round trip through the device
+    {
+        AcquireProperties configured = {};
+        OK(acquire_get_configuration(runtime, &configured));
+        const auto& metadata =
+          configured.video[0].storage.settings.external_metadata_json;
+        CHECK(metadata.str);
+        CHECK(json::parse(metadata.str) == json::parse(external_metadata));
+        storage_properties_destroy(&configured.video[0].storage.settings);
+    }
+
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+void
+validate_v2()
+{
+    const fs::path root(TEST "-v2.zarr");
+    CHECK(fs::is_directory(root));
+
+    std::ifstream f(root / "0" / ".zattrs");
+    CHECK(json::parse(f) == json({ { "hello", "world" } }));
+
+    f = std::ifstream(root / "0" / ".zarray");
+    const json zarray = json::parse(f);
+    ASSERT_EQ(int, "%d", max_frames, zarray["shape"][0]);
+
+    const json expected_filters = json::array({
+      { { "id", "delta" }, { "dtype", "u1" }, { "astype", "u1" } },
+    });
+    CHECK(zarray["filters"] == expected_filters);
+    CHECK(zarray["compressor"].is_null());
+
+    // filters don't change the size of raw chunks
+    const auto chunk_bytes = chunk_width * chunk_height * chunk_planes;
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        for (auto y = 0; y < 2; ++y) {
+            for (auto x = 0; x < 2; ++x) {
+                const auto chunk_path = root / "0" / std::to_string(t) / "0" /
+                                        std::to_string(y) / std::to_string(x);
+                CHECK(fs::is_regular_file(chunk_path));
+                ASSERT_EQ(
+                  int, "%d", chunk_bytes, fs::file_size(chunk_path));
+            }
+        }
+    }
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime,
+                "Zarr",
+                TEST "-v2.zarr",
+                R"({"hello": "world",
+                    "acquire_zarr_options": {
+                      "filters": [{"id": "delta"}]
+                    }})");
+        validate_v2();
+
+        // Zarr V3 readers would skip the filters, so they fail to configure
+        {
+            const std::string external_metadata =
+              R"({"acquire_zarr_options": {"filters": [{"id": "delta"}]}})";
+
+            AcquireProperties props = {};
+            configure_acquisition(runtime,
+                                  props,
+                                  "simulated.*empty.*",
+                                  "ZarrV3",
+                                  TEST "-v3.zarr",
+                                  external_metadata,
+                                  { .frame_width = frame_width,
+                                    .frame_height = frame_height,
+                                    .chunk_width = chunk_width,
+                                    .chunk_height = chunk_height,
+                                    .chunk_planes = chunk_planes,
+                                    .max_frames = max_frames });
+            CHECK(AcquireStatus_Ok != acquire_configure(runtime, &props));
+            storage_properties_destroy(&props.video[0].storage.settings);
+        }
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
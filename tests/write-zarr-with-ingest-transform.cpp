@@ -0,0 +1,117 @@
+/// @brief Test that the ingest transform given in the device options crops and
+/// bins each frame before it is written, and that summed 8-bit bins are stored
+/// as 16-bit samples.
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+// a 48 x 32 region at (8, 8), binned by 2
+const static uint32_t array_width = 24;
+const static uint32_t array_height = 16;
+
+const static uint32_t chunk_width = array_width / 2;
+const static uint32_t chunk_height = array_height / 2;
+const static uint32_t chunk_planes = 8;
+
+const static auto max_frames = 16;
+
+void
+acquire(AcquireRuntime* runtime, const char* filename)
+{
+    AcquireProperties props = {};
+
+    const char external_metadata[] = R"({
+      "acquire_zarr_options": {
+        "ingest_transform": {
+          "roi_x": 8,
+          "roi_y": 8,
+          "roi_width": 48,
+          "roi_height": 32,
+          "binning": 2,
+          "binning_mode": "sum"
+        }
+      }
+    })";
+
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "Zarr",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames,
+                            .array_width = array_width,
+                            .array_height = array_height });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+void
+validate()
+{
+    const fs::path root(TEST ".zarr");
+    CHECK(fs::is_directory(root));
+
+    std::ifstream f(root / "0" / ".zarray");
+    const json zarray = json::parse(f);
+
+    // summed u8 bins are widened to u16
+    CHECK(zarray["dtype"] == "u2");
+
+    const auto& shape = zarray["shape"];
+    ASSERT_EQ(int, "%d", max_frames, shape[0]);
+    ASSERT_EQ(int, "%d", 1, shape[1]);
+    ASSERT_EQ(int, "%d", array_height, shape[2]);
+    ASSERT_EQ(int, "%d", array_width, shape[3]);
+
+    const auto chunk_bytes =
+      sizeof(uint16_t) * chunk_width * chunk_height * chunk_planes;
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        for (auto y = 0; y < 2; ++y) {
+            for (auto x = 0; x < 2; ++x) {
+                const auto chunk_path = root / "0" / std::to_string(t) / "0" /
+                                        std::to_string(y) / std::to_string(x);
+                CHECK(fs::is_regular_file(chunk_path));
+                ASSERT_EQ(
+                  int, "%d", chunk_bytes, fs::file_size(chunk_path));
+            }
+        }
+    }
+
+    // there's no chunk past the transformed frame
+    CHECK(!fs::exists(root / "0" / "0" / "0" / "0" / "2"));
+    CHECK(!fs::exists(root / "0" / "0" / "0" / "2"));
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime, TEST ".zarr");
+        validate();
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
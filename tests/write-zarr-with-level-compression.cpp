@@ -0,0 +1,136 @@
+/// @brief Test that the `level_compression` device option sets the codec,
+/// compression level, and shuffle of each multiscale level, with the last
+/// entry applying to every coarser level, and that each array's metadata
+/// declares its compressor, for both Zarr V2 and Zarr V3.
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 256;
+const static uint32_t frame_height = 256;
+
+const static uint32_t chunk_width = 64;
+const static uint32_t chunk_height = 64;
+const static uint32_t chunk_planes = 4;
+
+const static auto max_frames = 16;
+
+const static AcquisitionShape shape = { .frame_width = frame_width,
+                                        .frame_height = frame_height,
+                                        .chunk_width = chunk_width,
+                                        .chunk_height = chunk_height,
+                                        .chunk_planes = chunk_planes,
+                                        .max_frames = max_frames };
+
+void
+acquire(AcquireRuntime* runtime,
+        const char* storage_kind,
+        const char* filename,
+        const std::string& external_metadata,
+        bool enable_multiscale)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          storage_kind,
+                          filename,
+                          external_metadata,
+                          shape);
+    CHECK(storage_properties_set_enable_multiscale(
+      &props.video[0].storage.settings, enable_multiscale));
+    acquire_and_stop(runtime, props);
+}
+
+void
+validate_v2()
+{
+    const fs::path root(TEST "-v2.zarr");
+    CHECK(fs::is_directory(root));
+
+    // full resolution is raw
+    const json level_0 = read_json(root / "0" / ".zarray");
+    CHECK(level_0["compressor"].is_null());
+
+    const auto bytes_of_chunk = chunk_width * chunk_height * chunk_planes;
+    const auto chunk_path = root / "0" / "0" / "0" / "0" / "0";
+    CHECK(fs::is_regular_file(chunk_path));
+    ASSERT_EQ(int, "%d", bytes_of_chunk, fs::file_size(chunk_path));
+
+    const json level_1 = read_json(root / "1" / ".zarray");
+    ASSERT_STREQ("blosc", level_1["compressor"]["id"]);
+    ASSERT_STREQ("zstd", level_1["compressor"]["cname"]);
+    ASSERT_EQ(int, "%d", 3, level_1["compressor"]["clevel"].get<int>());
+    ASSERT_EQ(int, "%d", 2, level_1["compressor"]["shuffle"].get<int>());
+
+    // the last entry applies to every coarser level
+    auto n_levels = 2;
+    for (; fs::is_directory(root / std::to_string(n_levels)); ++n_levels) {
+        const json level =
+          read_json(root / std::to_string(n_levels) / ".zarray");
+        ASSERT_STREQ("blosc", level["compressor"]["id"]);
+        ASSERT_STREQ("lz4", level["compressor"]["cname"]);
+        ASSERT_EQ(int, "%d", 5, level["compressor"]["clevel"].get<int>());
+        ASSERT_EQ(int, "%d", 1, level["compressor"]["shuffle"].get<int>());
+    }
+    ASSERT_GT(int, "%d", n_levels, 2);
+}
+
+void
+validate_v3()
+{
+    const fs::path root(TEST "-v3.zarr");
+    CHECK(fs::is_directory(root));
+
+    // Zarr V3 has no multiscale, so only the first entry applies
+    const json metadata = read_json(root / "meta" / "root" / "0.array.json");
+    const auto& compressor = metadata["compressor"];
+    CHECK("https://purl.org/zarr/spec/codec/blosc/1.0" == compressor["codec"]);
+
+    const auto& compressor_config = compressor["configuration"];
+    ASSERT_STREQ("zstd", compressor_config["cname"]);
+    ASSERT_EQ(int, "%d", 3, compressor_config["clevel"].get<int>());
+    ASSERT_EQ(int, "%d", 2, compressor_config["shuffle"].get<int>());
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime,
+                "Zarr",
+                TEST "-v2.zarr",
+                R"({"acquire_zarr_options": {
+                      "level_compression": [
+                        null,
+                        {"cname": "zstd", "clevel": 3, "shuffle": 2},
+                        {"cname": "lz4", "clevel": 5, "shuffle": 1}
+                      ]
+                    }})",
+                true);
+        validate_v2();
+
+        acquire(runtime,
+                "ZarrV3",
+                TEST "-v3.zarr",
+                R"({"acquire_zarr_options": {
+                      "level_compression": [
+                        {"cname": "zstd", "clevel": 3, "shuffle": 2}
+                      ]
+                    }})",
+                false);
+        validate_v3();
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
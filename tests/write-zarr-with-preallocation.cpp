@@ -0,0 +1,174 @@
+/// @brief Test that preallocating chunk and shard files leaves each one at
+/// exactly the size of what was written to it, for raw and compressed Zarr V2
+/// chunks and raw Zarr V3 shards, including ragged and partly filled ones.
+
+#include "test.harness.hh"
+
+#include <algorithm>
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+// ragged, so edge chunks are padded to full size
+const static uint32_t chunk_width = 24;
+const static uint32_t chunk_height = 20;
+const static uint32_t chunk_planes = 8;
+const static uint32_t chunks_in_x = 3;
+const static uint32_t chunks_in_y = 3;
+
+// one shard holds 2 x 2 chunks
+const static uint32_t shard_width = 2;
+const static uint32_t shard_height = 2;
+const static uint32_t chunks_per_shard = shard_width * shard_height;
+const static uint32_t shards_in_x = 2;
+const static uint32_t shards_in_y = 2;
+
+// the last chunks are only half filled
+const static auto max_frames = 12;
+const static auto n_timepoints =
+  (max_frames + chunk_planes - 1) / chunk_planes;
+
+const static size_t bytes_of_chunk = chunk_width * chunk_height * chunk_planes;
+
+// Blosc header layout: version, versionlz, flags, typesize, then nbytes,
+// blocksize, and cbytes as little-endian 32-bit integers
+const static size_t blosc_header_bytes = 16;
+
+void
+acquire(AcquireRuntime* runtime,
+        const char* camera,
+        const char* storage_kind,
+        const char* filename)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          camera,
+                          storage_kind,
+                          filename,
+                          "",
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames,
+                            .shard_width = shard_width,
+                            .shard_height = shard_height });
+    acquire_and_stop(runtime, props);
+}
+
+uint32_t
+read_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+void
+validate_v2_raw(const fs::path& root)
+{
+    CHECK(fs::is_directory(root));
+
+    for (auto t = 0; t < n_timepoints; ++t) {
+        for (auto y = 0; y < chunks_in_y; ++y) {
+            for (auto x = 0; x < chunks_in_x; ++x) {
+                const auto chunk_path = root / "0" / std::to_string(t) / "0" /
+                                        std::to_string(y) / std::to_string(x);
+                CHECK(fs::is_regular_file(chunk_path));
+                ASSERT_EQ(
+                  int, "%d", bytes_of_chunk, fs::file_size(chunk_path));
+            }
+        }
+    }
+}
+
+/// Check that each compressed chunk file ends where its Blosc frame does.
+void
+validate_v2_compressed(const fs::path& root)
+{
+    CHECK(fs::is_directory(root));
+
+    for (auto t = 0; t < n_timepoints; ++t) {
+        for (auto y = 0; y < chunks_in_y; ++y) {
+            for (auto x = 0; x < chunks_in_x; ++x) {
+                const auto chunk_path = root / "0" / std::to_string(t) / "0" /
+                                        std::to_string(y) / std::to_string(x);
+                CHECK(fs::is_regular_file(chunk_path));
+
+                uint8_t header[blosc_header_bytes];
+                std::ifstream f(chunk_path, std::ios::binary);
+                f.read((char*)header, sizeof(header));
+                CHECK(f.good());
+
+                ASSERT_EQ(int, "%d", bytes_of_chunk, read_u32(header + 4));
+                ASSERT_EQ(int,
+                          "%d",
+                          read_u32(header + 12),
+                          fs::file_size(chunk_path));
+            }
+        }
+    }
+}
+
+void
+validate_v3_raw(const fs::path& root)
+{
+    CHECK(fs::is_directory(root));
+
+    // an offset and a size for each chunk a full shard holds
+    const auto index_bytes = 2 * sizeof(uint64_t) * chunks_per_shard;
+
+    for (auto t = 0; t < n_timepoints; ++t) {
+        for (auto y = 0; y < shards_in_y; ++y) {
+            for (auto x = 0; x < shards_in_x; ++x) {
+                // shards on the ragged edges hold fewer chunks
+                const auto chunks_this_shard =
+                  std::min(shard_width, chunks_in_x - x * shard_width) *
+                  std::min(shard_height, chunks_in_y - y * shard_height);
+                const auto expected_shard_bytes =
+                  chunks_this_shard * bytes_of_chunk + index_bytes;
+
+                const auto shard_path = root / "data" / "root" / "0" /
+                                        ("c" + std::to_string(t)) / "0" /
+                                        std::to_string(y) / std::to_string(x);
+                CHECK(fs::is_regular_file(shard_path));
+                ASSERT_EQ(int,
+                          "%d",
+                          expected_shard_bytes,
+                          fs::file_size(shard_path));
+            }
+        }
+    }
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime, "simulated.*random.*", "Zarr", TEST "-v2.zarr");
+        validate_v2_raw(TEST "-v2.zarr");
+
+        acquire(runtime,
+                "simulated.*empty.*",
+                "ZarrBlosc1ZstdByteShuffle",
+                TEST "-v2-zstd.zarr");
+        validate_v2_compressed(TEST "-v2-zstd.zarr");
+
+        acquire(runtime, "simulated.*random.*", "ZarrV3", TEST "-v3.zarr");
+        validate_v3_raw(TEST "-v3.zarr");
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,187 @@
+/// @brief Test that the preview device option writes a decimated copy of the
+/// latest frame to a file, as a packed VideoFrame, for a GUI to poll, and that
+/// a stalled preview write doesn't stall appending frames.
+
+#include <chrono>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+const static uint32_t preview_max_width = 16;
+const static uint32_t preview_max_height = 16;
+
+const static auto max_frames = 16;
+
+void
+acquire(AcquireRuntime* runtime,
+        const char* filename,
+        const std::string& external_metadata)
+{
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "Zarr",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+#ifndef _WIN32
+/// @brief Put a FIFO with no reader where the preview is written aside, so
+/// that writing the preview file blocks, and check that every frame is still
+/// appended and flushed before the FIFO is drained.
+void
+acquire_with_blocked_preview(AcquireRuntime* runtime,
+                             const char* filename,
+                             const std::string& external_metadata,
+                             const fs::path& preview_path)
+{
+    const auto tmp_path = preview_path.string() + ".tmp";
+    fs::remove(tmp_path);
+    CHECK(0 == mkfifo(tmp_path.c_str(), 0600));
+
+    AcquireProperties props = {};
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "Zarr",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+
+    // the last chunk is only flushed once every frame has been appended
+    const auto last_chunk = fs::path(filename) / "0" /
+                            std::to_string(max_frames / chunk_planes - 1) /
+                            "0" / "1" / "1";
+    const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!fs::exists(last_chunk) &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    const bool appended_while_blocked = fs::exists(last_chunk);
+
+    // let the write through, whether or not appending got through
+    {
+        std::ifstream fifo(tmp_path, std::ios::binary);
+        const std::vector<char> bytes((std::istreambuf_iterator<char>(fifo)),
+                                      std::istreambuf_iterator<char>());
+        CHECK(bytes.size() > sizeof(VideoFrame));
+    }
+
+    OK(acquire_stop(runtime));
+    storage_properties_destroy(&props.video[0].storage.settings);
+
+    CHECK(appended_while_blocked);
+
+    // the drained FIFO was renamed into place
+    fs::remove(preview_path);
+}
+#endif
+
+void
+validate(const fs::path& preview_path)
+{
+    CHECK(fs::is_directory(TEST ".zarr"));
+    CHECK(fs::is_regular_file(preview_path));
+
+    // the file is only ever replaced whole
+    CHECK(!fs::exists(preview_path.string() + ".tmp"));
+
+    std::ifstream f(preview_path, std::ios::binary);
+    const std::vector<char> bytes((std::istreambuf_iterator<char>(f)),
+                                  std::istreambuf_iterator<char>());
+    CHECK(bytes.size() > sizeof(VideoFrame));
+
+    const auto* frame = (const VideoFrame*)bytes.data();
+    ASSERT_EQ(int, "%d", bytes.size(), frame->bytes_of_frame);
+    ASSERT_EQ(int, "%d", SampleType_u8, frame->shape.type);
+    CHECK(frame->frame_id < max_frames);
+
+    // 64 x 48 sampled every 4th pixel
+    ASSERT_EQ(int, "%d", frame_width / 4, frame->shape.dims.width);
+    ASSERT_EQ(int, "%d", frame_height / 4, frame->shape.dims.height);
+    CHECK(frame->shape.dims.width <= preview_max_width);
+    CHECK(frame->shape.dims.height <= preview_max_height);
+    ASSERT_EQ(int,
+              "%d",
+              sizeof(VideoFrame) +
+                frame->shape.dims.width * frame->shape.dims.height,
+              frame->bytes_of_frame);
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        const auto preview_path = fs::absolute(TEST "-preview.bin");
+        fs::remove(preview_path);
+
+        const json external_metadata = {
+            { "acquire_zarr_options",
+              { { "preview",
+                  { { "max_width", preview_max_width },
+                    { "max_height", preview_max_height },
+                    { "path", preview_path.string() } } } } },
+        };
+        acquire(runtime, TEST ".zarr", external_metadata.dump());
+        validate(preview_path);
+
+#ifndef _WIN32
+        // the blocked write holds one of the device's threads, and flushing
+        // needs another
+        if (std::thread::hardware_concurrency() > 1) {
+            acquire_with_blocked_preview(runtime,
+                                         TEST "-blocked.zarr",
+                                         external_metadata.dump(),
+                                         preview_path);
+        }
+#endif
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}
@@ -0,0 +1,133 @@
+/// @brief Test that regions of interest given in the device options are each
+/// written to their own array, with their own chunking and compression, and
+/// listed in the group metadata.
+
+#include "test.harness.hh"
+
+const static uint32_t frame_width = 64;
+const static uint32_t frame_height = 48;
+
+const static uint32_t chunk_width = frame_width / 2;
+const static uint32_t chunk_height = frame_height / 2;
+const static uint32_t chunk_planes = 8;
+
+const static auto max_frames = 16;
+
+void
+acquire(AcquireRuntime* runtime, const char* filename)
+{
+    AcquireProperties props = {};
+
+    // "cell" takes its chunk size from the full frame, capped at its size
+    const char external_metadata[] = R"({
+      "acquire_zarr_options": {
+        "roi_arrays": [
+          {"name": "cell", "x": 16, "y": 8, "width": 20, "height": 12},
+          {
+            "name": "field",
+            "x": 0,
+            "y": 0,
+            "width": 64,
+            "height": 48,
+            "chunk_width": 16,
+            "chunk_height": 16,
+            "compression": {"cname": "zstd", "clevel": 1, "shuffle": 1}
+          }
+        ]
+      }
+    })";
+
+    configure_acquisition(runtime,
+                          props,
+                          "simulated.*empty.*",
+                          "Zarr",
+                          filename,
+                          external_metadata,
+                          { .frame_width = frame_width,
+                            .frame_height = frame_height,
+                            .chunk_width = chunk_width,
+                            .chunk_height = chunk_height,
+                            .chunk_planes = chunk_planes,
+                            .max_frames = max_frames });
+
+    OK(acquire_configure(runtime, &props));
+    OK(acquire_start(runtime));
+    OK(acquire_stop(runtime));
+
+    storage_properties_destroy(&props.video[0].storage.settings);
+}
+
+void
+validate()
+{
+    const fs::path root(TEST ".zarr");
+    CHECK(fs::is_directory(root));
+
+    // the group lists both regions
+    std::ifstream f(root / ".zattrs");
+    const json group = json::parse(f);
+    const auto& rois = group["roi_arrays"];
+    ASSERT_EQ(int, "%d", 2, rois.size());
+    CHECK(rois[0] == json({ { "path", "cell" },
+                            { "x", 16 },
+                            { "y", 8 },
+                            { "width", 20 },
+                            { "height", 12 } }));
+    ASSERT_STREQ("field", rois[1]["path"]);
+
+    // the full frame is still written
+    CHECK(fs::is_regular_file(root / "0" / ".zarray"));
+
+    f = std::ifstream(root / "cell" / ".zarray");
+    json zarray = json::parse(f);
+    CHECK(zarray["shape"] == json({ max_frames, 1, 12, 20 }));
+    CHECK(zarray["chunks"] == json({ chunk_planes, 1, 12, 20 }));
+    CHECK(zarray["compressor"].is_null());
+
+    const auto cell_chunk_bytes = 12 * 20 * chunk_planes;
+    for (auto t = 0; t < max_frames / chunk_planes; ++t) {
+        const auto chunk_path =
+          root / "cell" / std::to_string(t) / "0" / "0" / "0";
+        CHECK(fs::is_regular_file(chunk_path));
+        ASSERT_EQ(int, "%d", cell_chunk_bytes, fs::file_size(chunk_path));
+    }
+
+    f = std::ifstream(root / "field" / ".zarray");
+    zarray = json::parse(f);
+    CHECK(zarray["shape"] == json({ max_frames, 1, 48, 64 }));
+    CHECK(zarray["chunks"] == json({ chunk_planes, 1, 16, 16 }));
+    ASSERT_STREQ("zstd", zarray["compressor"]["cname"]);
+
+    // 3 x 4 chunks per plane of chunks, compressed
+    const auto field_chunk_bytes = 16 * 16 * chunk_planes;
+    for (auto y = 0; y < 3; ++y) {
+        for (auto x = 0; x < 4; ++x) {
+            const auto chunk_path = root / "field" / "1" / "0" /
+                                    std::to_string(y) / std::to_string(x);
+            CHECK(fs::is_regular_file(chunk_path));
+            ASSERT_GT(int, "%d", field_chunk_bytes, fs::file_size(chunk_path));
+        }
+    }
+}
+
+int
+main()
+{
+    int retval = 1;
+    AcquireRuntime* runtime = acquire_init(reporter);
+
+    try {
+        acquire(runtime, TEST ".zarr");
+        validate();
+
+        retval = 0;
+        LOG("Done (OK)");
+    } catch (const std::exception& exc) {
+        ERR("Exception: %s", exc.what());
+    } catch (...) {
+        ERR("Unknown exception");
+    }
+
+    acquire_shutdown(runtime);
+    return retval;
+}